@@ -0,0 +1,34 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Constant-initialized, so touching it from operator new needs no TLS setup.
+thread_local uint64_t thread_alloc_count = 0;
+}
+
+uint64_t AllocCounter::count() { return thread_alloc_count; }
+
+// Replacing the plain forms is enough: the default array and nothrow forms
+// forward to them.
+void* operator new(std::size_t size) {
+  thread_alloc_count++;
+  if (size == 0) {
+    size = 1;
+  }
+  while (true) {
+    if (void* p = std::malloc(size)) {
+      return p;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// Counts calls to the global operator new, per thread. Used by the frame
+// profiler to report allocations per frame, which the sampler and helper
+// threads allocating at the same time must not inflate.
+namespace AllocCounter {
+/**
+ * @return allocations made by the calling thread so far.
+ */
+uint64_t count();
+}  // namespace AllocCounter
@@ -0,0 +1,367 @@
+#include "apply_daemon.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "nlohmann/json.hpp"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+const size_t MAX_REQUEST_LENGTH = 64 << 10;
+}
+
+ApplyDaemon::~ApplyDaemon() {
+#ifndef _WIN32
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+#endif
+}
+
+std::string ApplyDaemon::socket_path(const std::string& user_name) {
+  return fmt::format("/run/nvtuner-{}.sock", user_name);
+}
+
+bool ApplyDaemon::apply_saved_profiles(std::vector<ApplyResult>& results) {
+  // Re-read every time: the TUI saves right before asking.
+  ProfileManager pm(profile_path_, nvml_.get_gpus());
+  std::map<std::string, OcProfile> profiles = pm.get_all_profiles();
+  if (pm.get_node_config().power_budget_w > 0) {
+    // The budget owns the power limits: keep what is on the hardware and let
+    // it move them, decreases first.
+    nvml_.update_dynamic_state();
+    for (const auto& gs : nvml_.get_gpus()) {
+      if (gs.power_limit_w >= 0) {
+        profiles.at(gs.uuid).power_limit = gs.power_limit_w;
+      }
+    }
+  }
+  bool success = nvml_.apply_profiles(profiles, &results);
+
+  // Both restart from the newly applied limits.
+  budget_.configure(pm.get_node_config());
+  if (budget_.active()) {
+    budget_.redistribute();
+  }
+  governor_.configure(pm);
+  std::vector<bool> keep_power_limit;
+  for (size_t i = 0; i < nvml_.get_gpus().size(); ++i) {
+    keep_power_limit.push_back(budget_.active() || governor_.governs(i));
+  }
+  switcher_.configure(pm, std::move(keep_power_limit));
+  fans_.configure(pm);
+  watchdog_.configure(pm);
+  recorder_.configure(pm.get_recorder_config(), nvml_.get_gpus());
+  return success;
+}
+
+#ifdef _WIN32
+
+ApplyDaemon::ApplyDaemon(NvmlManager& nvml, std::string profile_path,
+                         const std::string& user_name,
+                         std::string boot_guard_path,
+                         std::string recording_dir)
+    : nvml_(nvml),
+      governor_(nvml),
+      budget_(nvml),
+      switcher_(nvml),
+      fans_(nvml),
+      watchdog_(nvml, profile_path, boot_guard_path),
+      recorder_(std::move(recording_dir)),
+      profile_path_(std::move(profile_path)),
+      boot_guard_path_(std::move(boot_guard_path)) {
+  throw std::runtime_error("The resident helper is not supported on Windows.");
+}
+
+void ApplyDaemon::run(const std::atomic<bool>&) {}
+
+ApplyDaemon::RequestStatus ApplyDaemon::request_apply(
+    const std::string&, std::vector<ApplyResult>&) {
+  return RequestStatus::Unavailable;
+}
+
+#else
+
+namespace {
+
+bool make_address(const std::string& path, sockaddr_un& addr) {
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+void set_timeouts(int fd, int seconds) {
+  timeval tv{seconds, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * @return false on timeout, error, EOF before a newline or an overlong line.
+ */
+bool read_line(int fd, std::string& line) {
+  char buf[4096];
+  while (line.find('\n') == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0 || line.size() + n > MAX_REQUEST_LENGTH) {
+      return false;
+    }
+    line.append(buf, n);
+  }
+  line.resize(line.find('\n'));
+  return true;
+}
+
+bool write_all(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+}  // namespace
+
+ApplyDaemon::ApplyDaemon(NvmlManager& nvml, std::string profile_path,
+                         const std::string& user_name,
+                         std::string boot_guard_path,
+                         std::string recording_dir)
+    : nvml_(nvml),
+      governor_(nvml),
+      budget_(nvml),
+      switcher_(nvml),
+      fans_(nvml),
+      watchdog_(nvml, profile_path, boot_guard_path),
+      recorder_(std::move(recording_dir)),
+      profile_path_(std::move(profile_path)),
+      boot_guard_path_(std::move(boot_guard_path)),
+      socket_path_(socket_path(user_name)) {
+  struct passwd* pw = getpwnam(user_name.c_str());
+  if (pw == nullptr) {
+    throw std::runtime_error("Unknown user: " + user_name);
+  }
+  user_uid_ = pw->pw_uid;
+
+  sockaddr_un addr;
+  if (!make_address(socket_path_, addr)) {
+    throw std::runtime_error("Socket path too long: " + socket_path_);
+  }
+  unlink(socket_path_.c_str());
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  // Only the target user can open the socket; SO_PEERCRED is checked anyway.
+  mode_t old_umask = umask(0177);
+  bool bound = listen_fd_ >= 0 &&
+               bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+                    sizeof(addr)) == 0;
+  umask(old_umask);
+  if (!bound || chown(socket_path_.c_str(), pw->pw_uid, pw->pw_gid) != 0 ||
+      chmod(socket_path_.c_str(), 0600) != 0 || listen(listen_fd_, 4) != 0) {
+    throw std::runtime_error(fmt::format("Cannot listen on {}: {}",
+                                         socket_path_, std::strerror(errno)));
+  }
+}
+
+void ApplyDaemon::run(const std::atomic<bool>& stop) {
+  if (!boot_guard_path_.empty()) {
+    BootGuard::check_and_arm(nvml_.get_gpus(), profile_path_,
+                             boot_guard_path_);
+  }
+  std::vector<ApplyResult> results;
+  apply_saved_profiles(results);
+  std::clog << fmt::format("Waiting for apply requests on {}.", socket_path_)
+            << std::endl;
+
+  const auto GOVERNOR_PERIOD = std::chrono::seconds(1);
+  // Rules should follow a workload starting or stopping within a second.
+  const auto SWITCHER_PERIOD = std::chrono::milliseconds(500);
+  auto last_tick = std::chrono::steady_clock::now();
+  auto last_switch_tick = last_tick;
+  auto last_record_tick = last_tick;
+  while (!stop) {
+    auto timeout = std::chrono::milliseconds(250);  // bounds stopping time
+    if (recorder_.active()) {
+      // Round up, so the wait does not end just before the sample is due.
+      auto until_record = std::chrono::ceil<std::chrono::milliseconds>(
+          last_record_tick + recorder_.period() -
+          std::chrono::steady_clock::now());
+      timeout = std::clamp(until_record, std::chrono::milliseconds(0),
+                           timeout);
+    }
+    pollfd pfd{listen_fd_, POLLIN, 0};
+    int ret = poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ret < 0 && errno != EINTR) {
+      std::cerr << fmt::format("Daemon poll failed: {}", std::strerror(errno))
+                << std::endl;
+      break;
+    }
+
+    // Nothing may stop the helper short of a signal: leaving the loop early
+    // would skip restoring power limits and fans below.
+    auto now = std::chrono::steady_clock::now();
+    try {
+      bool sampled = false;
+      if (recorder_.active() && now - last_record_tick >= recorder_.period()) {
+        last_record_tick = now;
+        nvml_.update_dynamic_state();
+        recorder_.add_sample(nvml_.get_gpus());
+        sampled = true;
+      }
+      if (now - last_tick >= GOVERNOR_PERIOD) {
+        double dt_s = std::chrono::duration<double>(now - last_tick).count();
+        last_tick = now;
+        if (governor_.active() || budget_.active() || fans_.active()) {
+          if (!sampled) {
+            nvml_.update_dynamic_state();
+          }
+          governor_.tick(dt_s);
+          budget_.tick(dt_s);
+          fans_.tick();
+        }
+        if (watchdog_.tick(switcher_)) {
+          apply_saved_profiles(results);
+        }
+      }
+      if (switcher_.active() && now - last_switch_tick >= SWITCHER_PERIOD) {
+        last_switch_tick = now;
+        switcher_.tick();
+      }
+    } catch (const std::exception& e) {
+      std::cerr << fmt::format("Daemon tick failed: {}", e.what())
+                << std::endl;
+    }
+
+    if (ret <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd >= 0) {
+      try {
+        serve_client(fd);
+      } catch (const std::exception& e) {
+        std::cerr << fmt::format("Apply request failed: {}", e.what())
+                  << std::endl;
+      }
+      close(fd);
+    }
+  }
+  governor_.restore();
+  fans_.restore();
+  if (!boot_guard_path_.empty()) {
+    BootGuard::disarm(boot_guard_path_);
+  }
+}
+
+void ApplyDaemon::serve_client(int fd) {
+  ucred cred{};
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    std::cerr << fmt::format("Rejected apply request; cannot identify the "
+                             "client: {}",
+                             std::strerror(errno))
+              << std::endl;
+    return;
+  }
+  if (cred.uid != 0 && cred.uid != user_uid_) {
+    std::cerr << fmt::format("Rejected apply request from uid {}.", cred.uid)
+              << std::endl;
+    return;
+  }
+
+  // Requests are handled one at a time; a stuck client must not block others
+  // for long.
+  set_timeouts(fd, 2);
+  std::string line;
+  if (!read_line(fd, line)) {
+    return;
+  }
+  json request = json::parse(line, nullptr, false);
+  json response;
+  if (!request.is_object() || request.value("command", json()) != "apply") {
+    response = {{"ok", false}, {"error", "unknown request"}};
+  } else {
+    std::clog << fmt::format("Apply requested by pid {}.", cred.pid)
+              << std::endl;
+    std::vector<ApplyResult> results;
+    bool ok = apply_saved_profiles(results);
+    json results_json = json::array();
+    for (const auto& r : results) {
+      results_json.push_back({{"index", r.index},
+                              {"success", r.success},
+                              {"writes", r.writes},
+                              {"us", r.duration.count()}});
+    }
+    response = {{"ok", ok}, {"results", std::move(results_json)}};
+  }
+  write_all(fd, response.dump() + "\n");
+}
+
+ApplyDaemon::RequestStatus ApplyDaemon::request_apply(
+    const std::string& user_name, std::vector<ApplyResult>& results) {
+  sockaddr_un addr;
+  if (!make_address(socket_path(user_name), addr)) {
+    return RequestStatus::Unavailable;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return RequestStatus::Unavailable;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return RequestStatus::Unavailable;  // not opted in, or not running
+  }
+
+  set_timeouts(fd, 10);
+  std::string line;
+  bool answered = write_all(fd, json{{"command", "apply"}}.dump() + "\n") &&
+                  read_line(fd, line);
+  close(fd);
+  if (!answered) {
+    return RequestStatus::Failed;
+  }
+
+  json response = json::parse(line, nullptr, false);
+  if (response.is_discarded()) {
+    return RequestStatus::Failed;
+  }
+  results.clear();
+  try {
+    for (const auto& r : response.value("results", json::array())) {
+      results.push_back({r.at("index").get<unsigned int>(),
+                         r.at("success").get<bool>(), r.at("writes").get<int>(),
+                         std::chrono::microseconds(r.at("us").get<long long>())});
+    }
+  } catch (const json::exception&) {
+    return RequestStatus::Failed;
+  }
+  return response.value("ok", false) ? RequestStatus::Applied
+                                     : RequestStatus::Failed;
+}
+
+#endif
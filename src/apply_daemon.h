@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "fan_controller.h"
+#include "flight_recorder.h"
+#include "nvtuner.h"
+#include "oc_watchdog.h"
+#include "power_budget.h"
+#include "power_governor.h"
+#include "profile_switcher.h"
+
+// Resident root helper, `nvtuner --daemon`, started by the systemd unit when
+// the user opts in. It keeps NVML initialized and applies the user's saved
+// profiles when asked over a Unix socket, so the TUI gets per-GPU results in
+// milliseconds instead of going through pkexec. It also runs the node power
+// budget or, without one, the power limit governors, the fan curves, the OC
+// watchdog and the flight recorder, and switches presets by the profile
+// rules. Linux only.
+//
+// Protocol: one JSON line each way.
+//   -> {"command": "apply"}
+//   <- {"ok": true, "results": [{"index": 0, "success": true, "writes": 1,
+//       "us": 850}, ...]}
+class ApplyDaemon {
+ public:
+  /**
+   * @param user_name only root and this user may connect.
+   * @param boot_guard_path see BootGuard; empty if not started at boot.
+   * @param recording_dir where the flight recorder writes its captures.
+   * @throw std::runtime_error if the socket cannot be created.
+   */
+  ApplyDaemon(NvmlManager& nvml, std::string profile_path,
+              const std::string& user_name, std::string boot_guard_path,
+              std::string recording_dir);
+  ~ApplyDaemon();
+
+  ApplyDaemon(const ApplyDaemon&) = delete;
+  ApplyDaemon& operator=(const ApplyDaemon&) = delete;
+
+  /**
+   * @brief Apply the saved profiles once, then serve and govern until `stop`
+   * is true.
+   */
+  void run(const std::atomic<bool>& stop);
+
+  /**
+   * @return true if all GPUs succeeded.
+   */
+  bool apply_saved_profiles(std::vector<ApplyResult>& results);
+
+  static std::string socket_path(const std::string& user_name);
+
+  enum class RequestStatus { Unavailable, Applied, Failed };
+  /**
+   * @brief Ask the daemon serving `user_name` to apply the saved profiles.
+   * @return Unavailable if no daemon is running; callers fall back to pkexec.
+   */
+  static RequestStatus request_apply(const std::string& user_name,
+                                     std::vector<ApplyResult>& results);
+
+ private:
+  void serve_client(int fd);
+
+  NvmlManager& nvml_;
+  PowerGovernor governor_;
+  PowerBudget budget_;
+  ProfileSwitcher switcher_;
+  FanController fans_;
+  OcWatchdog watchdog_;
+  FlightRecorder recorder_;
+  std::string profile_path_;
+  std::string boot_guard_path_;
+  std::string socket_path_;
+  unsigned int user_uid_ = 0;
+  int listen_fd_ = -1;
+};
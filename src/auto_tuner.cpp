@@ -0,0 +1,327 @@
+#include "auto_tuner.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+// A candidate is unstable if utilization falls below this fraction of the
+// baseline: the workload crashed or hung.
+const double STABLE_UTIL_RATIO = 0.5;
+// Lowering the power limit is free while the score stays within this.
+const double SCORE_TOLERANCE = 0.005;
+const double MAX_WORKLOAD_WAIT_S = 120;
+
+int round_to_step(double value, int step) {
+  return static_cast<int>(std::lround(value / step)) * step;
+}
+}  // namespace
+
+// --- Backends ---
+
+NvmlTuningBackend::NvmlTuningBackend(NvmlManager& nvml, size_t gpu_index)
+    : nvml_(nvml), gpu_index_(gpu_index) {}
+
+const GpuState& NvmlTuningBackend::gpu() const {
+  return nvml_.get_gpus()[gpu_index_];
+}
+
+bool NvmlTuningBackend::apply(const OcProfile& profile) {
+  std::vector<std::string> log;
+  ApplyResult result = nvml_.apply_profile(gpu(), profile, log);
+  if (!result.success) {
+    std::cerr << log.back() << std::endl;
+  }
+  return result.success;
+}
+
+void NvmlTuningBackend::wait_and_sample(double seconds) {
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  nvml_.update_dynamic_state();
+}
+
+SimulatedTuningBackend::SimulatedTuningBackend(unsigned int gpu_count,
+                                               size_t gpu_index)
+    : simulator_(gpu_count),
+      gpus_(simulator_.create_gpus()),
+      gpu_index_(gpu_index) {
+  simulator_.hold_load(gpus_.at(gpu_index_), 1.0);
+}
+
+const GpuState& SimulatedTuningBackend::gpu() const {
+  return gpus_[gpu_index_];
+}
+
+bool SimulatedTuningBackend::apply(const OcProfile& profile) {
+  simulator_.set_power_limit(gpu(), profile.power_limit);
+  simulator_.set_clock_offset(gpu(), profile.gpu_clock_offset);
+  simulator_.set_locked_clocks(gpu(), locked_min_gpu_clock(profile),
+                               profile.max_gpu_clock);
+  return true;
+}
+
+void SimulatedTuningBackend::wait_and_sample(double seconds) {
+  simulator_.step(gpus_, seconds);
+}
+
+// --- AutoTuner ---
+
+AutoTuner::AutoTuner(TuningBackend& backend, TuningOptions options)
+    : backend_(backend), options_(options) {}
+
+TuningResult AutoTuner::run(const OcProfile& start) {
+  const GpuState& gs = backend_.gpu();
+  TuningResult result;
+  result.profile = start;
+
+  std::clog << fmt::format(
+                   "Auto-tuning GPU {}. Keep your workload running; this "
+                   "takes a while.",
+                   gs.index)
+            << std::endl;
+
+  last_good_ = start;
+  try {
+    if (!backend_.apply(start)) {
+      throw std::runtime_error("Cannot apply profiles. Run as root?");
+    }
+    for (double t = 0; t < options_.warmup_s; t += options_.sample_period_s) {
+      backend_.wait_and_sample(options_.sample_period_s);
+    }
+
+    Evaluation base = evaluate(start);
+    baseline_ = base.measurement;
+    if (baseline_.util < 0.3) {
+      throw std::runtime_error(
+          "GPU is mostly idle. Start a steady workload first.");
+    }
+    base.score = score(baseline_);
+    cache_[{start.power_limit, start.gpu_clock_offset, start.max_gpu_clock}] =
+        base;
+
+    OcProfile profile = start;
+    profile.gpu_clock_offset = search_offset(profile);
+    profile.max_gpu_clock = search_max_clock(profile);
+    Evaluation tuned = evaluate(profile);
+    profile.power_limit = search_power_limit(profile, tuned.score);
+    tuned = evaluate(profile);
+
+    result.success = true;
+    result.baseline = baseline_;
+    if (tuned.stable && tuned.score > base.score) {
+      result.profile = profile;
+      result.best = tuned.measurement;
+    } else {
+      std::clog << "No better profile found; keeping the current one."
+                << std::endl;
+      result.best = baseline_;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << fmt::format("Auto-tuning GPU {} failed: {}", gs.index,
+                             e.what())
+              << std::endl;
+  }
+
+  backend_.apply(result.profile);
+  result.evaluations = evaluations_;
+  return result;
+}
+
+AutoTuner::Evaluation AutoTuner::evaluate(const OcProfile& profile) {
+  auto key = std::make_tuple(profile.power_limit, profile.gpu_clock_offset,
+                             profile.max_gpu_clock);
+  auto it = cache_.find(key);
+  if (it != cache_.end()) {
+    return it->second;
+  }
+
+  if (!backend_.apply(profile)) {
+    throw std::runtime_error("Failed to apply a candidate profile.");
+  }
+  for (double t = 0; t < options_.settle_s; t += options_.sample_period_s) {
+    backend_.wait_and_sample(options_.sample_period_s);
+  }
+
+  Evaluation evaluation;
+  evaluation.measurement = measure();
+  evaluation.stable =
+      evaluation.measurement.util >= baseline_.util * STABLE_UTIL_RATIO;
+  evaluation.score = evaluation.stable ? score(evaluation.measurement) : 0;
+  evaluations_++;
+
+  const TuningMeasurement& m = evaluation.measurement;
+  std::clog << fmt::format(
+                   "  OC ({}W, {:+}MHz, <={}MHz): {:.0f}MHz at {:.0f}%, "
+                   "{:.0f}W, {:.3f} perf/W{}",
+                   profile.power_limit, profile.gpu_clock_offset,
+                   profile.max_gpu_clock, m.clock_mhz, m.util * 100, m.power_w,
+                   m.perf_per_watt(), evaluation.stable ? "" : " (unstable)")
+            << std::endl;
+
+  cache_[key] = evaluation;
+  if (evaluation.stable) {
+    last_good_ = profile;
+  } else {
+    backend_.apply(last_good_);
+    wait_for_workload();
+  }
+  return evaluation;
+}
+
+TuningMeasurement AutoTuner::measure() {
+  TuningMeasurement m;
+  int samples = std::max(
+      1, static_cast<int>(options_.measure_s / options_.sample_period_s));
+  for (int i = 0; i < samples; ++i) {
+    backend_.wait_and_sample(options_.sample_period_s);
+    const GpuState& gs = backend_.gpu();
+    m.clock_mhz += gs.gpu_clock_mhz;
+    m.util += gs.gpu_util_percent / 100.0;
+    m.power_w += gs.power_usage_w;
+    m.energy_j += gs.power_usage_w * options_.sample_period_s;
+  }
+  m.clock_mhz /= samples;
+  m.util /= samples;
+  m.power_w /= samples;
+  return m;
+}
+
+void AutoTuner::wait_for_workload() {
+  // An unstable candidate may have taken the workload down with it; wait
+  // for it to come back (or be restarted) before measuring again.
+  std::clog << "  Workload stopped. Waiting for it to come back..."
+            << std::endl;
+  for (double t = 0; t < MAX_WORKLOAD_WAIT_S; t += options_.sample_period_s) {
+    backend_.wait_and_sample(options_.sample_period_s);
+    if (backend_.gpu().gpu_util_percent / 100.0 >= baseline_.util * 0.95) {
+      return;
+    }
+  }
+  throw std::runtime_error("The workload did not come back.");
+}
+
+double AutoTuner::score(const TuningMeasurement& m) const {
+  double score = m.perf_per_watt();
+  double required = baseline_.perf() * options_.min_perf_ratio;
+  if (m.perf() < required) {
+    // Steep but continuous, so the golden-section search still converges.
+    score *= std::pow(m.perf() / required, 8);
+  }
+  return score;
+}
+
+int AutoTuner::search_offset(OcProfile profile) {
+  const GpuState& gs = backend_.gpu();
+  int fine = options_.clock_step_mhz;
+  int coarse = fine * 4;
+  int stable = profile.gpu_clock_offset;
+  std::optional<int> unstable;
+
+  for (int offset = stable + coarse; offset <= gs.clock_offset_max_mhz;
+       offset += coarse) {
+    profile.gpu_clock_offset = offset;
+    if (!evaluate(profile).stable) {
+      unstable = offset;
+      break;
+    }
+    stable = offset;
+  }
+  if (!unstable) {
+    return stable;
+  }
+  for (int offset = stable + fine; offset < *unstable; offset += fine) {
+    profile.gpu_clock_offset = offset;
+    if (!evaluate(profile).stable) {
+      break;
+    }
+    stable = offset;
+  }
+  // Right at the edge is not stable enough for every workload.
+  return std::max(stable - fine, gs.clock_offset_min_mhz);
+}
+
+int AutoTuner::search_max_clock(OcProfile profile) {
+  const GpuState& gs = backend_.gpu();
+  int step = options_.clock_step_mhz;
+  // Above the clock the GPU actually reaches, the cap changes nothing.
+  double hi = std::min<double>(
+      gs.gpu_max_clock_mhz,
+      baseline_.clock_mhz + profile.gpu_clock_offset + step);
+  double lo = std::max(210.0, baseline_.clock_mhz * options_.min_perf_ratio *
+                                  0.8);
+
+  const double INV_PHI = (std::sqrt(5.0) - 1) / 2;
+  auto score_at = [&](double clock) {
+    profile.max_gpu_clock = round_to_step(clock, step);
+    return evaluate(profile).score;
+  };
+
+  double c = hi - (hi - lo) * INV_PHI;
+  double d = lo + (hi - lo) * INV_PHI;
+  double score_c = score_at(c);
+  double score_d = score_at(d);
+  while (hi - lo > step) {
+    if (score_c > score_d) {
+      hi = d;
+      d = c;
+      score_d = score_c;
+      c = hi - (hi - lo) * INV_PHI;
+      score_c = score_at(c);
+    } else {
+      lo = c;
+      c = d;
+      score_c = score_d;
+      d = lo + (hi - lo) * INV_PHI;
+      score_d = score_at(d);
+    }
+  }
+
+  // Best candidate seen with this offset and power limit.
+  int best_clock = round_to_step((lo + hi) / 2, step);
+  double best_score = score_at(best_clock);
+  for (const auto& [key, evaluation] : cache_) {
+    const auto& [power_limit, offset, max_clock] = key;
+    if (power_limit == profile.power_limit &&
+        offset == profile.gpu_clock_offset && evaluation.score > best_score) {
+      best_score = evaluation.score;
+      best_clock = max_clock;
+    }
+  }
+  return std::min(best_clock, gs.gpu_max_clock_mhz);
+}
+
+int AutoTuner::search_power_limit(OcProfile profile, double best_score) {
+  const GpuState& gs = backend_.gpu();
+  if (gs.power_limit_min_w < 0 || gs.power_limit_w < 0) {
+    return profile.power_limit;  // unsupported
+  }
+  int fine = options_.power_step_w;
+  int coarse = fine * 5;
+  int good = profile.power_limit;
+  auto acceptable = [&](int power_limit) {
+    profile.power_limit = power_limit;
+    Evaluation e = evaluate(profile);
+    return e.stable && e.score >= best_score * (1 - SCORE_TOLERANCE);
+  };
+
+  int limit = good - coarse;
+  for (; limit >= gs.power_limit_min_w; limit -= coarse) {
+    if (!acceptable(limit)) {
+      break;
+    }
+    good = limit;
+  }
+  for (int pl = good - fine; pl > limit && pl >= gs.power_limit_min_w;
+       pl -= fine) {
+    if (!acceptable(pl)) {
+      break;
+    }
+    good = pl;
+  }
+  return good;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "gpu_simulator.h"
+#include "nvtuner.h"
+
+// Where the tuner applies settings and reads samples from: the real GPU, or
+// a simulated one that advances simulated time so a search takes
+// milliseconds.
+class TuningBackend {
+ public:
+  virtual ~TuningBackend() = default;
+
+  virtual const GpuState& gpu() const = 0;
+  /**
+   * @return true on success
+   */
+  virtual bool apply(const OcProfile& profile) = 0;
+  /**
+   * @brief Let `seconds` pass, then take a fresh sample into gpu().
+   */
+  virtual void wait_and_sample(double seconds) = 0;
+};
+
+class NvmlTuningBackend : public TuningBackend {
+ public:
+  NvmlTuningBackend(NvmlManager& nvml, size_t gpu_index);
+
+  const GpuState& gpu() const override;
+  bool apply(const OcProfile& profile) override;
+  void wait_and_sample(double seconds) override;
+
+ private:
+  NvmlManager& nvml_;
+  size_t gpu_index_;
+};
+
+class SimulatedTuningBackend : public TuningBackend {
+ public:
+  /**
+   * @param gpu_count GPUs of the simulated node; only `gpu_index` is tuned,
+   * under a steady full load.
+   */
+  SimulatedTuningBackend(unsigned int gpu_count, size_t gpu_index);
+
+  const GpuState& gpu() const override;
+  bool apply(const OcProfile& profile) override;
+  void wait_and_sample(double seconds) override;
+
+ private:
+  GpuSimulator simulator_;
+  std::vector<GpuState> gpus_;
+  size_t gpu_index_;
+};
+
+struct TuningOptions {
+  double warmup_s = 60;   // let temperatures settle before the baseline
+  double settle_s = 5;    // after applying, before measuring
+  double measure_s = 10;  // averaging window per candidate
+  double sample_period_s = 0.5;
+  // Candidates slower than this fraction of the starting profile are
+  // penalized, so the search does not trade away most of the performance.
+  double min_perf_ratio = 0.9;
+  int clock_step_mhz = 15;
+  int power_step_w = 5;
+};
+
+struct TuningMeasurement {
+  double clock_mhz = 0;  // average graphics clock
+  double util = 0;       // average utilization, 0..1
+  double power_w = 0;    // average board power
+  double energy_j = 0;   // over the measuring window
+
+  // Work done per second, in "MHz at 100% utilization".
+  double perf() const { return clock_mhz * util; }
+  double perf_per_watt() const { return power_w > 0 ? perf() / power_w : 0; }
+};
+
+struct TuningResult {
+  bool success = false;
+  OcProfile profile{};
+  TuningMeasurement baseline;
+  TuningMeasurement best;
+  int evaluations = 0;
+};
+
+// Searches clock offset, max clock and power limit for the best perf/W while
+// the user's workload runs:
+// 1. offset: coarse-to-fine search upwards for the highest offset that keeps
+//    the workload alive, minus one step of margin;
+// 2. max clock: golden-section search on the perf/W score;
+// 3. power limit: coarse-to-fine search downwards for the lowest cap that
+//    costs no score.
+class AutoTuner {
+ public:
+  AutoTuner(TuningBackend& backend, TuningOptions options = {});
+
+  /**
+   * @param start profile to start from and compare against, usually the
+   * saved one.
+   */
+  TuningResult run(const OcProfile& start);
+
+ private:
+  struct Evaluation {
+    TuningMeasurement measurement;
+    bool stable;
+    double score;
+  };
+
+  Evaluation evaluate(const OcProfile& profile);
+  TuningMeasurement measure();
+  void wait_for_workload();
+  double score(const TuningMeasurement& m) const;
+
+  int search_offset(OcProfile profile);
+  int search_max_clock(OcProfile profile);
+  int search_power_limit(OcProfile profile, double best_score);
+
+  TuningBackend& backend_;
+  TuningOptions options_;
+  TuningMeasurement baseline_;
+  OcProfile last_good_{};  // last stable candidate, to recover from crashes
+  std::map<std::tuple<int, int, int>, Evaluation> cache_;
+  int evaluations_ = 0;
+};
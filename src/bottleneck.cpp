@@ -0,0 +1,109 @@
+#include "bottleneck.h"
+
+#include <nvml.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+const int IDLE_UTIL_PERCENT = 5;
+// Below this the GPU waits for work a good part of the time.
+const int STARVED_UTIL_PERCENT = 60;
+// NVML memory util is the share of time the memory was read or written.
+const int MEMORY_BOUND_UTIL_PERCENT = 70;
+// Power at the limit only binds if it also keeps the clock down.
+const double POWER_AT_LIMIT_RATIO = 0.97;
+const double CLOCK_HELD_DOWN_RATIO = 0.9;
+
+// A sample stands for at most this long, so the first one and one after a
+// paused sampler do not fill the window alone.
+const double MAX_SAMPLE_S = 1.0;
+
+const unsigned long long THERMAL_REASONS =
+    nvmlClocksEventReasonSwThermalSlowdown |
+    nvmlClocksThrottleReasonHwThermalSlowdown;
+const unsigned long long POWER_REASONS =
+    nvmlClocksEventReasonSwPowerCap |
+    nvmlClocksThrottleReasonHwPowerBrakeSlowdown;
+}  // namespace
+
+const char* bottleneck_name(Bottleneck bottleneck) {
+  switch (bottleneck) {
+    case Bottleneck::Idle:
+      return "idle";
+    case Bottleneck::Starved:
+      return "starved";
+    case Bottleneck::Compute:
+      return "compute";
+    case Bottleneck::Memory:
+      return "memory";
+    case Bottleneck::Power:
+      return "power";
+    case Bottleneck::Thermal:
+      return "thermal";
+    case Bottleneck::Unknown:
+    default:
+      return "unknown";
+  }
+}
+
+Bottleneck BottleneckClassifier::classify(const Sample& sample) {
+  if (sample.gpu_util_percent < 0) {
+    return Bottleneck::Unknown;
+  }
+  if (sample.gpu_util_percent < IDLE_UTIL_PERCENT) {
+    return Bottleneck::Idle;
+  }
+  if (sample.clock_event_reasons & THERMAL_REASONS) {
+    return Bottleneck::Thermal;
+  }
+  bool clock_held_down =
+      sample.gpu_clock_mhz >= 0 && sample.gpu_max_clock_mhz > 0 &&
+      sample.gpu_clock_mhz < sample.gpu_max_clock_mhz * CLOCK_HELD_DOWN_RATIO;
+  bool power_at_limit =
+      sample.power_limit_w > 0 &&
+      sample.power_usage_w >= sample.power_limit_w * POWER_AT_LIMIT_RATIO;
+  if ((sample.clock_event_reasons & POWER_REASONS) ||
+      (power_at_limit && clock_held_down)) {
+    return Bottleneck::Power;
+  }
+  if (sample.gpu_util_percent < STARVED_UTIL_PERCENT) {
+    return Bottleneck::Starved;
+  }
+  if (sample.mem_util_percent >= MEMORY_BOUND_UTIL_PERCENT) {
+    return Bottleneck::Memory;
+  }
+  return Bottleneck::Compute;
+}
+
+void BottleneckClassifier::add_sample(double dt_s, const Sample& sample) {
+  double weight = std::clamp(dt_s, 0.0, MAX_SAMPLE_S);
+  window_.emplace_back(classify(sample), weight);
+  window_s_ += weight;
+  // Drop what fell out of the window, cutting the oldest sample short.
+  while (window_s_ > WINDOW_S) {
+    double excess = window_s_ - WINDOW_S;
+    if (window_.front().second > excess) {
+      window_.front().second -= excess;
+      window_s_ = WINDOW_S;
+    } else {
+      window_s_ -= window_.front().second;
+      window_.pop_front();
+    }
+  }
+
+  // Ties go to the later class in the enum, the more specific limit.
+  std::array<double, 7> seconds{};
+  for (const auto& [b, s] : window_) {
+    seconds[static_cast<size_t>(b)] += s;
+  }
+  size_t best = 0;
+  for (size_t i = 1; i < seconds.size(); ++i) {
+    if (seconds[i] >= seconds[best]) {
+      best = i;
+    }
+  }
+  bottleneck_ = static_cast<Bottleneck>(best);
+  confidence_ = static_cast<int>(std::lround(seconds[best] * 100 / WINDOW_S));
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+// What holds a GPU back, judged from its recent samples.
+enum class Bottleneck {
+  Unknown,  // no samples yet
+  Idle,     // no work
+  Starved,  // work comes in bursts; the host or input pipeline is too slow
+  Compute,  // busy at full clocks
+  Memory,   // busy, memory bandwidth saturated
+  Power,    // clocks held down by the power limit
+  Thermal,  // clocks held down by temperature
+};
+
+/**
+ * @return short lowercase name, e.g. "memory".
+ */
+const char* bottleneck_name(Bottleneck bottleneck);
+
+// Classifies each sample by the first rule that holds: idle, thermal or
+// power slowdown in the clock event reasons (or power at the limit with the
+// clock well below max), starved by low util, memory by high memory
+// controller util, compute otherwise. The result is the class that held for
+// most of the last WINDOW_S seconds; the confidence is for how much of them.
+// Samples are weighted by the time since the previous one, so the window
+// does not depend on the sampling rate. Fed by
+// NvmlManager::update_dynamic_state.
+class BottleneckClassifier {
+ public:
+  struct Sample {
+    int gpu_util_percent;
+    int mem_util_percent;
+    int gpu_clock_mhz;
+    int gpu_max_clock_mhz;
+    int power_usage_w;
+    int power_limit_w;  // enforced, -1 if unknown
+    unsigned long long clock_event_reasons;
+  };
+
+  /**
+   * @brief Add a sample taken `dt_s` after the previous one.
+   */
+  void add_sample(double dt_s, const Sample& sample);
+
+  Bottleneck bottleneck() const { return bottleneck_; }
+  /**
+   * @return percent of the last WINDOW_S seconds that agree; partial
+   * windows count the missing time as disagreeing.
+   */
+  int confidence() const { return confidence_; }
+
+  static Bottleneck classify(const Sample& sample);
+
+  static constexpr int WINDOW_S = 10;
+
+ private:
+  std::deque<std::pair<Bottleneck, double>> window_;  // class, seconds
+  double window_s_ = 0;
+  Bottleneck bottleneck_ = Bottleneck::Unknown;
+  int confidence_ = 0;
+};
@@ -0,0 +1,116 @@
+#include "cli_options.h"
+
+#include <fmt/core.h>
+
+#include <climits>
+#include <stdexcept>
+
+namespace {
+const char* next_value(int argc, char* argv[], int& i) {
+  if (i + 1 >= argc) {
+    throw std::invalid_argument(
+        fmt::format("Missing value for argument: {}", argv[i]));
+  }
+  return argv[++i];
+}
+
+unsigned int parse_uint(const std::string& arg, const std::string& value,
+                        unsigned long max = UINT_MAX) {
+  try {
+    size_t pos = 0;
+    unsigned long parsed = std::stoul(value, &pos);
+    // stoul takes "-1" too, wrapping it around.
+    if (pos == value.size() && parsed <= max &&
+        value.find('-') == std::string::npos) {
+      return static_cast<unsigned int>(parsed);
+    }
+  } catch (const std::exception&) {
+  }
+  throw std::invalid_argument(
+      fmt::format("Invalid value for {}: {}", arg, value));
+}
+}  // namespace
+
+CliOptions parse_cli_options(int argc, char* argv[]) {
+  CliOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--apply-profiles") {
+      options.apply_profiles = true;
+    } else if (arg == "--daemon") {
+      options.daemon = true;
+    } else if (arg == "--reset-fans") {
+      options.reset_fans = true;
+    } else if (arg == "--boot") {
+      options.boot = true;
+    } else if (arg == "--boot-ok") {
+      options.boot_ok = true;
+    } else if (arg == "--continuous-render") {
+      options.continuous_render = true;
+    } else if (arg == "--profile-frames") {
+      options.profile_frames = true;
+    } else if (arg == "--simulate-gpus") {
+      options.simulate_gpus = parse_uint(arg, next_value(argc, argv, i));
+    } else if (arg == "--auto-tune") {
+      options.auto_tune_gpu = static_cast<int>(
+          parse_uint(arg, next_value(argc, argv, i), INT_MAX));
+    } else if (arg == "--classify") {
+      options.classify = true;
+    } else if (arg == "--agent") {
+      options.agent_endpoint = next_value(argc, argv, i);
+    } else if (arg == "--connect") {
+      // Comma-separated, and may be repeated.
+      std::string value = next_value(argc, argv, i);
+      size_t start = 0;
+      while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        if (end > start) {
+          options.connect_endpoints.push_back(value.substr(start, end - start));
+        }
+        start = end + 1;
+      }
+    } else {
+      throw std::invalid_argument(fmt::format("Unknown argument: {}", arg));
+    }
+  }
+  if (!options.agent_endpoint.empty() && !options.connect_endpoints.empty()) {
+    throw std::invalid_argument("--agent and --connect cannot be combined.");
+  }
+  return options;
+}
+
+std::string cli_usage() {
+  return "Usage: nvtuner [options]\n"
+         "  --apply-profiles     Apply saved profiles and exit.\n"
+         "  --daemon             Apply saved profiles, then stay resident and "
+         "apply\n"
+         "                       them again when the TUI asks (root, Linux).\n"
+         "  --reset-fans         Put all fans back on the stock curve and "
+         "exit.\n"
+         "  --boot               With --apply-profiles or --daemon: roll the "
+         "profiles\n"
+         "                       back if the previous boot crashed with "
+         "them.\n"
+         "  --boot-ok            Mark this boot as shut down cleanly and "
+         "exit.\n"
+         "  --continuous-render  Redraw at a fixed 60 fps instead of on "
+         "demand.\n"
+         "  --profile-frames     Show the frame profiler (F12) from start and "
+         "export\n"
+         "                       its stats on exit.\n"
+         "  --simulate-gpus <n>  Use n simulated GPUs instead of NVML.\n"
+         "  --auto-tune <gpu>    Search offset, max clock and power limit for "
+         "the best\n"
+         "                       perf/W under the running workload, then save "
+         "them.\n"
+         "  --classify           Sample for 10s, then print whether each GPU is "
+         "idle,\n"
+         "                       starved, compute, memory, power or thermal "
+         "bound.\n"
+         "  --agent <endpoint>   Serve GPU stats to cluster dashboards, headless.\n"
+         "  --connect <endpoint>[,<endpoint>...]\n"
+         "                       Show the GPUs of remote agents. May be "
+         "repeated.\n"
+         "Endpoints are host:port, [ipv6]:port or unix:/path/to/socket.\n";
+}
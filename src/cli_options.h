@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+
+struct CliOptions {
+  bool apply_profiles = false;
+  // Stay resident as root and apply profiles on request (Linux only).
+  bool daemon = false;
+  // Hand all fans back to the driver and exit (run when the helper stops).
+  bool reset_fans = false;
+  // Started by the startup unit: roll back the profiles if the previous boot
+  // crashed with them applied (with --apply-profiles or --daemon, Linux).
+  bool boot = false;
+  // Mark the boot as clean and exit (run when the startup unit stops).
+  bool boot_ok = false;
+  // Redraw at a fixed 60 fps like older releases. Kept for CPU comparisons.
+  bool continuous_render = false;
+  // Start with the frame profiler overlay shown; export its stats on exit.
+  bool profile_frames = false;
+  // Use this many simulated GPUs instead of NVML (0: disabled).
+  unsigned int simulate_gpus = 0;
+  // Auto-tune this GPU headless and save the result (-1: disabled).
+  int auto_tune_gpu = -1;
+  // Sample for a few seconds, print what limits each GPU and exit.
+  bool classify = false;
+  // Serve local GPU stats to cluster dashboards on this endpoint.
+  std::string agent_endpoint;
+  // Show the GPUs of these agents instead of the local ones.
+  std::vector<std::string> connect_endpoints;
+};
+
+/**
+ * @brief Parse command line arguments.
+ * @throw std::invalid_argument on unknown or malformed arguments.
+ */
+CliOptions parse_cli_options(int argc, char* argv[]);
+
+std::string cli_usage();
@@ -0,0 +1,129 @@
+#include "clock_power_curve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+// A few well-populated bins must not drown the rest of the curve.
+const double MAX_BIN_WEIGHT = 30.0;
+
+/**
+ * @return false if the system is singular.
+ */
+bool solve(std::array<std::array<double, 5>, 4>& m,
+           std::array<double, 4>& x) {
+  const int n = 4;
+  for (int col = 0; col < n; ++col) {
+    int pivot = col;
+    for (int row = col + 1; row < n; ++row) {
+      if (std::abs(m[row][col]) > std::abs(m[pivot][col])) {
+        pivot = row;
+      }
+    }
+    if (std::abs(m[pivot][col]) < 1e-12) {
+      return false;
+    }
+    std::swap(m[col], m[pivot]);
+    for (int row = col + 1; row < n; ++row) {
+      double factor = m[row][col] / m[col][col];
+      for (int k = col; k <= n; ++k) {
+        m[row][k] -= factor * m[col][k];
+      }
+    }
+  }
+  for (int row = n - 1; row >= 0; --row) {
+    double sum = m[row][n];
+    for (int k = row + 1; k < n; ++k) {
+      sum -= m[row][k] * x[k];
+    }
+    x[row] = sum / m[row][row];
+  }
+  return true;
+}
+}  // namespace
+
+ClockPowerCurve::ClockPowerCurve(int max_clock_mhz, int max_power_w)
+    : clock_bins_(std::max(max_clock_mhz, 1) / CLOCK_BIN_MHZ + 1),
+      power_bins_(std::max(max_power_w, 1) / POWER_BIN_W + 1),
+      counts_(static_cast<size_t>(clock_bins_) * power_bins_, 0) {}
+
+void ClockPowerCurve::add_sample(const GpuState& gs) {
+  if (gs.gpu_util_percent < MIN_UTIL_PERCENT || gs.gpu_clock_mhz <= 0 ||
+      gs.power_usage_w <= 0) {
+    return;
+  }
+  int clock_bin = std::min(gs.gpu_clock_mhz / CLOCK_BIN_MHZ, clock_bins_ - 1);
+  int power_bin = std::min(gs.power_usage_w / POWER_BIN_W, power_bins_ - 1);
+  counts_[clock_bin * power_bins_ + power_bin]++;
+  sample_count_++;
+  fit_stale_ = true;
+}
+
+const ClockPowerCurve::Fit& ClockPowerCurve::fit() {
+  if (!fit_stale_) {
+    return fit_;
+  }
+  fit_stale_ = false;
+  fit_ = Fit{};
+
+  // Normal equations of the weighted cubic, one point per clock bin.
+  std::array<std::array<double, 5>, 4> m{};
+  int bins = 0;
+  for (int c = 0; c < clock_bins_; ++c) {
+    double samples = 0;
+    double power_sum = 0;
+    for (int p = 0; p < power_bins_; ++p) {
+      unsigned int n = count(c, p);
+      samples += n;
+      power_sum += n * (p + 0.5) * POWER_BIN_W;
+    }
+    if (samples == 0) {
+      continue;
+    }
+    int clock_mhz = c * CLOCK_BIN_MHZ + CLOCK_BIN_MHZ / 2;
+    if (bins == 0) {
+      fit_.min_clock_mhz = clock_mhz;
+    }
+    fit_.max_clock_mhz = clock_mhz;
+    bins++;
+
+    double x = clock_mhz / 1000.0;
+    double powers[4] = {1, x, x * x, x * x * x};
+    double weight = std::min(samples, MAX_BIN_WEIGHT);
+    double power = power_sum / samples;
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        m[i][j] += weight * powers[i] * powers[j];
+      }
+      m[i][4] += weight * powers[i] * power;
+    }
+  }
+  if (bins < MIN_FIT_BINS || !solve(m, fit_.coefficients)) {
+    return fit_;
+  }
+  fit_.valid = true;
+
+  double best = 0;
+  for (int clock = fit_.min_clock_mhz; clock <= fit_.max_clock_mhz;
+       clock += CLOCK_BIN_MHZ) {
+    double power = fit_.power_at(clock);
+    if (power > 0 && clock / power > best) {
+      best = clock / power;
+      fit_.best_perf_per_watt_clock_mhz = clock;
+    }
+  }
+  return fit_;
+}
+
+double ClockPowerCurve::Fit::power_at(double clock_mhz) const {
+  double x = clock_mhz / 1000.0;
+  const auto& a = coefficients;
+  return a[0] + x * (a[1] + x * (a[2] + x * a[3]));
+}
+
+double ClockPowerCurve::Fit::slope_at(double clock_mhz) const {
+  double x = clock_mhz / 1000.0;
+  const auto& a = coefficients;
+  return (a[1] + x * (2 * a[2] + x * 3 * a[3])) / 1000.0;
+}
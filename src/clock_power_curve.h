@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Empirical graphics clock -> board power curve of one GPU, built from its
+// own samples. Samples under load are binned by clock and power into a 2-D
+// histogram; fit() puts a least-squares cubic through the mean power of each
+// clock bin, weighted by its samples. Power ~ f * V^2 with V rising with f
+// above the knee of the V/F curve, so a cubic follows it well.
+class ClockPowerCurve {
+ public:
+  ClockPowerCurve(int max_clock_mhz, int max_power_w);
+
+  /**
+   * @brief Add a sample; ignored below MIN_UTIL_PERCENT, where power says
+   * more about the load than about the clock.
+   */
+  void add_sample(const GpuState& gs);
+
+  int clock_bins() const { return clock_bins_; }
+  int power_bins() const { return power_bins_; }
+  /**
+   * @return samples in bin [clock_bin * CLOCK_BIN_MHZ, +CLOCK_BIN_MHZ) x
+   * [power_bin * POWER_BIN_W, +POWER_BIN_W).
+   */
+  unsigned int count(int clock_bin, int power_bin) const {
+    return counts_[clock_bin * power_bins_ + power_bin];
+  }
+  unsigned int sample_count() const { return sample_count_; }
+
+  struct Fit {
+    bool valid = false;
+    std::array<double, 4> coefficients{};  // in clock / 1000
+    int min_clock_mhz = 0;  // range of the binned clocks
+    int max_clock_mhz = 0;
+    int best_perf_per_watt_clock_mhz = 0;  // perf taken as ~ clock
+
+    double power_at(double clock_mhz) const;
+    /**
+     * @return extra watts per MHz at `clock_mhz`.
+     */
+    double slope_at(double clock_mhz) const;
+  };
+  /**
+   * @return fit over the samples so far; invalid with fewer than
+   * MIN_FIT_BINS clock bins.
+   */
+  const Fit& fit();
+
+  static constexpr int CLOCK_BIN_MHZ = 15;
+  static constexpr int POWER_BIN_W = 5;
+  static constexpr int MIN_UTIL_PERCENT = 80;
+  static constexpr int MIN_FIT_BINS = 4;
+
+ private:
+  int clock_bins_;
+  int power_bins_;
+  std::vector<unsigned int> counts_;  // clock-major
+  unsigned int sample_count_ = 0;
+  Fit fit_;
+  bool fit_stale_ = false;
+};
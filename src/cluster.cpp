@@ -0,0 +1,709 @@
+#include "cluster.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+using TimePoint = std::chrono::system_clock::time_point;
+
+const auto SAMPLE_PERIOD = std::chrono::seconds(1);
+const size_t MAX_PENDING_OUTPUT = 1 << 20;  // drop clients that fall behind
+const size_t MAX_LINE_LENGTH = 16 << 20;
+
+// Unique across hosts and reconnects, so the Dashboard never mistakes a
+// re-sent GPU for the one it cached at the same position.
+std::atomic<unsigned long long> next_generation{1};
+
+struct IntField {
+  const char* key;
+  int GpuState::*member;
+};
+
+// Short keys keep the deltas small on the wire.
+const IntField DYNAMIC_FIELDS[] = {
+    {"f", &GpuState::fan_speed_percent},
+    {"fr", &GpuState::fan_speed_rpm},
+    {"t", &GpuState::temperature_c},
+    {"p", &GpuState::power_usage_w},
+    {"pl", &GpuState::power_limit_w},
+    {"epl", &GpuState::enforced_power_limit_w},
+    {"mu", &GpuState::mem_used_mib},
+    {"mt", &GpuState::mem_total_mib},
+    {"u", &GpuState::gpu_util_percent},
+    {"mem", &GpuState::mem_util_percent},
+    {"c", &GpuState::gpu_clock_mhz},
+    {"ps", &GpuState::pstate},
+    {"pm", &GpuState::persistence_mode},
+    {"tts", &GpuState::seconds_to_slowdown},
+    {"bnc", &GpuState::bottleneck_confidence},
+};
+
+const IntField STATIC_FIELDS[] = {
+    {"pl_min", &GpuState::power_limit_min_w},
+    {"pl_max", &GpuState::power_limit_max_w},
+    {"pl_def", &GpuState::power_limit_default_w},
+    {"co_min", &GpuState::clock_offset_min_mhz},
+    {"co_max", &GpuState::clock_offset_max_mhz},
+    {"c_max", &GpuState::gpu_max_clock_mhz},
+    {"t_sd", &GpuState::slowdown_temp_c},
+};
+
+struct EventField {
+  const char* key;
+  std::optional<TimePoint> GpuState::*member;
+};
+
+const EventField EVENT_FIELDS[] = {
+    {"pc", &GpuState::last_event_power_cap_time},
+    {"st", &GpuState::last_event_swt_slowdown_time},
+    {"ht", &GpuState::last_event_hwt_slowdown_time},
+};
+
+long long to_ms(const std::optional<TimePoint>& t) {
+  if (!t) return 0;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             t->time_since_epoch())
+      .count();
+}
+
+std::optional<TimePoint> from_ms(long long ms) {
+  if (ms == 0) return std::nullopt;
+  return TimePoint(std::chrono::duration_cast<TimePoint::duration>(
+      std::chrono::milliseconds(ms)));
+}
+
+void encode_dynamic(const GpuState* prev, const GpuState& cur, json& out) {
+  for (const auto& field : DYNAMIC_FIELDS) {
+    if (!prev || prev->*field.member != cur.*field.member) {
+      out[field.key] = cur.*field.member;
+    }
+  }
+  for (const auto& field : EVENT_FIELDS) {
+    if (!prev || prev->*field.member != cur.*field.member) {
+      out[field.key] = to_ms(cur.*field.member);
+    }
+  }
+  if (!prev || prev->bottleneck != cur.bottleneck) {
+    out["bn"] = static_cast<int>(cur.bottleneck);
+  }
+}
+
+void decode_dynamic(const json& in, GpuState& gpu) {
+  for (const auto& field : DYNAMIC_FIELDS) {
+    auto it = in.find(field.key);
+    if (it != in.end()) {
+      gpu.*field.member = it->get<int>();
+    }
+  }
+  for (const auto& field : EVENT_FIELDS) {
+    auto it = in.find(field.key);
+    if (it != in.end()) {
+      gpu.*field.member = from_ms(it->get<long long>());
+    }
+  }
+  auto bottleneck = in.find("bn");
+  if (bottleneck != in.end()) {
+    int value = bottleneck->get<int>();
+    gpu.bottleneck = value >= 0 && value <= static_cast<int>(Bottleneck::Thermal)
+                         ? static_cast<Bottleneck>(value)
+                         : Bottleneck::Unknown;
+  }
+  gpu.sample_generation = next_generation++;
+}
+
+}  // namespace
+
+ClusterEndpoint parse_cluster_endpoint(const std::string& text) {
+  ClusterEndpoint endpoint;
+  endpoint.text = text;
+
+  const std::string UNIX_PREFIX = "unix:";
+  if (text.rfind(UNIX_PREFIX, 0) == 0) {
+    endpoint.unix_path = text.substr(UNIX_PREFIX.size());
+    if (endpoint.unix_path.empty()) {
+      throw std::invalid_argument(
+          fmt::format("Missing socket path in endpoint: {}", text));
+    }
+    return endpoint;
+  }
+
+  size_t colon = text.rfind(':');
+  if (colon == std::string::npos || colon + 1 == text.size()) {
+    throw std::invalid_argument(
+        fmt::format("Expected host:port or unix:/path, got: {}", text));
+  }
+  endpoint.host = text.substr(0, colon);
+  endpoint.port = text.substr(colon + 1);
+  if (endpoint.host.size() >= 2 && endpoint.host.front() == '[' &&
+      endpoint.host.back() == ']') {
+    endpoint.host = endpoint.host.substr(1, endpoint.host.size() - 2);
+  }
+  return endpoint;
+}
+
+// --- ClusterProtocol ---
+
+json ClusterProtocol::encode_full(const std::string& host,
+                                  const std::vector<GpuState>& gpus) {
+  json gpus_json = json::array();
+  for (const auto& gs : gpus) {
+    json gpu_json;
+    gpu_json["i"] = gs.index;
+    gpu_json["uuid"] = gs.uuid;
+    gpu_json["name"] = gs.name;
+    gpu_json["name_short"] = gs.name_short;
+    for (const auto& field : STATIC_FIELDS) {
+      gpu_json[field.key] = gs.*field.member;
+    }
+    encode_dynamic(nullptr, gs, gpu_json);
+    gpus_json.push_back(std::move(gpu_json));
+  }
+  return json{{"host", host}, {"gpus", std::move(gpus_json)}};
+}
+
+json ClusterProtocol::encode_delta(const std::vector<GpuState>& prev,
+                                   const std::vector<GpuState>& cur) {
+  json delta = json::array();
+  for (size_t i = 0; i < cur.size(); ++i) {
+    json changed = json::object();
+    encode_dynamic(i < prev.size() ? &prev[i] : nullptr, cur[i], changed);
+    if (!changed.empty()) {
+      delta.push_back(json::array({i, std::move(changed)}));
+    }
+  }
+  return delta;
+}
+
+bool ClusterProtocol::apply_message(const json& message, std::string& host,
+                                    std::vector<GpuState>& gpus) {
+  try {
+    if (message.contains("gpus")) {
+      host = message.at("host").get<std::string>();
+      gpus.clear();
+      for (const auto& gpu_json : message.at("gpus")) {
+        GpuState gpu{};
+        gpu.host = host;
+        gpu.handle = nullptr;
+        gpu.index = gpu_json.at("i").get<unsigned int>();
+        gpu.uuid = gpu_json.at("uuid").get<std::string>();
+        gpu.name = gpu_json.at("name").get<std::string>();
+        gpu.name_short = gpu_json.at("name_short").get<std::string>();
+        for (const auto& field : STATIC_FIELDS) {
+          gpu.*field.member = gpu_json.value(field.key, -1);
+        }
+        decode_dynamic(gpu_json, gpu);
+        gpus.push_back(std::move(gpu));
+      }
+      return true;
+    }
+    for (const auto& entry : message.at("d")) {
+      size_t i = entry.at(0).get<size_t>();
+      if (i >= gpus.size()) {
+        return false;
+      }
+      decode_dynamic(entry.at(1), gpus[i]);
+    }
+    return true;
+  } catch (const json::exception&) {
+    return false;
+  }
+}
+
+#ifdef _WIN32
+
+ClusterAgent::ClusterAgent(NvmlManager& nvml, const std::string& endpoint)
+    : nvml_(nvml) {
+  throw std::runtime_error("Cluster mode is not supported on Windows yet.");
+}
+ClusterAgent::~ClusterAgent() {}
+void ClusterAgent::run(const std::atomic<bool>&) {}
+
+ClusterClient::ClusterClient(const std::vector<std::string>&) {
+  throw std::runtime_error("Cluster mode is not supported on Windows yet.");
+}
+ClusterClient::~ClusterClient() {}
+bool ClusterClient::sync(std::vector<GpuState>&) { return false; }
+
+#else
+
+namespace {
+
+bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool make_unix_address(const std::string& path, sockaddr_un& addr) {
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+}  // namespace
+
+// --- ClusterAgent ---
+
+ClusterAgent::ClusterAgent(NvmlManager& nvml, const std::string& endpoint)
+    : nvml_(nvml), endpoint_(parse_cluster_endpoint(endpoint)) {
+  char host_buf[256] = {0};
+  gethostname(host_buf, sizeof(host_buf) - 1);
+  host_name_ = host_buf;
+
+  if (!endpoint_.unix_path.empty()) {
+    sockaddr_un addr;
+    if (!make_unix_address(endpoint_.unix_path, addr)) {
+      throw std::runtime_error("Socket path too long: " + endpoint_.unix_path);
+    }
+    unlink(endpoint_.unix_path.c_str());
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+            0) {
+      throw std::runtime_error(fmt::format("Cannot listen on {}: {}",
+                                           endpoint, std::strerror(errno)));
+    }
+  } else {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    int ret = getaddrinfo(endpoint_.host.empty() ? nullptr
+                                                 : endpoint_.host.c_str(),
+                          endpoint_.port.c_str(), &hints, &result);
+    if (ret != 0) {
+      throw std::runtime_error(fmt::format("Cannot resolve {}: {}", endpoint,
+                                           gai_strerror(ret)));
+    }
+    // "Any" resolves to 0.0.0.0 before ::, but a dual-stack :: takes IPv4
+    // clients too, so it goes first.
+    std::vector<addrinfo*> candidates;
+    for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+      candidates.push_back(ai);
+    }
+    if (endpoint_.host.empty()) {
+      std::stable_partition(
+          candidates.begin(), candidates.end(),
+          [](const addrinfo* ai) { return ai->ai_family == AF_INET6; });
+    }
+    for (addrinfo* ai : candidates) {
+      int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      int one = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (ai->ai_family == AF_INET6) {
+        int zero = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+      }
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        listen_fd_ = fd;
+        break;
+      }
+      close(fd);
+    }
+    freeaddrinfo(result);
+    if (listen_fd_ < 0) {
+      throw std::runtime_error(fmt::format("Cannot listen on {}: {}",
+                                           endpoint, std::strerror(errno)));
+    }
+  }
+
+  if (listen(listen_fd_, 16) != 0 || !set_nonblocking(listen_fd_)) {
+    throw std::runtime_error(fmt::format("Cannot listen on {}: {}", endpoint,
+                                         std::strerror(errno)));
+  }
+  std::clog << fmt::format("Agent for {} listening on {}.", host_name_,
+                           endpoint)
+            << std::endl;
+}
+
+ClusterAgent::~ClusterAgent() {
+  for (const auto& client : clients_) {
+    close(client.fd);
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+  if (!endpoint_.unix_path.empty()) {
+    unlink(endpoint_.unix_path.c_str());
+  }
+}
+
+void ClusterAgent::run(const std::atomic<bool>& stop) {
+  last_sent_ = nvml_.get_gpus();
+  auto next_sample = std::chrono::steady_clock::now() + SAMPLE_PERIOD;
+  std::vector<pollfd> fds;
+
+  while (!stop) {
+    fds.clear();
+    fds.push_back({listen_fd_, POLLIN, 0});
+    for (const auto& client : clients_) {
+      short events = POLLIN | (client.out.empty() ? 0 : POLLOUT);
+      fds.push_back({client.fd, events, 0});
+    }
+
+    // Wake up at least every 250 ms to notice `stop`.
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       next_sample - std::chrono::steady_clock::now())
+                       .count();
+    timeout = std::clamp<long long>(timeout, 0, 250);
+    if (poll(fds.data(), fds.size(), static_cast<int>(timeout)) < 0 &&
+        errno != EINTR) {
+      std::cerr << fmt::format("Agent poll failed: {}", std::strerror(errno))
+                << std::endl;
+      return;
+    }
+
+    // Clients never send anything; readable means closed (or garbage).
+    for (size_t i = fds.size() - 1; i >= 1; --i) {
+      Client& client = clients_[i - 1];
+      if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        close_client(i - 1);
+        continue;
+      }
+      if (fds[i].revents & POLLIN) {
+        char buf[256];
+        ssize_t n = recv(client.fd, buf, sizeof(buf), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+          close_client(i - 1);
+          continue;
+        }
+      }
+      if (fds[i].revents & POLLOUT) {
+        flush(client);
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      accept_clients();
+    }
+
+    if (std::chrono::steady_clock::now() < next_sample) {
+      continue;
+    }
+    next_sample += SAMPLE_PERIOD;
+
+    nvml_.update_dynamic_state();
+    const auto& gpus = nvml_.get_gpus();
+    json delta = ClusterProtocol::encode_delta(last_sent_, gpus);
+    last_sent_ = gpus;
+    if (delta.empty()) {
+      continue;
+    }
+    std::string line = json{{"d", std::move(delta)}}.dump() + "\n";
+    for (size_t i = clients_.size(); i-- > 0;) {
+      if (clients_[i].out.size() + line.size() > MAX_PENDING_OUTPUT) {
+        std::cerr << "Dropping a cluster client that stopped reading."
+                  << std::endl;
+        close_client(i);
+        continue;
+      }
+      clients_[i].out += line;
+      flush(clients_[i]);
+    }
+  }
+}
+
+void ClusterAgent::accept_clients() {
+  while (true) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      return;  // EAGAIN: no more pending connections
+    }
+    if (!set_nonblocking(fd)) {
+      close(fd);
+      continue;
+    }
+    Client client{fd, ClusterProtocol::encode_full(host_name_, last_sent_)
+                              .dump() +
+                          "\n"};
+    clients_.push_back(std::move(client));
+    flush(clients_.back());
+    std::clog << fmt::format("Cluster client connected ({} total).",
+                             clients_.size())
+              << std::endl;
+  }
+}
+
+void ClusterAgent::flush(Client& client) {
+  while (!client.out.empty()) {
+    ssize_t n = send(client.fd, client.out.data(), client.out.size(),
+                     MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;  // EAGAIN, or an error that poll() will report
+    }
+    client.out.erase(0, n);
+  }
+}
+
+void ClusterAgent::close_client(size_t i) {
+  close(clients_[i].fd);
+  clients_.erase(clients_.begin() + i);
+  std::clog << fmt::format("Cluster client disconnected ({} left).",
+                           clients_.size())
+            << std::endl;
+}
+
+// --- ClusterClient ---
+
+ClusterClient::ClusterClient(const std::vector<std::string>& endpoints) {
+  for (const auto& text : endpoints) {
+    Connection conn;
+    conn.endpoint = parse_cluster_endpoint(text);
+    conn.host = text;
+    connections_.push_back(std::move(conn));
+  }
+  thread_ = std::thread(&ClusterClient::run, this);
+}
+
+ClusterClient::~ClusterClient() {
+  stop_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (auto& conn : connections_) {
+    if (conn.fd >= 0) {
+      close(conn.fd);
+    }
+  }
+}
+
+bool ClusterClient::sync(std::vector<GpuState>& gpus) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!changed_) {
+    return false;
+  }
+  changed_ = false;
+
+  size_t total = 0;
+  for (const auto& conn : connections_) {
+    total += conn.gpus.size();
+  }
+  gpus.resize(total);
+  size_t pos = 0;
+  for (const auto& conn : connections_) {
+    for (const auto& gpu : conn.gpus) {
+      gpus[pos++] = gpu;
+    }
+  }
+  return true;
+}
+
+void ClusterClient::run() {
+  std::vector<pollfd> fds;
+  std::vector<Connection*> polled;
+
+  while (!stop_) {
+    auto now = std::chrono::steady_clock::now();
+    fds.clear();
+    polled.clear();
+    for (auto& conn : connections_) {
+      if (conn.fd < 0 && now >= conn.retry_at) {
+        start_connect(conn);
+      }
+      if (conn.fd >= 0) {
+        fds.push_back(
+            {conn.fd, static_cast<short>(conn.connecting ? POLLOUT : POLLIN),
+             0});
+        polled.push_back(&conn);
+      }
+    }
+
+    // The timeout bounds how long stopping and reconnecting can take.
+    if (poll(fds.data(), fds.size(), 250) < 0 && errno != EINTR) {
+      std::cerr << fmt::format("Cluster poll failed: {}",
+                               std::strerror(errno))
+                << std::endl;
+      return;
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+      Connection& conn = *polled[i];
+      if (conn.connecting) {
+        if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+          finish_connect(conn);
+        }
+      } else if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+        read_from(conn);
+      }
+    }
+  }
+}
+
+void ClusterClient::start_connect(Connection& conn) {
+  int fd = -1;
+  int ret = -1;
+  if (!conn.endpoint.unix_path.empty()) {
+    sockaddr_un addr;
+    if (!make_unix_address(conn.endpoint.unix_path, addr)) {
+      disconnect(conn, "socket path too long");
+      return;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && set_nonblocking(fd)) {
+      ret = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+  } else {
+    if (!conn.addresses) {
+      // Blocks this thread, and so all connections, while DNS answers.
+      addrinfo hints{};
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      addrinfo* result = nullptr;
+      int gai = getaddrinfo(conn.endpoint.host.c_str(),
+                            conn.endpoint.port.c_str(), &hints, &result);
+      if (gai != 0) {
+        disconnect(conn, gai_strerror(gai));
+        return;
+      }
+      conn.addresses.reset(result, freeaddrinfo);
+      conn.next_address = result;
+    }
+    // Try the addresses in turn until one connects or is in progress;
+    // finish_connect comes back here for the rest if it fails.
+    while (conn.next_address != nullptr) {
+      addrinfo* ai = conn.next_address;
+      conn.next_address = ai->ai_next;
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd >= 0 && set_nonblocking(fd)) {
+        ret = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (ret == 0 || errno == EINPROGRESS || errno == EAGAIN) {
+          break;
+        }
+      }
+      int error = errno;
+      if (fd >= 0) {
+        close(fd);
+        fd = -1;
+      }
+      errno = error;
+    }
+  }
+
+  conn.fd = fd;
+  if (fd < 0 || (ret != 0 && errno != EINPROGRESS && errno != EAGAIN)) {
+    disconnect(conn, std::strerror(errno));
+    return;
+  }
+  conn.connecting = true;
+  if (ret == 0) {
+    finish_connect(conn);
+  }
+}
+
+void ClusterClient::finish_connect(Connection& conn) {
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 ||
+      error != 0) {
+    if (conn.next_address != nullptr) {
+      close(conn.fd);
+      conn.fd = -1;
+      start_connect(conn);
+      return;
+    }
+    disconnect(conn, std::strerror(error ? error : errno));
+    return;
+  }
+  conn.addresses.reset();
+  conn.next_address = nullptr;
+  conn.connecting = false;
+  conn.connected = true;
+  conn.backoff = std::chrono::seconds(1);
+  connected_count_++;
+  std::clog << fmt::format("Connected to {}.", conn.endpoint.text)
+            << std::endl;
+}
+
+void ClusterClient::read_from(Connection& conn) {
+  char buf[65536];
+  while (true) {
+    ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      conn.in.append(buf, n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    disconnect(conn, n == 0 ? "closed by agent" : std::strerror(errno));
+    return;
+  }
+
+  size_t start = 0;
+  size_t end;
+  while ((end = conn.in.find('\n', start)) != std::string::npos) {
+    json message = json::parse(conn.in.begin() + start, conn.in.begin() + end,
+                               nullptr, false);
+    start = end + 1;
+
+    bool valid = false;
+    if (!message.is_discarded()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      valid = ClusterProtocol::apply_message(message, conn.host, conn.gpus);
+      changed_ = changed_ || valid;
+    }
+    if (!valid) {
+      std::cerr << fmt::format("Malformed update from {}.",
+                               conn.endpoint.text)
+                << std::endl;
+    }
+  }
+  conn.in.erase(0, start);
+  if (conn.in.size() > MAX_LINE_LENGTH) {
+    disconnect(conn, "message too long");
+  }
+}
+
+void ClusterClient::disconnect(Connection& conn, const std::string& reason) {
+  if (conn.fd >= 0) {
+    close(conn.fd);
+  }
+  if (conn.connected) {
+    connected_count_--;
+    {
+      // Stale numbers are worse than none.
+      std::lock_guard<std::mutex> lock(mutex_);
+      conn.gpus.clear();
+      changed_ = true;
+    }
+    std::cerr << fmt::format("Lost connection to {}: {}.", conn.endpoint.text,
+                             reason)
+              << std::endl;
+  } else if (conn.backoff == std::chrono::seconds(1)) {
+    std::cerr << fmt::format("Cannot connect to {}: {}. Retrying.",
+                             conn.endpoint.text, reason)
+              << std::endl;
+  }
+  conn.fd = -1;
+  conn.connecting = false;
+  conn.connected = false;
+  conn.addresses.reset();  // resolve again on the next attempt
+  conn.next_address = nullptr;
+  conn.in.clear();
+  conn.retry_at = std::chrono::steady_clock::now() + conn.backoff;
+  conn.backoff = std::min(conn.backoff * 2, std::chrono::seconds(30));
+}
+
+#endif
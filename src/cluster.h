@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "nvtuner.h"
+
+// Cluster mode: `nvtuner --agent <endpoint>` serves the local GpuState stream,
+// `nvtuner --connect <endpoint>...` merges the streams of many agents into one
+// Dashboard. Endpoints are "host:port" or "unix:/path/to/socket".
+//
+// Wire format: one JSON object per line. The first message is a full
+// snapshot {"host": ..., "gpus": [...]}, then once per second a delta
+// {"d": [[gpu, {changed fields}], ...]} holding only what changed.
+
+struct addrinfo;
+
+struct ClusterEndpoint {
+  std::string text;       // as given on the command line
+  std::string host;       // empty for unix sockets / "any" when listening
+  std::string port;
+  std::string unix_path;  // non-empty for unix sockets
+};
+
+/**
+ * @throw std::invalid_argument on malformed endpoints.
+ */
+ClusterEndpoint parse_cluster_endpoint(const std::string& text);
+
+namespace ClusterProtocol {
+nlohmann::json encode_full(const std::string& host,
+                           const std::vector<GpuState>& gpus);
+/**
+ * @return delta from `prev` to `cur`; an empty array if nothing changed.
+ */
+nlohmann::json encode_delta(const std::vector<GpuState>& prev,
+                            const std::vector<GpuState>& cur);
+/**
+ * @return false if the message is malformed.
+ */
+bool apply_message(const nlohmann::json& message, std::string& host,
+                   std::vector<GpuState>& gpus);
+}  // namespace ClusterProtocol
+
+class ClusterAgent {
+ public:
+  /**
+   * @throw std::runtime_error if the endpoint cannot be listened on.
+   */
+  ClusterAgent(NvmlManager& nvml, const std::string& endpoint);
+  ~ClusterAgent();
+
+  ClusterAgent(const ClusterAgent&) = delete;
+  ClusterAgent& operator=(const ClusterAgent&) = delete;
+
+  /**
+   * @brief Sample and serve until `stop` becomes true.
+   */
+  void run(const std::atomic<bool>& stop);
+
+ private:
+  struct Client {
+    int fd;
+    std::string out;
+  };
+
+  void accept_clients();
+  void flush(Client& client);
+  void close_client(size_t i);
+
+  NvmlManager& nvml_;
+  ClusterEndpoint endpoint_;
+  std::string host_name_;
+  int listen_fd_ = -1;
+  std::vector<Client> clients_;
+  std::vector<GpuState> last_sent_;
+};
+
+class ClusterClient {
+ public:
+  explicit ClusterClient(const std::vector<std::string>& endpoints);
+  ~ClusterClient();
+
+  ClusterClient(const ClusterClient&) = delete;
+  ClusterClient& operator=(const ClusterClient&) = delete;
+
+  /**
+   * @brief Copy the merged GPU list (grouped by host, in endpoint order) into
+   * `gpus` if anything changed since the last call.
+   * @return true if `gpus` was updated.
+   */
+  bool sync(std::vector<GpuState>& gpus);
+
+  size_t host_count() const { return connections_.size(); }
+  size_t connected_count() const { return connected_count_; }
+
+ private:
+  struct Connection {
+    ClusterEndpoint endpoint;
+    int fd = -1;
+    bool connecting = false;
+    bool connected = false;
+    // While connecting, the resolved addresses and the next one to try.
+    std::shared_ptr<addrinfo> addresses;
+    addrinfo* next_address = nullptr;
+    std::chrono::steady_clock::time_point retry_at;
+    std::chrono::seconds backoff{1};
+    std::string in;
+
+    // Guarded by mutex_.
+    std::string host;
+    std::vector<GpuState> gpus;
+  };
+
+  void run();
+  void start_connect(Connection& conn);
+  void finish_connect(Connection& conn);
+  void read_from(Connection& conn);
+  void disconnect(Connection& conn, const std::string& reason);
+
+  std::vector<Connection> connections_;
+  std::atomic<size_t> connected_count_{0};
+  std::atomic<bool> stop_{false};
+
+  std::mutex mutex_;
+  bool changed_ = false;
+
+  std::thread thread_;
+};
@@ -2,161 +2,442 @@
 
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <climits>
+#include <iterator>
+
 using namespace ftxui;
 
-static Element clock_event_text(
-    const std::string& code,
-    const std::optional<std::chrono::system_clock::time_point>& event_time,
-    Color active_color) {
-  std::string time_suffix;
+namespace {
+
+using TimePoint = std::chrono::system_clock::time_point;
+
+// Cells of one GPU row. They are rebuilt only when the GPU has a new sample,
+// except the clock events whose relative labels also age with time.
+struct RowCells {
+  unsigned long long generation = ULLONG_MAX;
+  bool short_name = false;
+  Element host, index, name, util, memory, clock, power, temp, slowdown, fan,
+      persistence, bottleneck;
+
+  std::string event_labels[3];
+  Element clock_event;
+};
+
+enum class SortKey { Index, Util, Power, Temp, Clock, Memory };
+const char* SORT_KEY_NAMES[] = {"Index", "Util", "Power",
+                                "Temp",  "Clock", "Memory"};
+const int SORT_KEY_COUNT = 6;
+const int TOP_N_CHOICES[] = {0, 8, 16, 32};  // 0: all GPUs
+const int TOP_N_CHOICE_COUNT = 4;
+
+struct DashboardState {
+  std::vector<RowCells> rows;  // indexed like gpu_states
+  std::vector<const RowCells*> visible_rows;
+  std::string buffer;  // reused by every format call
+  std::string label;
+
+  SortKey sort_key = SortKey::Index;
+  int top_n_choice = 0;
+  int scroll = 0;
+  int visible_count = 1;
+  Box box;  // where the dashboard was drawn last frame
+
+  // GPU indices; order[0, sorted_count) is sorted by order_key. Only
+  // recomputed when a GPU has a new sample or the key changes.
+  std::vector<size_t> order;
+  size_t sorted_count = 0;
+  SortKey order_key = SortKey::Index;
+  unsigned long long order_signature = 0;
+};
+
+template <typename... Args>
+const std::string& format_into(std::string& buffer,
+                               fmt::format_string<Args...> format,
+                               Args&&... args) {
+  buffer.clear();
+  fmt::format_to(std::back_inserter(buffer), format,
+                 std::forward<Args>(args)...);
+  return buffer;
+}
+
+void format_clock_event(std::string& out, const char* code,
+                        const std::optional<TimePoint>& event_time) {
   if (!event_time) {
-    time_suffix = "-";
+    format_into(out, "{}:-", code);
+    return;
+  }
+  auto t_sec = std::chrono::duration_cast<std::chrono::seconds>(
+                   std::chrono::system_clock::now() - *event_time)
+                   .count();
+  if (t_sec < 0) t_sec = 0;
+  if (t_sec >= 86400) {
+    format_into(out, "{}:{}d", code, t_sec / 86400);
+  } else if (t_sec >= 3600) {
+    format_into(out, "{}:{}h", code, t_sec / 3600);
+  } else if (t_sec >= 60) {
+    format_into(out, "{}:{}m", code, t_sec / 60);
   } else {
-    auto t_sec = std::chrono::duration_cast<std::chrono::seconds>(
-                     std::chrono::system_clock::now() - *event_time)
-                     .count();
-    if (t_sec < 0) t_sec = 0;
-    if (t_sec >= 86400) {
-      time_suffix = fmt::format("{}d", t_sec / 86400);
-    } else if (t_sec >= 3600) {
-      time_suffix = fmt::format("{}h", t_sec / 3600);
-    } else if (t_sec >= 60) {
-      time_suffix = fmt::format("{}m", t_sec / 60);
-    } else {
-      time_suffix = fmt::format("{}s", t_sec);
-    }
+    format_into(out, "{}:{}s", code, t_sec);
   }
-  std::string fmt_text = fmt::format("{}:{}", code, time_suffix);
+}
 
-  if (!event_time) return text(fmt_text) | dim;
-  return text(fmt_text) | color(active_color);
+Element clock_event_text(const std::string& label, bool active,
+                         Color active_color) {
+  if (!active) return text(label) | dim;
+  return text(label) | color(active_color);
 }
 
-Component Dashboard(const std::vector<GpuState>& gpu_states) {
-  return Renderer([&gpu_states] {
-    Elements columns;
-
-    Elements gpu_column;
-    gpu_column.push_back(text("GPU") | bold);
-    gpu_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      gpu_column.push_back(text(fmt::format("{}", gs.index)));
+Color bottleneck_color(Bottleneck bottleneck) {
+  switch (bottleneck) {
+    case Bottleneck::Compute:
+      return Color::Green;
+    case Bottleneck::Memory:
+      return Color::Cyan;
+    case Bottleneck::Starved:
+    case Bottleneck::Power:
+      return Color::Yellow;
+    case Bottleneck::Thermal:
+      return Color::Red;
+    default:
+      return Color::Default;
+  }
+}
+
+Color load_color(int percent) {
+  if (percent >= 80) return Color::Red;
+  if (percent >= 50) return Color::Yellow;
+  return Color::Green;
+}
+
+void update_sample_cells(DashboardState& state, RowCells& row,
+                         const GpuState& gs, bool use_short_name) {
+  std::string& buf = state.buffer;
+  row.generation = gs.sample_generation;
+  row.short_name = use_short_name;
+
+  row.host = text(gs.host);
+  row.index = text(format_into(buf, "{}", gs.index));
+  row.name = text(use_short_name ? gs.name_short : gs.name);
+  row.util = text(format_into(buf, "{}%", gs.gpu_util_percent)) |
+             color(load_color(gs.gpu_util_percent));
+
+  int mem_percent =
+      gs.mem_total_mib ? (gs.mem_used_mib * 100 / gs.mem_total_mib) : 0;
+  row.memory = text(format_into(buf, "{}/{}MiB {}%", gs.mem_used_mib,
+                                gs.mem_total_mib, mem_percent)) |
+               color(load_color(mem_percent));
+
+  row.clock = text(format_into(buf, "{}MHz", gs.gpu_clock_mhz));
+
+  int real_pl =
+      gs.power_limit_w == -1 ? gs.enforced_power_limit_w : gs.power_limit_w;
+  row.power = text(real_pl >= 0
+                       ? format_into(buf, "{}/{}W", gs.power_usage_w, real_pl)
+                       : format_into(buf, "{}/N/AW", gs.power_usage_w));
+
+  row.temp = text(format_into(buf, "{}C", gs.temperature_c));
+
+  // Forecast time to thermal slowdown; a minute of warning is enough to act.
+  if (gs.seconds_to_slowdown < 0) {
+    row.slowdown = text("-") | dim;
+  } else if (gs.seconds_to_slowdown == 0) {
+    row.slowdown = text("Now") | color(Color::Red);
+  } else if (gs.seconds_to_slowdown < 60) {
+    row.slowdown = text(format_into(buf, "{}s", gs.seconds_to_slowdown)) |
+                   color(Color::Red);
+  } else {
+    row.slowdown = text(format_into(buf, "{}m", gs.seconds_to_slowdown / 60)) |
+                   color(Color::Yellow);
+  }
+
+  if (gs.fan_speed_percent < 0) {
+    row.fan = text("N/A");
+  } else if (gs.fan_speed_rpm < 0) {
+    row.fan = text(format_into(buf, "{}%", gs.fan_speed_percent));
+  } else {
+    row.fan = text(format_into(buf, "{}% {}R", gs.fan_speed_percent,
+                               gs.fan_speed_rpm));
+  }
+
+  if (gs.persistence_mode < 0) {
+    row.persistence = text("N/A") | dim;
+  } else {
+    row.persistence = gs.persistence_mode ? text("On") : (text("Off") | dim);
+  }
+
+  // A guess from few or disagreeing samples is shown dim.
+  row.bottleneck =
+      text(format_into(buf, "{} {}%", bottleneck_name(gs.bottleneck),
+                       gs.bottleneck_confidence)) |
+      color(bottleneck_color(gs.bottleneck));
+  if (gs.bottleneck_confidence < 60) {
+    row.bottleneck |= dim;
+  }
+}
+
+void update_clock_event_cell(DashboardState& state, RowCells& row,
+                             const GpuState& gs) {
+  bool changed =
+      format_clock_event_labels(gs, row.event_labels, state.label) ||
+      !row.clock_event;
+  if (!changed) {
+    return;
+  }
+
+  const std::optional<TimePoint>* events[3] = {
+      &gs.last_event_power_cap_time,
+      &gs.last_event_swt_slowdown_time,
+      &gs.last_event_hwt_slowdown_time,
+  };
+  row.clock_event = hbox({
+      clock_event_text(row.event_labels[0], events[0]->has_value(),
+                       Color::Blue),
+      text(" "),
+      clock_event_text(row.event_labels[1], events[1]->has_value(),
+                       Color::Yellow),
+      text(" "),
+      clock_event_text(row.event_labels[2], events[2]->has_value(),
+                       Color::Red),
+  });
+}
+
+Element column(const DashboardState& state, const char* title,
+               Element RowCells::*cell) {
+  Elements elements;
+  elements.reserve(state.visible_rows.size() + 2);
+  elements.push_back(text(title) | bold);
+  elements.push_back(separator());
+  for (const RowCells* row : state.visible_rows) {
+    elements.push_back(row->*cell);
+  }
+  return vbox(std::move(elements));
+}
+
+int sort_value(const GpuState& gs, SortKey key) {
+  switch (key) {
+    case SortKey::Util:
+      return gs.gpu_util_percent;
+    case SortKey::Power:
+      return gs.power_usage_w;
+    case SortKey::Temp:
+      return gs.temperature_c;
+    case SortKey::Clock:
+      return gs.gpu_clock_mhz;
+    case SortKey::Memory:
+      return gs.mem_used_mib;
+    case SortKey::Index:
+    default:
+      return -static_cast<int>(gs.index);
+  }
+}
+
+// Make sure the first `needed` entries of state.order are sorted. Only those
+// are shown, so a partial sort is enough.
+void update_order(DashboardState& state,
+                  const std::vector<GpuState>& gpu_states, size_t needed) {
+  unsigned long long signature = gpu_states.size();
+  for (const auto& gs : gpu_states) {
+    signature += gs.sample_generation;
+  }
+
+  bool invalid = state.order.size() != gpu_states.size() ||
+                 state.order_key != state.sort_key ||
+                 (state.sort_key != SortKey::Index &&
+                  state.order_signature != signature);
+  if (!invalid && needed <= state.sorted_count) {
+    return;
+  }
+
+  state.order.resize(gpu_states.size());
+  for (size_t i = 0; i < state.order.size(); ++i) {
+    state.order[i] = i;
+  }
+  state.order_key = state.sort_key;
+  state.order_signature = signature;
+  if (state.sort_key == SortKey::Index) {
+    state.sorted_count = state.order.size();
+    return;
+  }
+
+  SortKey key = state.sort_key;
+  needed = std::min(needed, state.order.size());
+  std::partial_sort(state.order.begin(), state.order.begin() + needed,
+                    state.order.end(), [&gpu_states, key](size_t a, size_t b) {
+                      int va = sort_value(gpu_states[a], key);
+                      int vb = sort_value(gpu_states[b], key);
+                      return va != vb ? va > vb : a < b;
+                    });
+  state.sorted_count = needed;
+}
+
+bool handle_event(DashboardState& state, Event event) {
+  if (event == Event::Character('s')) {
+    state.sort_key =
+        static_cast<SortKey>((static_cast<int>(state.sort_key) + 1) %
+                             SORT_KEY_COUNT);
+    state.scroll = 0;
+    return true;
+  }
+  if (event == Event::Character('t')) {
+    state.top_n_choice = (state.top_n_choice + 1) % TOP_N_CHOICE_COUNT;
+    state.scroll = 0;
+    return true;
+  }
+  if (event == Event::ArrowUp && state.scroll > 0) {
+    state.scroll--;
+    return true;
+  }
+  if (event == Event::ArrowDown) {
+    state.scroll++;  // clamped on render
+    return true;
+  }
+  if (event == Event::PageUp) {
+    state.scroll = std::max(0, state.scroll - state.visible_count);
+    return true;
+  }
+  if (event == Event::PageDown) {
+    state.scroll += state.visible_count;
+    return true;
+  }
+  if (event == Event::Home) {
+    state.scroll = 0;
+    return true;
+  }
+  if (event == Event::End) {
+    state.scroll = INT_MAX / 2;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+bool format_clock_event_labels(const GpuState& gs, std::string (&labels)[3],
+                               std::string& scratch) {
+  const std::optional<TimePoint>* events[3] = {
+      &gs.last_event_power_cap_time,
+      &gs.last_event_swt_slowdown_time,
+      &gs.last_event_hwt_slowdown_time,
+  };
+  static const char* CODES[3] = {"PC", "ST", "HT"};
+
+  bool changed = false;
+  for (int i = 0; i < 3; ++i) {
+    format_clock_event(scratch, CODES[i], *events[i]);
+    if (scratch != labels[i]) {
+      labels[i] = scratch;
+      changed = true;
     }
-    columns.push_back(vbox(gpu_column) | size(WIDTH, EQUAL, 3));
-    columns.push_back(separator());
+  }
+  return changed;
+}
 
-    Elements name_column;
+Component Dashboard(const std::vector<GpuState>& gpu_states) {
+  auto state = std::make_shared<DashboardState>();
+  auto renderer = Renderer([&gpu_states, state](bool focused) {
     int terminal_width = Terminal::Size().dimx;
     bool use_short_name = terminal_width < 112;
-    name_column.push_back(text("Name") | bold);
-    name_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      name_column.push_back(text(use_short_name ? gs.name_short : gs.name));
-    }
-    columns.push_back(vbox(name_column) | flex);
-    columns.push_back(separator());
-
-    Elements util_column;
-    util_column.push_back(text("Util") | bold);
-    util_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      Color util_color = Color::Green;
-      if (gs.gpu_util_percent >= 80)
-        util_color = Color::Red;
-      else if (gs.gpu_util_percent >= 50)
-        util_color = Color::Yellow;
-      util_column.push_back(text(fmt::format("{}%", gs.gpu_util_percent)) |
-                            color(util_color));
-    }
-    columns.push_back(vbox(util_column) | size(WIDTH, EQUAL, 4));
-    columns.push_back(separator());
-
-    Elements memory_column;
-    memory_column.push_back(text("Memory") | bold);
-    memory_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      int mem_percent =
-          gs.mem_total_mib ? (gs.mem_used_mib * 100 / gs.mem_total_mib) : 0;
-      Color mem_color = Color::Green;
-      if (mem_percent >= 80)
-        mem_color = Color::Red;
-      else if (mem_percent >= 50)
-        mem_color = Color::Yellow;
-      memory_column.push_back(
-          text(fmt::format("{}/{}MiB {}%", gs.mem_used_mib, gs.mem_total_mib,
-                           gs.mem_total_mib
-                               ? gs.mem_used_mib * 100 / gs.mem_total_mib
-                               : 0)) |
-          color(mem_color));
-    }
-    columns.push_back(vbox(memory_column) | size(WIDTH, GREATER_THAN, 18));
-    columns.push_back(separator());
-
-    Elements clock_column;
-    clock_column.push_back(text("Clock") | bold);
-    clock_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      clock_column.push_back(text(fmt::format("{}MHz", gs.gpu_clock_mhz)));
-    }
-    columns.push_back(vbox(clock_column) | size(WIDTH, EQUAL, 7));
-    columns.push_back(separator());
-
-    Elements power_column;
-    power_column.push_back(text("Power") | bold);
-    power_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      int real_pl =
-          gs.power_limit_w == -1 ? gs.enforced_power_limit_w : gs.power_limit_w;
-      power_column.push_back(
-          text(fmt::format("{}/{}W", gs.power_usage_w,
-                           real_pl >= 0 ? std::to_string(real_pl) : "N/A")));
+
+    // Only build the rows that fit: border, header and status line take 5.
+    int height = state->box.y_max - state->box.y_min + 1;
+    if (height <= 1) {
+      height = Terminal::Size().dimy - 13;
     }
-    columns.push_back(vbox(power_column) | size(WIDTH, EQUAL, 11));
-    columns.push_back(separator());
-
-    Elements temp_column;
-    temp_column.push_back(text("Temp") | bold);
-    temp_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      temp_column.push_back(text(fmt::format("{}C", gs.temperature_c)));
+    state->visible_count = std::max(1, height - 5);
+
+    int top_n = TOP_N_CHOICES[state->top_n_choice];
+    int count = static_cast<int>(gpu_states.size());
+    if (top_n > 0) {
+      count = std::min(count, top_n);
     }
-    columns.push_back(vbox(temp_column) | size(WIDTH, EQUAL, 4));
-    columns.push_back(separator());
-
-    Elements fan_column;
-    fan_column.push_back(text("Fan") | bold);
-    fan_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      std::string fs = gs.fan_speed_percent < 0
-                           ? "N/A"
-                           : fmt::format("{}%", gs.fan_speed_percent);
-      std::string fs_rpm =
-          gs.fan_speed_rpm < 0 ? "N/A" : fmt::format("{}R", gs.fan_speed_rpm);
-      if (gs.fan_speed_rpm < 0) {
-        fan_column.push_back(text(fs));
-      } else {
-        fan_column.push_back(text(fmt::format("{} {}", fs, fs_rpm)));
+    state->scroll = std::clamp(state->scroll, 0,
+                               std::max(0, count - state->visible_count));
+    int end = std::min(count, state->scroll + state->visible_count);
+    update_order(*state, gpu_states, end);
+
+    state->rows.resize(gpu_states.size());
+    state->visible_rows.clear();
+    for (int pos = state->scroll; pos < end; ++pos) {
+      size_t i = state->order[pos];
+      RowCells& row = state->rows[i];
+      const GpuState& gs = gpu_states[i];
+      if (row.generation != gs.sample_generation ||
+          row.short_name != use_short_name) {
+        update_sample_cells(*state, row, gs, use_short_name);
       }
+      update_clock_event_cell(*state, row, gs);
+      state->visible_rows.push_back(&row);
     }
-    columns.push_back(vbox(fan_column) | size(WIDTH, GREATER_THAN, 4) |
-                      size(WIDTH, LESS_THAN, 13));
-    columns.push_back(separator());
-
-    Elements clock_event_column;
-    clock_event_column.push_back(text("Clock Event") | bold);
-    clock_event_column.push_back(separator());
-    for (const auto& gs : gpu_states) {
-      clock_event_column.push_back(hbox({
-          clock_event_text("PC", gs.last_event_power_cap_time, Color::Blue),
-          text(" "),
-          clock_event_text("ST", gs.last_event_swt_slowdown_time,
-                           Color::Yellow),
-          text(" "),
-          clock_event_text("HT", gs.last_event_hwt_slowdown_time, Color::Red),
-      }));
+
+    // In cluster mode GPUs come grouped by host, and indices repeat per host.
+    bool show_host = std::any_of(gpu_states.begin(), gpu_states.end(),
+                                 [](const GpuState& gs) {
+                                   return !gs.host.empty();
+                                 });
+    Elements host_column;
+    if (show_host) {
+      host_column = {column(*state, "Host", &RowCells::host) |
+                         size(WIDTH, LESS_THAN, 16),
+                     separator()};
     }
-    columns.push_back(vbox(clock_event_column) | size(WIDTH, GREATER_THAN, 18));
 
-    return vbox(hbox(columns) | border);
+    auto table = hbox({
+                     hbox(std::move(host_column)),
+                     column(*state, "GPU", &RowCells::index) |
+                         size(WIDTH, EQUAL, 3),
+                     separator(),
+                     column(*state, "Name", &RowCells::name) | flex,
+                     separator(),
+                     column(*state, "Util", &RowCells::util) |
+                         size(WIDTH, EQUAL, 4),
+                     separator(),
+                     column(*state, "Memory", &RowCells::memory) |
+                         size(WIDTH, GREATER_THAN, 18),
+                     separator(),
+                     column(*state, "Clock", &RowCells::clock) |
+                         size(WIDTH, EQUAL, 7),
+                     separator(),
+                     column(*state, "Power", &RowCells::power) |
+                         size(WIDTH, EQUAL, 11),
+                     separator(),
+                     column(*state, "Temp", &RowCells::temp) |
+                         size(WIDTH, EQUAL, 4),
+                     separator(),
+                     column(*state, "ST in", &RowCells::slowdown) |
+                         size(WIDTH, EQUAL, 5),
+                     separator(),
+                     column(*state, "Fan", &RowCells::fan) |
+                         size(WIDTH, GREATER_THAN, 4) |
+                         size(WIDTH, LESS_THAN, 13),
+                     separator(),
+                     column(*state, "PM", &RowCells::persistence) |
+                         size(WIDTH, EQUAL, 3),
+                     separator(),
+                     column(*state, "Bound", &RowCells::bottleneck) |
+                         size(WIDTH, EQUAL, 12),
+                     separator(),
+                     column(*state, "Clock Event", &RowCells::clock_event) |
+                         size(WIDTH, GREATER_THAN, 18),
+                 }) |
+                 border;
+
+    std::string status = fmt::format(
+        "Sort: {}{} | GPUs {}-{} of {} | [s] sort [t] top N [Up/Down/PgUp/"
+        "PgDn] scroll",
+        SORT_KEY_NAMES[static_cast<int>(state->sort_key)],
+        top_n > 0 ? fmt::format(" | Top {}", top_n) : "",
+        end > state->scroll ? state->scroll + 1 : 0, end, gpu_states.size());
+
+    return vbox({
+               table,
+               text(status) | (focused ? bold : dim),
+               filler(),
+           }) |
+           reflect(state->box);
+  });
+
+  return CatchEvent(renderer, [state](Event event) {
+    return handle_event(*state, event);
   });
 }
@@ -1,6 +1,16 @@
 #pragma once
 #include <ftxui/component/component.hpp>
+#include <string>
 
 #include "nvtuner.h"
 
 ftxui::Component Dashboard(const std::vector<GpuState>& gpu_states);
+
+/**
+ * @brief Format the PC / ST / HT clock event labels of `gs` (e.g. "PC:12s")
+ * into `labels`, through `scratch`. Both keep their capacity, so once the
+ * labels settle this does not allocate.
+ * @return true if any label changed.
+ */
+bool format_clock_event_labels(const GpuState& gs, std::string (&labels)[3],
+                               std::string& scratch);
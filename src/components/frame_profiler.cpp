@@ -0,0 +1,206 @@
+#include "frame_profiler.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "alloc_counter.h"
+#include "nlohmann/json.hpp"
+#include "sys_utils.h"
+
+using namespace ftxui;
+using json = nlohmann::json;
+
+namespace {
+float elapsed_us(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<float, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+void FrameProfiler::Stats::add(float us, uint32_t alloc_count) {
+  if (time_us.size() < WINDOW) {
+    time_us.push_back(us);
+    allocs.push_back(alloc_count);
+  } else {
+    time_us[next] = us;
+    allocs[next] = alloc_count;
+  }
+  next = (next + 1) % WINDOW;
+}
+
+FrameProfiler& FrameProfiler::instance() {
+  static FrameProfiler profiler;
+  return profiler;
+}
+
+Component FrameProfiler::Profiled(const std::string& name, Component child) {
+  size_t id = instance().register_section(name);
+  return Renderer(child, [child, id] {
+    FrameProfiler& profiler = instance();
+    if (!profiler.enabled_) {
+      return child->Render();
+    }
+    uint64_t allocs_before = AllocCounter::count();
+    auto start = std::chrono::steady_clock::now();
+    Element element = child->Render();
+    profiler.sections_[id].add(
+        elapsed_us(start),
+        static_cast<uint32_t>(AllocCounter::count() - allocs_before));
+    return element;
+  });
+}
+
+Component FrameProfiler::Overlay(Component root) {
+  auto renderer = Renderer(root, [this, root] {
+    if (!enabled_) {
+      return root->Render();
+    }
+    finish_pending_frame();
+
+    uint64_t allocs_before = AllocCounter::count();
+    auto start = std::chrono::steady_clock::now();
+    Element element = root->Render();
+    pending_render_us_ = elapsed_us(start);
+    pending_allocs_ =
+        static_cast<uint32_t>(AllocCounter::count() - allocs_before);
+    if (output_timer_) {
+      output_time_after_render_ = output_timer_->total_time();
+    }
+    frame_pending_ = true;
+
+    return dbox({
+        element,
+        hbox({filler(), vbox({render_overlay() | clear_under, filler()})}),
+    });
+  });
+
+  return CatchEvent(renderer, [this](Event event) {
+    if (event == Event::F12) {
+      set_enabled(!enabled_);
+      return true;
+    }
+    if (enabled_ && event == Event::Character('e')) {
+      if (export_json()) {
+        std::clog << fmt::format("Frame profile exported to {}.",
+                                 export_path_)
+                  << std::endl;
+      }
+      return true;
+    }
+    return false;
+  });
+}
+
+void FrameProfiler::set_enabled(bool enabled) {
+  enabled_ = enabled;
+  frame_pending_ = false;
+}
+
+size_t FrameProfiler::register_section(const std::string& name) {
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    if (sections_[i].name == name) {
+      return i;
+    }
+  }
+  sections_.emplace_back(name);
+  return sections_.size() - 1;
+}
+
+void FrameProfiler::finish_pending_frame() {
+  if (!frame_pending_) {
+    return;
+  }
+  float flush_us = 0;
+  if (output_timer_) {
+    flush_us = std::chrono::duration<float, std::micro>(
+                   output_timer_->total_time() - output_time_after_render_)
+                   .count();
+  }
+  flush_.add(flush_us, 0);
+  frame_.add(pending_render_us_ + flush_us, pending_allocs_);
+  frame_pending_ = false;
+}
+
+FrameProfiler::Summary FrameProfiler::summarize(const Stats& stats) const {
+  Summary summary;
+  summary.samples = stats.time_us.size();
+  if (summary.samples == 0) {
+    return summary;
+  }
+
+  scratch_time_.assign(stats.time_us.begin(), stats.time_us.end());
+  std::sort(scratch_time_.begin(), scratch_time_.end());
+  size_t last = scratch_time_.size() - 1;
+  double sum = 0;
+  for (float us : scratch_time_) {
+    sum += us;
+  }
+  summary.p50_ms = scratch_time_[last / 2] / 1000.0;
+  summary.p99_ms = scratch_time_[last * 99 / 100] / 1000.0;
+  summary.mean_ms = sum / scratch_time_.size() / 1000.0;
+  summary.max_ms = scratch_time_[last] / 1000.0;
+
+  scratch_allocs_.assign(stats.allocs.begin(), stats.allocs.end());
+  std::sort(scratch_allocs_.begin(), scratch_allocs_.end());
+  summary.allocs_p50 = scratch_allocs_[last / 2];
+  summary.allocs_max = scratch_allocs_[last];
+  return summary;
+}
+
+Element FrameProfiler::render_overlay() const {
+  auto row = [this](const Stats& stats, bool show_allocs) {
+    Summary s = summarize(stats);
+    return text(fmt::format(
+        "{:<18} {:>7.2f} {:>7.2f} {:>7}", stats.name, s.p50_ms, s.p99_ms,
+        show_allocs ? std::to_string(s.allocs_p50) : std::string("-")));
+  };
+
+  Elements rows;
+  rows.push_back(text(fmt::format("{:<18} {:>7} {:>7} {:>7}", "Component",
+                                  "p50 ms", "p99 ms", "allocs")) |
+                 bold);
+  rows.push_back(separator());
+  for (const Stats& stats : sections_) {
+    if (!stats.time_us.empty()) {
+      rows.push_back(row(stats, true));
+    }
+  }
+  rows.push_back(separator());
+  rows.push_back(row(flush_, false));
+  rows.push_back(row(frame_, true));
+  rows.push_back(text(fmt::format("last {} frames | e: export", WINDOW)) |
+                 dim);
+  return window(text("Frame Profiler (F12)"), vbox(rows));
+}
+
+bool FrameProfiler::export_json() const {
+  auto to_json = [this](const Stats& stats) {
+    Summary s = summarize(stats);
+    return json{{"samples", s.samples},       {"p50_ms", s.p50_ms},
+                {"p99_ms", s.p99_ms},         {"mean_ms", s.mean_ms},
+                {"max_ms", s.max_ms},         {"allocs_p50", s.allocs_p50},
+                {"allocs_max", s.allocs_max}};
+  };
+
+  json data;
+  for (const Stats& stats : sections_) {
+    if (!stats.time_us.empty()) {
+      data["components"][stats.name] = to_json(stats);
+    }
+  }
+  data["flush"] = to_json(flush_);
+  data["frame"] = to_json(frame_);
+
+  std::ofstream outfile(SysUtils::make_path_string(export_path_));
+  if (!outfile) {
+    std::cerr << fmt::format("Failed to open {}.", export_path_) << std::endl;
+    return false;
+  }
+  outfile << data.dump(4);
+  return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <ftxui/component/component.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "stream_redirect.h"
+
+// Times Render() of the top-level components and the terminal flush, per
+// frame. Shown as an overlay toggled with F12.
+class FrameProfiler {
+ public:
+  static FrameProfiler& instance();
+
+  /**
+   * @brief Time `child`'s Render() under `name` while profiling is enabled.
+   * Components sharing a name share their stats.
+   */
+  static ftxui::Component Profiled(const std::string& name,
+                                   ftxui::Component child);
+
+  /**
+   * @brief Wrap the root component: time whole frames, draw the overlay and
+   * handle its keys (F12: toggle, 'e': export while shown).
+   */
+  ftxui::Component Overlay(ftxui::Component root);
+
+  bool enabled() const { return enabled_; }
+  void set_enabled(bool enabled);
+  void set_output_timer(const TimedStreamBuffer* timer) {
+    output_timer_ = timer;
+  }
+  void set_export_path(const std::string& path) { export_path_ = path; }
+
+  /**
+   * @return true on success
+   */
+  bool export_json() const;
+
+ private:
+  struct Stats {
+    explicit Stats(std::string name) : name(std::move(name)) {}
+
+    std::string name;
+    std::vector<float> time_us;    // ring buffers of the last WINDOW frames
+    std::vector<uint32_t> allocs;
+    size_t next = 0;
+
+    void add(float us, uint32_t alloc_count);
+  };
+
+  struct Summary {
+    size_t samples = 0;
+    double p50_ms = 0, p99_ms = 0, mean_ms = 0, max_ms = 0;
+    uint32_t allocs_p50 = 0, allocs_max = 0;
+  };
+
+  static const size_t WINDOW = 300;
+
+  FrameProfiler() = default;
+
+  size_t register_section(const std::string& name);
+  void finish_pending_frame();
+  Summary summarize(const Stats& stats) const;
+  ftxui::Element render_overlay() const;
+
+  bool enabled_ = false;
+  const TimedStreamBuffer* output_timer_ = nullptr;
+  std::string export_path_;
+
+  std::vector<Stats> sections_;
+  Stats frame_{"Frame"};
+  Stats flush_{"Flush"};
+
+  // The flush of a frame happens after its render returns, so a frame is
+  // recorded when the next one starts.
+  bool frame_pending_ = false;
+  float pending_render_us_ = 0;
+  uint32_t pending_allocs_ = 0;
+  std::chrono::nanoseconds output_time_after_render_{0};
+
+  mutable std::vector<float> scratch_time_;
+  mutable std::vector<uint32_t> scratch_allocs_;
+};
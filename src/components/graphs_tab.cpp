@@ -3,10 +3,35 @@
 #include <fmt/core.h>
 
 #include <algorithm>
+#include <climits>
 #include <iostream>
 
+#include "frame_profiler.h"
+
 using namespace ftxui;
 
+namespace {
+struct OverlayMetric {
+  const char* name;
+  const char* type;  // as in GpuGraphData::series
+  const char* unit;
+  int threshold;  // off the median by this much is an outlier
+  StragglerDetector::Direction slow;
+};
+
+// The clock comes first: in data-parallel work, it is what sets the pace.
+const OverlayMetric OVERLAY_METRICS[] = {
+    {"GPU Clock", "gpu_clock", "MHz", 50, StragglerDetector::Direction::Low},
+    {"Util", "util", "%", 10, StragglerDetector::Direction::Low},
+    {"Memory", "mem", "%", 10, StragglerDetector::Direction::Low},
+    {"Temperature", "temp", "C", 5, StragglerDetector::Direction::High},
+};
+const int OVERLAY_METRIC_COUNT =
+    sizeof(OVERLAY_METRICS) / sizeof(OVERLAY_METRICS[0]);
+// Stragglers by this metric are marked in the GPU menu.
+const int STRAGGLER_METRIC = 0;
+}  // namespace
+
 // -----------------------------------------------------------------------------
 // GpuGraphData
 // -----------------------------------------------------------------------------
@@ -25,13 +50,18 @@ void GraphsTab::GpuGraphData::add_sample(const GpuState& gs) {
   }
 }
 
+const std::deque<int>& GraphsTab::GpuGraphData::series(
+    const std::string& type) const {
+  return (type == "util")        ? util
+         : (type == "mem")       ? mem
+         : (type == "gpu_clock") ? gpu_clock
+                                 : temp;
+}
+
 std::vector<int> GraphsTab::GpuGraphData::get_normalized(
     const std::string& type, int width, int height) const {
   std::vector<int> result(width, 0);
-  const auto& data = (type == "util")        ? util
-                     : (type == "mem")       ? mem
-                     : (type == "gpu_clock") ? gpu_clock
-                                             : temp;
+  const auto& data = series(type);
 
   if (data.empty()) return result;
 
@@ -93,10 +123,15 @@ GraphsTab::GraphsTab(const std::vector<GpuState>& gpu_states)
     gpu_history_[i].max_supported_gpu_clock = gpu_states_[i].gpu_max_clock_mhz;
   }
 
+  for (const auto& metric : OVERLAY_METRICS) {
+    detectors_.emplace_back(gpu_states_.size(), metric.threshold, metric.slow);
+  }
+
   menu_entries_.clear();
   for (size_t i = 0; i < gpu_states_.size(); ++i) {
     menu_entries_.push_back(std::to_string(i));
   }
+  menu_entries_.push_back("All");
   menu_component_ = Menu(&menu_entries_, &selected_gpu_);
 
   subtab_components_.clear();
@@ -153,14 +188,19 @@ GraphsTab::GraphsTab(const std::vector<GpuState>& gpu_states)
              flex;
     });
 
-    subtab_components_.push_back(subtab_component);
+    subtab_components_.push_back(FrameProfiler::Profiled(
+        fmt::format("Graphs/GPU {}", i), subtab_component));
   }
 
+  subtab_components_.push_back(FrameProfiler::Profiled(
+      "Graphs/All", Renderer([this] { return render_overlay(); })));
+
   auto subtabs_container = Container::Tab(subtab_components_, &selected_gpu_);
-  main_component_ = Renderer(menu_component_, [this, subtabs_container] {
+  auto renderer = Renderer(menu_component_, [this, subtabs_container] {
     return hbox({
         vbox({
-            text(fmt::format("GPU {}", selected_gpu_)),
+            text(overlay_selected() ? "All GPUs"
+                                    : fmt::format("GPU {}", selected_gpu_)),
             separator(),
             menu_component_->Render(),
         }),
@@ -168,12 +208,146 @@ GraphsTab::GraphsTab(const std::vector<GpuState>& gpu_states)
         subtabs_container->Render(),
     });
   });
+  main_component_ = CatchEvent(renderer, [this](Event event) {
+    if (overlay_selected() && event == Event::Character('m')) {
+      overlay_metric_ = (overlay_metric_ + 1) % OVERLAY_METRIC_COUNT;
+      return true;
+    }
+    return false;
+  });
 }
 
 void GraphsTab::update() {
   for (size_t i = 0; i < gpu_states_.size() && i < gpu_history_.size(); ++i) {
     gpu_history_[i].add_sample(gpu_states_[i]);
   }
+
+  for (int m = 0; m < OVERLAY_METRIC_COUNT; ++m) {
+    sample_values_.clear();
+    for (const auto& history : gpu_history_) {
+      sample_values_.push_back(history.series(OVERLAY_METRICS[m].type).back());
+    }
+    detectors_[m].add_sample(sample_values_);
+  }
+  const StragglerDetector& detector = detectors_[STRAGGLER_METRIC];
+  for (size_t i = 0; i < gpu_states_.size(); ++i) {
+    menu_entries_[i] =
+        detector.straggler(i) ? fmt::format("{} !", i) : std::to_string(i);
+  }
+}
+
+Element GraphsTab::render_overlay() {
+  const OverlayMetric& metric = OVERLAY_METRICS[overlay_metric_];
+  const StragglerDetector& detector = detectors_[overlay_metric_];
+  auto flagged = [&detector](size_t i) {
+    return detector.straggler(i) || detector.outlier(i);
+  };
+  auto gpu_color = [&detector](size_t i) -> Color {
+    return detector.straggler(i)  ? Color::Red
+           : detector.outlier(i) ? Color::Yellow
+                                  : Color::GrayDark;
+  };
+
+  auto plot = canvas([this, &metric, flagged, gpu_color](Canvas& c) {
+    if (gpu_history_.empty()) {
+      return;
+    }
+    int w = c.width();
+    int h = c.height() - 1;
+    size_t history = gpu_history_[0].series(metric.type).size();
+    size_t shown = std::min(history, static_cast<size_t>(w));
+    size_t first = history - shown;
+
+    // Fit the visible samples, so a gap of a few percent still shows.
+    int lo = INT_MAX;
+    int hi = INT_MIN;
+    for (const auto& gpu : gpu_history_) {
+      const auto& data = gpu.series(metric.type);
+      for (size_t k = first; k < data.size(); ++k) {
+        if (data[k] >= 0) {
+          lo = std::min(lo, data[k]);
+          hi = std::max(hi, data[k]);
+        }
+      }
+    }
+    if (lo > hi) {
+      return;
+    }
+    int pad = std::max((hi - lo) / 10, metric.threshold);
+    lo = std::max(lo - pad, 0);
+    hi += pad;
+    auto to_x = [&](size_t k) {
+      return static_cast<int>(w - shown + k - first);
+    };
+    auto to_y = [&](int v) { return h - (v - lo) * h / (hi - lo); };
+
+    // Flagged GPUs last, so they are drawn on top.
+    for (bool pass_flagged : {false, true}) {
+      for (size_t i = 0; i < gpu_history_.size(); ++i) {
+        if (flagged(i) != pass_flagged) {
+          continue;
+        }
+        const auto& data = gpu_history_[i].series(metric.type);
+        for (size_t k = first + 1; k < data.size(); ++k) {
+          if (data[k - 1] >= 0 && data[k] >= 0) {
+            c.DrawPointLine(to_x(k - 1), to_y(data[k - 1]), to_x(k),
+                            to_y(data[k]), gpu_color(i));
+          }
+        }
+      }
+    }
+
+    int prev_median = -1;
+    for (size_t k = first; k < history; ++k) {
+      column_values_.clear();
+      for (const auto& gpu : gpu_history_) {
+        column_values_.push_back(gpu.series(metric.type)[k]);
+      }
+      int median = StragglerDetector::median_of(column_values_);
+      if (prev_median >= 0 && median >= 0) {
+        c.DrawPointLine(to_x(k - 1), to_y(prev_median), to_x(k), to_y(median),
+                        Color::White);
+      }
+      prev_median = median;
+    }
+  });
+
+  Elements legend = {
+      text(fmt::format("Median {}{}", detector.median(), metric.unit)) |
+          color(Color::White),
+      text(fmt::format("Mean off it, last {} samples:",
+                       StragglerDetector::WINDOW)) |
+          dim,
+  };
+  for (size_t i = 0; i < gpu_history_.size(); ++i) {
+    const auto& data = gpu_history_[i].series(metric.type);
+    std::string flag = detector.straggler(i)  ? " straggler"
+                       : detector.outlier(i) ? " outlier"
+                                              : "";
+    legend.push_back(
+        text(fmt::format("GPU {:<2} {:>5}{} {:+6.0f}{}", i,
+                         data.empty() ? -1 : data.back(), metric.unit,
+                         detector.mean_deviation(i), flag)) |
+        color(flagged(i) ? gpu_color(i) : Color::Default));
+  }
+  if (gpu_history_.size() < StragglerDetector::MIN_GPUS) {
+    legend.push_back(separator());
+    legend.push_back(text(fmt::format("Needs {}+ GPUs to flag",
+                                      StragglerDetector::MIN_GPUS)) |
+                     dim);
+  }
+
+  return hbox({
+             vbox({
+                 text(fmt::format("{} of all GPUs ('m' to change)",
+                                  metric.name)) |
+                     hcenter,
+                 plot | flex,
+             }) | flex,
+             separator(),
+             vbox(std::move(legend)),
+         }) |
+         flex;
 }
 
 Element GraphsTab::create_chart(
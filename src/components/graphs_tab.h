@@ -4,6 +4,7 @@
 #include <ftxui/component/component.hpp>
 
 #include "nvtuner.h"
+#include "straggler.h"
 
 class GraphsTab {
  public:
@@ -17,6 +18,7 @@ class GraphsTab {
     static const size_t MAX_HISTORY = 360;
 
     void add_sample(const GpuState& gs);
+    const std::deque<int>& series(const std::string& type) const;
     std::vector<int> get_normalized(const std::string& type, int width,
                                     int height) const;
     std::vector<int> get_normalized_util(int width, int height) const;
@@ -32,6 +34,13 @@ class GraphsTab {
 
   const std::vector<GpuState>& gpu_states_;
 
+  // The "All" entry after the GPUs overlays one metric of every GPU and
+  // flags those off the node median; 'm' cycles the metric.
+  int overlay_metric_ = 0;
+  std::vector<StragglerDetector> detectors_;  // one per overlay metric
+  std::vector<int> sample_values_;           // reused by update()
+  std::vector<int> column_values_;           // reused by render_overlay()
+
   ftxui::Component main_component_;
   ftxui::Component menu_component_;
   ftxui::Components subtab_components_;
@@ -47,4 +56,8 @@ class GraphsTab {
       const std::string& min_label,
       std::function<std::vector<int>(int, int)> data_func,
       ftxui::Color chart_color);
+  ftxui::Element render_overlay();
+  bool overlay_selected() const {
+    return selected_gpu_ == static_cast<int>(gpu_states_.size());
+  }
 };
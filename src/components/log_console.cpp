@@ -4,15 +4,27 @@ using namespace ftxui;
 
 Component LogConsole() {
   const int msg_count = 4;
-  return Renderer([msg_count] {
-    Elements lines;
-    auto log_messages = LogStreamBuffer::get_messages(msg_count);
-    int start_index = std::max(0, (int)log_messages.size() - msg_count);
-    for (int i = start_index; i < log_messages.size(); ++i) {
-      lines.push_back(text(log_messages[i]));
+
+  // Rebuilt only when new lines were logged.
+  struct Cache {
+    unsigned long long generation = 0;
+    std::vector<std::string> messages;
+    Element element;
+  };
+  auto cache = std::make_shared<Cache>();
+
+  return Renderer([msg_count, cache] {
+    if (LogWriter::get_messages(msg_count, cache->generation,
+                                cache->messages) ||
+        !cache->element) {
+      Elements lines;
+      for (const auto& message : cache->messages) {
+        lines.push_back(text(message));
+      }
+      cache->element = window(text("Log Console"),
+                              vbox(lines) | size(HEIGHT, GREATER_THAN, 4) |
+                                  size(HEIGHT, LESS_THAN, msg_count + 2));
     }
-    return window(text("Log Console"),
-                  vbox(lines) | size(HEIGHT, GREATER_THAN, 4) |
-                      size(HEIGHT, LESS_THAN, msg_count + 2));
+    return cache->element;
   });
 }
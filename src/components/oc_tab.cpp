@@ -2,12 +2,41 @@
 
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <iostream>
 
+#include "apply_daemon.h"
+#include "frame_profiler.h"
+
 using namespace ftxui;
 
+namespace {
+// Runs `after_event` once the child has handled an event.
+class AfterEvent : public ComponentBase {
+ public:
+  AfterEvent(Component child, std::function<void()> after_event)
+      : after_event_(std::move(after_event)) {
+    Add(std::move(child));
+  }
+
+  bool OnEvent(Event event) override {
+    bool handled = ComponentBase::OnEvent(event);
+    after_event_();
+    return handled;
+  }
+
+ private:
+  std::function<void()> after_event_;
+};
+}  // namespace
+
 OCTab::OCTab(ProfileManager& profile_manager, NvmlManager& nvml_manager)
     : pm_(profile_manager), nvml_(nvml_manager) {
+  saved_profiles_ = pm_.get_all_profiles();
+  if (SysUtils::is_elevated() || nvml_.is_simulated()) {
+    live_applier_ = std::make_unique<LiveApplier>(nvml_);
+  }
+
   setup_action_buttons();
   setup_oc_panels();
 
@@ -40,19 +69,18 @@ void OCTab::setup_action_buttons() {
       Button("Save and Apply All",
              [this] {
                pm_.save();
-               if (SysUtils::call_apply_profiles_as_root()) {
-                 std::clog << fmt::format("Profiles applied for {} GPUs.",
-                                          nvml_.get_gpus().size())
-                           << std::endl;
-               } else {
-                 std::cerr << "Failed to apply profiles. No Permissions?"
-                           << std::endl;
+               saved_profiles_ = pm_.get_all_profiles();
+               if (live_applier_) {
+                 live_applier_->mark_saved();
                }
-               //  nvml_.apply_profiles(pm_.get_all_profiles());
+               apply_saved_profiles();
              }),
+#ifndef _WIN32
+      Checkbox("Resident helper", &resident_helper_),
+#endif
       Button("Register Service",
              [this] {
-               if (SysUtils::register_startup_task()) {
+               if (SysUtils::register_startup_task(resident_helper_)) {
                  std::clog << REGISTER_SUCCESSFUL << std::endl;
                } else {
                  std::cerr << REGISTER_FAILED << std::endl;
@@ -67,12 +95,72 @@ void OCTab::setup_action_buttons() {
                }
              }),
   });
+
+  if (live_applier_) {
+    CheckboxOption live_option = CheckboxOption::Simple();
+    live_option.on_change = [this] {
+      if (live_preview_) {
+        std::clog << "Live preview on: slider changes are applied right away "
+                     "and reverted on exit unless saved."
+                  << std::endl;
+      } else {
+        revert_live_changes();
+      }
+    };
+    action_buttons_->Add(
+        Checkbox("Live preview", &live_preview_, std::move(live_option)));
+  }
+}
+
+void OCTab::revert_live_changes() {
+  if (live_applier_) {
+    live_applier_->revert(saved_profiles_);
+  }
+}
+
+void OCTab::apply_saved_profiles() {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<ApplyResult> results;
+  auto status =
+      ApplyDaemon::request_apply(SysUtils::get_user_name(), results);
+
+  if (status == ApplyDaemon::RequestStatus::Unavailable) {
+    if (SysUtils::call_apply_profiles_as_root()) {
+      std::clog << fmt::format("Profiles applied for {} GPUs.",
+                               nvml_.get_gpus().size())
+                << std::endl;
+    } else {
+      std::cerr << "Failed to apply profiles. No Permissions?" << std::endl;
+    }
+    return;
+  }
+
+  for (const auto& r : results) {
+    (r.success ? std::clog : std::cerr)
+        << fmt::format("GPU {}: {} ({} writes, {:.1f}ms).", r.index,
+                       r.success ? "applied" : "failed", r.writes,
+                       r.duration.count() / 1000.0)
+        << std::endl;
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  if (status == ApplyDaemon::RequestStatus::Applied) {
+    std::clog << fmt::format(
+                     "Profiles applied for {} GPUs by the resident helper in "
+                     "{:.1f}ms.",
+                     results.size(), ms)
+              << std::endl;
+  } else {
+    std::cerr << "The resident helper failed to apply profiles." << std::endl;
+  }
 }
 
 void OCTab::setup_oc_panels() {
   oc_panels_.clear();
   for (size_t i = 0; i < nvml_.get_gpus().size(); ++i) {
-    oc_panels_.push_back(create_gpu_panel(i));
+    oc_panels_.push_back(FrameProfiler::Profiled(
+        fmt::format("OC/GPU {}", i), create_gpu_panel(i)));
   }
 }
 
@@ -94,26 +182,175 @@ Component OCTab::create_gpu_panel(size_t gpu_index) {
       Slider("", &profile.max_gpu_clock, &MAX_CLOCK_MIN_MHZ,
              &gs.gpu_max_clock_mhz, &CLOCK_STEP);
 
-  auto oc_panel_component = Container::Vertical({
-      power_limit_slider,
-      gpu_clock_offset_slider,
-      gpu_max_clock_slider,
-  });
+  // Like the memory locks below, the floor picks an index into the
+  // supported clocks.
+  const auto& gpu_clocks = gs.gpu_clocks_mhz;
+  bool min_clock_supported = !gpu_clocks.empty();
+  auto min_clock_index = std::make_shared<int>(0);
+  if (min_clock_supported) {
+    auto it = std::lower_bound(gpu_clocks.begin(), gpu_clocks.end(),
+                               profile.min_gpu_clock);
+    *min_clock_index = static_cast<int>(
+        std::min<size_t>(it - gpu_clocks.begin(), gpu_clocks.size() - 1));
+  }
+  auto gpu_min_clock_slider =
+      Slider("", min_clock_index.get(), 0,
+             std::max<int>(gpu_clocks.size(), 1) - 1, 1);
+  auto latency_mode_checkbox = Checkbox("Latency mode", &profile.latency_mode);
+  auto gpu_min_clock_row = Renderer(
+      Container::Horizontal({latency_mode_checkbox, gpu_min_clock_slider}),
+      [&profile, min_clock_supported, latency_mode_checkbox,
+       gpu_min_clock_slider] {
+        Element slider = gpu_min_clock_slider->Render() | flex;
+        return hbox({
+            min_clock_supported ? latency_mode_checkbox->Render()
+                                : (latency_mode_checkbox->Render() | dim),
+            text(" "),
+            profile.latency_mode ? slider : (slider | dim),
+        });
+      });
 
-  return Renderer(oc_panel_component, [this, pl_supported, gpu_index, &gs,
-                                       &profile, power_limit_slider,
-                                       gpu_clock_offset_slider,
-                                       gpu_max_clock_slider] {
+  auto persistence_checkbox = Checkbox("Enable", &profile.persistence_mode);
+
+  bool mem_offset_supported =
+      gs.mem_clock_offset_min_mhz != gs.mem_clock_offset_max_mhz;
+  auto mem_clock_offset_slider =
+      Slider("", &profile.mem_clock_offset, &gs.mem_clock_offset_min_mhz,
+             &gs.mem_clock_offset_max_mhz, &MEM_CLOCK_STEP);
+
+  // Memory clocks can only be locked to supported values, which are far
+  // apart, so those sliders pick an index into the supported list.
+  const auto& mem_clocks = gs.mem_clocks_mhz;
+  bool mem_lock_supported = !mem_clocks.empty();
+  auto mem_clock_index = [&mem_clocks](int clock_mhz) {
+    auto it = std::lower_bound(mem_clocks.begin(), mem_clocks.end(), clock_mhz);
+    return static_cast<int>(
+        std::min<size_t>(it - mem_clocks.begin(), mem_clocks.size() - 1));
+  };
+  auto mem_lock = std::make_shared<std::pair<int, int>>(0, 0);
+  if (mem_lock_supported) {
+    *mem_lock = {mem_clock_index(profile.min_mem_clock),
+                 mem_clock_index(profile.max_mem_clock)};
+  }
+  int mem_clock_last_index = std::max<int>(mem_clocks.size(), 1) - 1;
+  auto min_mem_clock_slider =
+      Slider("", &mem_lock->first, 0, mem_clock_last_index, 1);
+  auto max_mem_clock_slider =
+      Slider("", &mem_lock->second, 0, mem_clock_last_index, 1);
+
+  // Intermediate P-states: one row each, graphics offset on the left and
+  // memory offset on the right if the driver lets both move.
+  struct PstateRow {
+    int pstate;
+    Component component;
+  };
+  std::vector<PstateRow> pstate_rows;
+  for (const auto& range : gs.pstate_offset_ranges) {
+    PstateClockOffset& offset = profile.pstate_clock_offsets[range.pstate];
+    Components sliders;
+    if (range.gpu_min_mhz != range.gpu_max_mhz) {
+      sliders.push_back(Slider("", &offset.gpu, &range.gpu_min_mhz,
+                               &range.gpu_max_mhz, &CLOCK_STEP));
+    }
+    if (range.mem_min_mhz != range.mem_max_mhz) {
+      sliders.push_back(Slider("", &offset.mem, &range.mem_min_mhz,
+                               &range.mem_max_mhz, &MEM_CLOCK_STEP));
+    }
+    auto row = Container::Horizontal(sliders);
+    pstate_rows.push_back(
+        {range.pstate, Renderer(row, [sliders] {
+           Elements elements;
+           for (const auto& slider : sliders) {
+             if (!elements.empty()) {
+               elements.push_back(text(" "));
+             }
+             elements.push_back(slider->Render() | flex);
+           }
+           return hbox(elements);
+         })});
+  }
+
+  Components oc_panel_children = {
+      power_limit_slider,      gpu_clock_offset_slider, gpu_max_clock_slider,
+      gpu_min_clock_row,       mem_clock_offset_slider, min_mem_clock_slider,
+      max_mem_clock_slider,
+  };
+#ifndef _WIN32
+  oc_panel_children.push_back(persistence_checkbox);
+#endif
+  for (const auto& row : pstate_rows) {
+    oc_panel_children.push_back(row.component);
+  }
+  auto oc_panel_component = Container::Vertical(oc_panel_children);
+
+  auto panel = Renderer(oc_panel_component, [this, pl_supported,
+                                             mem_offset_supported,
+                                             mem_lock_supported, gpu_index,
+                                             &gs, &profile, power_limit_slider,
+                                             gpu_clock_offset_slider,
+                                             gpu_max_clock_slider,
+                                             min_clock_supported,
+                                             gpu_min_clock_row,
+                                             persistence_checkbox,
+                                             mem_clock_offset_slider,
+                                             min_mem_clock_slider,
+                                             max_mem_clock_slider,
+                                             pstate_rows] {
+    std::string extra_text;
+    if (profile.mem_clock_offset != 0) {
+      extra_text += fmt::format(", mem {:+}MHz", profile.mem_clock_offset);
+    }
+    if (!mem_clocks_unlocked(gs, profile)) {
+      extra_text += fmt::format(", mem {}-{}MHz", profile.min_mem_clock,
+                                profile.max_mem_clock);
+    }
+    auto mem_clock_text = [mem_lock_supported](int clock_mhz) {
+      return mem_lock_supported ? fmt::format("{}MHz", clock_mhz)
+                                : std::string("Unsupported");
+    };
+    Elements pstate_elements;
+    for (const auto& row : pstate_rows) {
+      PstateClockOffset offset = pstate_clock_offset(profile, row.pstate);
+      pstate_elements.push_back(create_slider_row(
+          fmt::format("P{} Offset", row.pstate),
+          fmt::format("{:+}/{:+}MHz", offset.gpu, offset.mem), row.component));
+      if (offset != PstateClockOffset{}) {
+        extra_text += fmt::format(", P{} {:+}/{:+}MHz", row.pstate,
+                                  offset.gpu, offset.mem);
+      }
+    }
+    std::string clock_text =
+        profile.latency_mode ? fmt::format("{}-{}MHz", profile.min_gpu_clock,
+                                           profile.max_gpu_clock)
+                             : fmt::format("<={}MHz", profile.max_gpu_clock);
+    std::string min_clock_text = "Unsupported";
+    if (min_clock_supported) {
+      min_clock_text = profile.latency_mode
+                           ? fmt::format("{}MHz", profile.min_gpu_clock)
+                           : "Off";
+    }
+    // Recorded by the resident helper's OC watchdog.
+    Element rollback_note = emptyElement();
+    if (auto unstable = pm_.get_unstable(gs.uuid)) {
+      rollback_note =
+          text(fmt::format("Rolled back {}{} at {}: {:+}MHz offset, {}",
+                           unstable->preset.empty() ? "" : "preset ",
+                           unstable->preset, unstable->time,
+                           unstable->profile.gpu_clock_offset,
+                           unstable->reason)) |
+          color(Color::Red);
+    }
     return vbox({
         hbox({
             text(fmt::format("GPU {}: {} ", gs.index, gs.name)) | bold,
             separatorCharacter("|"),
             text(fmt::format(
-                " OC ({}{:+}MHz, <={}MHz)",
+                " OC ({}{:+}MHz, {}{})",
                 pl_supported ? fmt::format("{}W, ", profile.power_limit) : "",
-                profile.gpu_clock_offset, profile.max_gpu_clock)) |
+                profile.gpu_clock_offset, clock_text, extra_text)) |
                 dim,
         }),
+        rollback_note,
         create_slider_row(
             "Power Limit",
             pl_supported ? fmt::format("{}W", profile.power_limit)
@@ -125,8 +362,75 @@ Component OCTab::create_gpu_panel(size_t gpu_index) {
         create_slider_row("GPU Max Clock",
                           fmt::format("{}MHz", profile.max_gpu_clock),
                           gpu_max_clock_slider),
+        create_slider_row("GPU Min Clock", min_clock_text, gpu_min_clock_row),
+        create_slider_row(
+            "Mem Clock Offset",
+            mem_offset_supported
+                ? fmt::format("{:+}MHz", profile.mem_clock_offset)
+                : "Unsupported",
+            mem_offset_supported ? mem_clock_offset_slider
+                                 : (mem_clock_offset_slider | dim)),
+        create_slider_row(
+            "Mem Min Clock", mem_clock_text(profile.min_mem_clock),
+            mem_lock_supported ? min_mem_clock_slider
+                               : (min_mem_clock_slider | dim)),
+        create_slider_row(
+            "Mem Max Clock", mem_clock_text(profile.max_mem_clock),
+            mem_lock_supported ? max_mem_clock_slider
+                               : (max_mem_clock_slider | dim)),
+        vbox(pstate_elements),
+#ifndef _WIN32
+        create_slider_row("Persistence Mode",
+                          gs.persistence_mode < 0 ? "N/A"
+                          : gs.persistence_mode   ? "On"
+                                                  : "Off",
+                          persistence_checkbox),
+#endif
     });
   });
+
+  // Sliders edit the profile in place (memory locks through their index);
+  // after each event, queue it for the hardware if live preview is on and it
+  // changed.
+  auto last_submitted = std::make_shared<OcProfile>(profile);
+  return Make<AfterEvent>(panel, [this, gpu_index, &gs, &profile, mem_lock,
+                                  min_clock_index, last_submitted] {
+    if (gs.gpu_clocks_mhz.empty()) {
+      profile.latency_mode = false;
+    } else {
+      // The floor stays at or below the cap: raising the floor past it
+      // raises the cap, lowering the cap past it lowers the floor.
+      const auto& clocks = gs.gpu_clocks_mhz;
+      int& index = *min_clock_index;
+      if (clocks[index] > profile.max_gpu_clock) {
+        if (profile.min_gpu_clock != clocks[index]) {
+          profile.max_gpu_clock = clocks[index];
+        } else {
+          while (index > 0 && clocks[index] > profile.max_gpu_clock) {
+            --index;
+          }
+        }
+      }
+      profile.min_gpu_clock = clocks[index];
+    }
+    if (!gs.mem_clocks_mhz.empty()) {
+      // Moving one end past the other drags it along.
+      auto& [min_index, max_index] = *mem_lock;
+      if (min_index > max_index) {
+        if (profile.min_mem_clock != gs.mem_clocks_mhz[min_index]) {
+          max_index = min_index;
+        } else {
+          min_index = max_index;
+        }
+      }
+      profile.min_mem_clock = gs.mem_clocks_mhz[min_index];
+      profile.max_mem_clock = gs.mem_clocks_mhz[max_index];
+    }
+    if (live_preview_ && profile != *last_submitted) {
+      *last_submitted = profile;
+      live_applier_->submit(gpu_index, profile);
+    }
+  });
 }
 
 Element OCTab::create_slider_row(const std::string& label,
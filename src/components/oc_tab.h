@@ -1,6 +1,7 @@
 #pragma once
 #include <ftxui/component/component.hpp>
 
+#include "live_applier.h"
 #include "nvtuner.h"
 
 class OCTab {
@@ -9,11 +10,18 @@ class OCTab {
   NvmlManager& nvml_;
 
   ftxui::Component action_buttons_;
+  bool resident_helper_ = false;  // register `nvtuner --daemon` (Linux)
+
+  // Live preview: only when NVML setters work in this process.
+  std::unique_ptr<LiveApplier> live_applier_;
+  bool live_preview_ = false;
+  std::map<std::string, OcProfile> saved_profiles_;  // what to revert to
   std::vector<ftxui::Component> oc_panels_;
   ftxui::Component main_component_;
 
   static inline const int POWER_STEP = 1;
   static inline const int CLOCK_STEP = 15;
+  static inline const int MEM_CLOCK_STEP = 50;
   static inline const int MAX_CLOCK_MIN_MHZ = 210;
   static inline const int OC_SLIDER_TAG_WIDTH = 30;
 #ifdef _WIN32
@@ -41,8 +49,15 @@ class OCTab {
 
   ftxui::Component get_component();
 
+  /**
+   * @brief Restore the saved profiles on GPUs changed by live preview since
+   * the last save. Call before exiting.
+   */
+  void revert_live_changes();
+
  private:
   void setup_action_buttons();
+  void apply_saved_profiles();
   void setup_oc_panels();
   ftxui::Component create_gpu_panel(size_t gpu_index);
   ftxui::Element create_slider_row(const std::string& label,
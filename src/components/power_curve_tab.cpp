@@ -0,0 +1,184 @@
+#include "power_curve_tab.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+
+#include "frame_profiler.h"
+
+using namespace ftxui;
+
+namespace {
+// Plot height for GPUs without a power limit range.
+const int FALLBACK_MAX_POWER_W = 600;
+
+int plot_max_power(const GpuState& gs) {
+  return gs.power_limit_max_w > 0 ? gs.power_limit_max_w
+                                  : FALLBACK_MAX_POWER_W;
+}
+
+Color density_color(unsigned int count) {
+  if (count >= 10) return Color::White;
+  if (count >= 3) return Color::GrayLight;
+  return Color::GrayDark;
+}
+}  // namespace
+
+PowerCurveTab::PowerCurveTab(const std::vector<GpuState>& gpu_states,
+                             const ProfileManager& pm)
+    : gpu_states_(gpu_states), pm_(pm) {
+  for (const auto& gs : gpu_states_) {
+    curves_.emplace_back(gs.gpu_max_clock_mhz, plot_max_power(gs));
+    menu_entries_.push_back(std::to_string(gs.index));
+  }
+
+  auto menu = Menu(&menu_entries_, &selected_gpu_);
+  Components gpu_components;
+  for (size_t i = 0; i < gpu_states_.size(); ++i) {
+    gpu_components.push_back(FrameProfiler::Profiled(
+        fmt::format("Power Curve/GPU {}", i),
+        Renderer([this, i] { return render_gpu(i); })));
+  }
+  auto gpus_container = Container::Tab(gpu_components, &selected_gpu_);
+  main_component_ = Renderer(menu, [this, menu, gpus_container] {
+    return hbox({
+        vbox({
+            text(fmt::format("GPU {}", selected_gpu_)),
+            separator(),
+            menu->Render(),
+        }),
+        separator(),
+        gpus_container->Render() | flex,
+    });
+  });
+}
+
+void PowerCurveTab::update() {
+  for (size_t i = 0; i < gpu_states_.size() && i < curves_.size(); ++i) {
+    curves_[i].add_sample(gpu_states_[i]);
+  }
+}
+
+Element PowerCurveTab::render_gpu(size_t gpu_index) {
+  const GpuState& gs = gpu_states_[gpu_index];
+  const OcProfile& profile = pm_.get_profile(gs.uuid);
+  ClockPowerCurve& curve = curves_[gpu_index];
+  const ClockPowerCurve::Fit& fit = curve.fit();
+
+  int max_clock = std::max(gs.gpu_max_clock_mhz, 1);
+  int max_power = plot_max_power(gs);
+  bool pl_supported = gs.power_limit_w != -1;
+
+  auto plot = canvas([&gs, &profile, &curve, &fit, max_clock, max_power,
+                      pl_supported](Canvas& c) {
+    int w = c.width() - 1;
+    int h = c.height() - 1;
+    auto to_x = [&](double clock) {
+      return std::clamp(static_cast<int>(clock * w / max_clock), 0, w);
+    };
+    auto to_y = [&](double power) {
+      return std::clamp(h - static_cast<int>(power * h / max_power), 0, h);
+    };
+
+    for (int cb = 0; cb < curve.clock_bins(); ++cb) {
+      for (int pb = 0; pb < curve.power_bins(); ++pb) {
+        unsigned int n = curve.count(cb, pb);
+        if (n > 0) {
+          c.DrawPoint(to_x((cb + 0.5) * ClockPowerCurve::CLOCK_BIN_MHZ),
+                      to_y((pb + 0.5) * ClockPowerCurve::POWER_BIN_W), true,
+                      density_color(n));
+        }
+      }
+    }
+
+    // Limits of the current profile.
+    c.DrawPointLine(to_x(profile.max_gpu_clock), 0,
+                    to_x(profile.max_gpu_clock), h, Color::Red);
+    if (pl_supported) {
+      c.DrawPointLine(0, to_y(profile.power_limit), w,
+                      to_y(profile.power_limit), Color::Red);
+    }
+
+    if (fit.valid) {
+      int prev_x = to_x(fit.min_clock_mhz);
+      int prev_y = to_y(fit.power_at(fit.min_clock_mhz));
+      const int step = ClockPowerCurve::CLOCK_BIN_MHZ;
+      for (int clock = fit.min_clock_mhz + step; clock <= fit.max_clock_mhz;
+           clock += step) {
+        int x = to_x(clock);
+        int y = to_y(fit.power_at(clock));
+        c.DrawPointLine(prev_x, prev_y, x, y, Color::Yellow);
+        prev_x = x;
+        prev_y = y;
+      }
+      int best = fit.best_perf_per_watt_clock_mhz;
+      c.DrawPointCircle(to_x(best), to_y(fit.power_at(best)), 2,
+                        Color::Cyan);
+    }
+
+    if (gs.gpu_clock_mhz > 0 && gs.power_usage_w >= 0) {
+      c.DrawPointCircleFilled(to_x(gs.gpu_clock_mhz), to_y(gs.power_usage_w),
+                              1, Color::GreenLight);
+    }
+  });
+
+  Elements info = {
+      text(fmt::format("Samples under load: {}", curve.sample_count())),
+      text(fmt::format("  (util >= {}%)",
+                       ClockPowerCurve::MIN_UTIL_PERCENT)) |
+          dim,
+      separator(),
+      text(fmt::format("Now: {}MHz, {}W", gs.gpu_clock_mhz,
+                       gs.power_usage_w)) |
+          color(Color::GreenLight),
+  };
+  if (fit.valid) {
+    int clock = std::clamp(gs.gpu_clock_mhz, fit.min_clock_mhz,
+                           fit.max_clock_mhz);
+    info.push_back(text(fmt::format(
+        "+{}MHz costs {:.1f}W", ClockPowerCurve::CLOCK_BIN_MHZ,
+        fit.slope_at(clock) * ClockPowerCurve::CLOCK_BIN_MHZ)));
+    int best = fit.best_perf_per_watt_clock_mhz;
+    info.push_back(text(fmt::format("Best perf/W: {}MHz, {:.0f}W", best,
+                                    fit.power_at(best))) |
+                   color(Color::Cyan));
+    info.push_back(text(fmt::format("Fit: {}-{}MHz", fit.min_clock_mhz,
+                                    fit.max_clock_mhz)) |
+                   color(Color::Yellow));
+  } else {
+    info.push_back(text("Fit: needs load at a few") | dim);
+    info.push_back(text(fmt::format("  more clocks ({} bins)",
+                                    ClockPowerCurve::MIN_FIT_BINS)) |
+                   dim);
+  }
+  info.push_back(
+      text(pl_supported ? fmt::format("Profile: <={}MHz, {}W",
+                                      profile.max_gpu_clock,
+                                      profile.power_limit)
+                        : fmt::format("Profile: <={}MHz",
+                                      profile.max_gpu_clock)) |
+      color(Color::Red));
+
+  return hbox({
+             vbox({
+                 text(fmt::format("GPU {}: Clock vs Power", gs.index)) |
+                     hcenter,
+                 hbox({
+                     vbox({
+                         text(fmt::format("{}W", max_power)),
+                         filler(),
+                         text("0W"),
+                     }),
+                     plot | flex,
+                 }) | flex,
+                 hbox({
+                     text("0MHz"),
+                     filler(),
+                     text(fmt::format("{}MHz", max_clock)),
+                 }),
+             }) | flex,
+             separator(),
+             vbox(std::move(info)),
+         }) |
+         flex;
+}
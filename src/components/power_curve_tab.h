@@ -0,0 +1,31 @@
+#pragma once
+
+#include <ftxui/component/component.hpp>
+
+#include "clock_power_curve.h"
+#include "nvtuner.h"
+
+// Clock vs power of each GPU under load, as measured: the binned samples,
+// the fitted curve, the live operating point and the limits of the current
+// profile, plus what the next clock step costs and where perf/W peaks.
+class PowerCurveTab {
+ public:
+  PowerCurveTab(const std::vector<GpuState>& gpu_states,
+                const ProfileManager& pm);
+  /**
+   * @brief Call with freshly sampled dynamic state.
+   */
+  void update();
+  ftxui::Component get_component() { return main_component_; }
+
+ private:
+  ftxui::Element render_gpu(size_t gpu_index);
+
+  const std::vector<GpuState>& gpu_states_;
+  const ProfileManager& pm_;
+  std::vector<ClockPowerCurve> curves_;
+
+  int selected_gpu_ = 0;
+  std::vector<std::string> menu_entries_;
+  ftxui::Component main_component_;
+};
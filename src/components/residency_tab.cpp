@@ -0,0 +1,161 @@
+#include "residency_tab.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "frame_profiler.h"
+
+using namespace ftxui;
+
+namespace {
+// A stall of the UI thread must not count as time in the current bins.
+const double MAX_DT_S = 5.0;
+// Clock and temperature bars run from the first to the last bin with at
+// least this share, so stray samples do not stretch the chart.
+const double MIN_SHOWN_FRACTION = 0.005;
+
+struct Bar {
+  std::string label;
+  double seconds;
+};
+
+template <size_t N>
+std::vector<Bar> binned_bars(const std::array<double, N>& seconds, int bin) {
+  double total = std::accumulate(seconds.begin(), seconds.end(), 0.0);
+  std::vector<Bar> bars;
+  if (total <= 0) {
+    return bars;
+  }
+  auto shown = [&](double s) { return s >= total * MIN_SHOWN_FRACTION; };
+  auto first = std::find_if(seconds.begin(), seconds.end(), shown);
+  auto last = std::find_if(seconds.rbegin(), seconds.rend(), shown);
+  for (size_t i = first - seconds.begin(); i < N - (last - seconds.rbegin());
+       ++i) {
+    int lo = static_cast<int>(i) * bin;
+    bars.push_back({i + 1 == N ? fmt::format("{}+", lo)
+                               : fmt::format("{}-{}", lo, lo + bin - 1),
+                    seconds[i]});
+  }
+  return bars;
+}
+
+std::string format_duration(double seconds) {
+  int s = static_cast<int>(seconds);
+  return s >= 3600 ? fmt::format("{}h{:02}m", s / 3600, s % 3600 / 60)
+                   : fmt::format("{}m{:02}s", s / 60, s % 60);
+}
+
+Element bar_chart(const std::string& title, const std::vector<Bar>& bars,
+                  Color bar_color) {
+  if (bars.empty()) {
+    return window(text(title), text("No samples") | dim) | flex;
+  }
+  double total = 0;
+  size_t label_width = 0;
+  for (const auto& bar : bars) {
+    total += bar.seconds;
+    label_width = std::max(label_width, bar.label.size());
+  }
+  Elements rows;
+  for (const auto& bar : bars) {
+    double fraction = bar.seconds / total;
+    rows.push_back(hbox({
+        text(bar.label) | size(WIDTH, EQUAL, static_cast<int>(label_width)),
+        text(" "),
+        gauge(static_cast<float>(fraction)) | color(bar_color) | flex,
+        text(fmt::format("{:6.1f}%", fraction * 100)),
+    }));
+  }
+  return window(text(title), vbox(std::move(rows))) | flex;
+}
+}  // namespace
+
+ResidencyTab::ResidencyTab(const std::vector<GpuState>& gpu_states)
+    : gpu_states_(gpu_states),
+      residencies_(gpu_states.size()),
+      last_update_(std::chrono::steady_clock::now()) {
+  for (const auto& gs : gpu_states_) {
+    menu_entries_.push_back(std::to_string(gs.index));
+  }
+
+  auto menu = Menu(&menu_entries_, &selected_gpu_);
+  Components gpu_components;
+  for (size_t i = 0; i < gpu_states_.size(); ++i) {
+    gpu_components.push_back(FrameProfiler::Profiled(
+        fmt::format("Residency/GPU {}", i),
+        Renderer([this, i] { return render_gpu(i); })));
+  }
+  auto gpus_container = Container::Tab(gpu_components, &selected_gpu_);
+  auto renderer = Renderer(menu, [this, menu, gpus_container] {
+    return hbox({
+        vbox({
+            text(fmt::format("GPU {}", selected_gpu_)),
+            separator(),
+            menu->Render(),
+        }),
+        separator(),
+        gpus_container->Render() | flex,
+    });
+  });
+  main_component_ = CatchEvent(renderer, [this](Event event) {
+    if (event == Event::Character('r')) {
+      reset();
+      return true;
+    }
+    return false;
+  });
+}
+
+void ResidencyTab::update() {
+  auto now = std::chrono::steady_clock::now();
+  double dt_s = std::min(
+      std::chrono::duration<double>(now - last_update_).count(), MAX_DT_S);
+  last_update_ = now;
+  for (size_t i = 0; i < gpu_states_.size() && i < residencies_.size(); ++i) {
+    residencies_[i].add_sample(gpu_states_[i], dt_s);
+  }
+}
+
+void ResidencyTab::reset() {
+  for (auto& residency : residencies_) {
+    residency.reset();
+  }
+}
+
+Element ResidencyTab::render_gpu(size_t gpu_index) {
+  const GpuState& gs = gpu_states_[gpu_index];
+  const Residency& residency = residencies_[gpu_index];
+
+  std::vector<Bar> pstate_bars;
+  for (int p = 0; p < Residency::PSTATES; ++p) {
+    if (residency.pstate_seconds()[p] > 0) {
+      pstate_bars.push_back(
+          {fmt::format("P{}", p), residency.pstate_seconds()[p]});
+    }
+  }
+
+  return vbox({
+             hbox({
+                 text(fmt::format("GPU {}: {}", gs.index, gs.name)) | bold,
+                 filler(),
+                 text(fmt::format("{} since reset ('r' resets all GPUs)",
+                                  format_duration(residency.total_seconds()))) |
+                     dim,
+             }),
+             hbox({
+                 bar_chart("Clock [MHz]",
+                           binned_bars(residency.clock_seconds(),
+                                       Residency::CLOCK_BIN_MHZ),
+                           Color::GreenLight),
+                 bar_chart("P-state", pstate_bars, Color::Cyan),
+                 bar_chart("Temp. [C]",
+                           binned_bars(residency.temp_seconds(),
+                                       Residency::TEMP_BIN_C),
+                           Color::Yellow),
+             }) | flex,
+         }) |
+         flex;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <ftxui/component/component.hpp>
+
+#include "nvtuner.h"
+#include "residency.h"
+
+// Where each GPU spends its time: residency in graphics clock bins,
+// P-states and temperature bins since the last reset, as horizontal bars.
+// Reset with 'r', e.g. after applying an undervolt and before starting a
+// sustained load, to check that it holds the target clock.
+class ResidencyTab {
+ public:
+  explicit ResidencyTab(const std::vector<GpuState>& gpu_states);
+  /**
+   * @brief Call with freshly sampled dynamic state.
+   */
+  void update();
+  ftxui::Component get_component() { return main_component_; }
+
+ private:
+  ftxui::Element render_gpu(size_t gpu_index);
+  void reset();
+
+  const std::vector<GpuState>& gpu_states_;
+  std::vector<Residency> residencies_;
+  std::chrono::steady_clock::time_point last_update_;
+
+  int selected_gpu_ = 0;
+  std::vector<std::string> menu_entries_;
+  ftxui::Component main_component_;
+};
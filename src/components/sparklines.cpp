@@ -3,10 +3,14 @@
 #include <fmt/core.h>
 
 #include <algorithm>
+#include <array>
+#include <iterator>
 #include <numeric>
+#include <string_view>
+
+#include "frame_profiler.h"
 
 using namespace ftxui;
-using namespace fmt;
 
 void GpuStateSamples::add_sample(const GpuState& gs) {
   util.push_back(gs.gpu_util_percent);
@@ -23,9 +27,12 @@ void GpuStateSamples::add_sample(const GpuState& gs) {
 }
 
 Sparklines::Sparklines(const std::vector<GpuState>& gpu_states)
-    : gpu_states_(gpu_states), samples_(gpu_states.size()) {
+    : gpu_states_(gpu_states),
+      samples_(gpu_states.size()),
+      window_caches_(gpu_states.size()) {
   for (size_t i = 0; i < gpu_states.size(); i++) {
-    sparkline_windows_.push_back(create_window(i));
+    sparkline_windows_.push_back(FrameProfiler::Profiled(
+        fmt::format("Sparklines/GPU {}", i), create_window(i)));
   }
 
   main_component_ = Container::Vertical(sparkline_windows_);
@@ -35,88 +42,114 @@ void Sparklines::update() {
   for (size_t i = 0; i < gpu_states_.size(); i++) {
     samples_[i].add_sample(gpu_states_[i]);
   }
+  generation_++;
 }
 
-std::string Sparklines::get_sparkline_string(const std::deque<int>& data,
-                                             int min_val, int max_val) {
-  // static const std::vector<std::string> BLOCK_ELEMS = {" ", "▁", "▂", "▃",
-  // "▄", "▅", "▆", "▇", "█"};
-  static const std::vector<std::string> BLOCK_ELEMS = {"▁", "▂", "▃", "▄",
-                                                       "▅", "▆", "▇"};
-  std::string result = "";
+void Sparklines::format_sparkline(const std::deque<int>& data, int min_val,
+                                  int max_val, std::string& out) {
+  // static constexpr std::array<std::string_view, 9> BLOCK_ELEMS = {
+  //     " ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+  static constexpr std::array<std::string_view, 7> BLOCK_ELEMS = {
+      "▁", "▂", "▃", "▄", "▅", "▆", "▇"};
+  out.clear();
   for (auto& v : data) {
     double normalized_value = (v - min_val) * 1.0 / (max_val - min_val);
     normalized_value = std::clamp(normalized_value, 0.0, 1.0);
 
-    result += BLOCK_ELEMS[int(normalized_value * (BLOCK_ELEMS.size() - 0.01))];
+    out += BLOCK_ELEMS[int(normalized_value * (BLOCK_ELEMS.size() - 0.01))];
   }
+}
+
+void Sparklines::rebuild_window_cache(size_t gpu_index) {
+  const auto& gs = gpu_states_[gpu_index];
+  const auto& sample = samples_[gpu_index];
+  WindowCache& cache = window_caches_[gpu_index];
+
+  auto text_sparkline = [this](const std::deque<int>& data, int min_val,
+                               int max_val) {
+    format_sparkline(data, min_val, max_val, buffer_);
+    return text(buffer_);
+  };
+  auto text_int = [this](long long value) {
+    buffer_.clear();
+    fmt::format_to(std::back_inserter(buffer_), "{}", value);
+    return text(buffer_);
+  };
+  auto dq_max = [](const std::deque<int>& dq) {
+    return *std::max_element(dq.begin(), dq.end());
+  };
+  auto dq_avg = [](const std::deque<int>& dq) {
+    return std::accumulate(dq.begin(), dq.end(), 0) / (long long)dq.size();
+  };
 
-  return result;
+  cache.generation = generation_;
+  if (gs.seconds_to_slowdown >= 0) {
+    cache.title = hbox({
+        text(fmt::format("GPU {}: {} ", gs.index, gs.name)),
+        text(gs.seconds_to_slowdown == 0
+                 ? fmt::format("(at slowdown, {}C)", gs.slowdown_temp_c)
+                 : fmt::format("(slowdown at {}C in ~{}s)", gs.slowdown_temp_c,
+                               gs.seconds_to_slowdown)) |
+            color(Color::Yellow),
+    });
+  } else {
+    cache.title = text(fmt::format("GPU {}: {}", gs.index, gs.name));
+  }
+  cache.body = hbox({
+      vbox({
+          text("Metric"),
+          separator(),
+          text("Util.   [%]"),
+          text("Clock [MHz]"),
+          text("Temp.   [C]"),
+          text("Power   [W]"),
+      }),
+      separator(),
+      vbox({
+          text("Sparkline (60s)") |
+              size(WIDTH, EQUAL, GpuStateSamples::MAX_SAMPLES),
+          separator(),
+          text_sparkline(sample.util, 0, 100),
+          text_sparkline(sample.gpu_clock, 0, gs.gpu_max_clock_mhz),
+          text_sparkline(sample.temp, 0, 100),
+          text_sparkline(sample.power, 0, 100),
+      }),
+      separator(),
+      vbox({
+          text("Now "),
+          separator(),
+          text_int(sample.util.back()),
+          text_int(sample.gpu_clock.back()),
+          text_int(sample.temp.back()),
+          text_int(sample.power.back()),
+      }),
+      separator(),
+      vbox({
+          text("Max "),
+          separator(),
+          text_int(dq_max(sample.util)),
+          text_int(dq_max(sample.gpu_clock)),
+          text_int(dq_max(sample.temp)),
+          text_int(dq_max(sample.power)),
+      }),
+      separator(),
+      vbox({
+          text("Avg "),
+          separator(),
+          text_int(dq_avg(sample.util)),
+          text_int(dq_avg(sample.gpu_clock)),
+          text_int(dq_avg(sample.temp)),
+          text_int(dq_avg(sample.power)),
+      }) | flex,
+  });
 }
 
 Component Sparklines::create_window(size_t gpu_index) {
   return Renderer([this, gpu_index](bool focused) {
-    const auto& gs = gpu_states_[gpu_index];
-    const auto& sample = samples_[gpu_index];
-
-    auto text_sparkline = [](const std::deque<int>& data, int min_val,
-                             int max_val) {
-      return text(get_sparkline_string(data, min_val, max_val));
-    };
-    auto dq_max = [](const std::deque<int>& dq) {
-      return *std::max_element(dq.begin(), dq.end());
-    };
-    auto dq_avg = [](const std::deque<int>& dq) {
-      return std::accumulate(dq.begin(), dq.end(), 0) / dq.size();
-    };
-
-    return window(
-               text(fmt::format("GPU {}: {}", gs.index, gs.name)),
-               hbox({
-                   vbox({
-                       text("Metric"),
-                       separator(),
-                       text("Util.   [%]"),
-                       text("Clock [MHz]"),
-                       text("Temp.   [C]"),
-                       text("Power   [W]"),
-                   }),
-                   separator(),
-                   vbox({
-                       text("Sparkline (60s)") |
-                           size(WIDTH, EQUAL, GpuStateSamples::MAX_SAMPLES),
-                       separator(), text_sparkline(sample.util, 0, 100),
-                       text_sparkline(sample.gpu_clock, 0,
-                                      gs.gpu_max_clock_mhz),
-                       text_sparkline(sample.temp, 0, 100),
-                       text_sparkline(sample.power, 0, 100),
-                   }),
-                   separator(),
-                   vbox({
-                       text("Now "),
-                       separator(),
-                       text(format("{}", sample.util.back())),
-                       text(format("{}", sample.gpu_clock.back())),
-                       text(format("{}", sample.temp.back())),
-                       text(format("{}", sample.power.back())),
-                   }),
-                   separator(),
-                   vbox({
-                       text("Max "), separator(),
-                       text(format("{}", dq_max(sample.util))),
-                       text(format("{}", dq_max(sample.gpu_clock))),
-                       text(format("{}", dq_max(sample.temp))),
-                       text(format("{}", dq_max(sample.power))),
-                   }),
-                   separator(),
-                   vbox({
-                       text("Avg "), separator(),
-                       text(format("{}", dq_avg(sample.util))),
-                       text(format("{}", dq_avg(sample.gpu_clock))),
-                       text(format("{}", dq_avg(sample.temp))),
-                       text(format("{}", dq_avg(sample.power))),
-                   }) | flex,
-               })) |
-           (focused ? focus : dim);
+    if (window_caches_[gpu_index].generation != generation_) {
+      rebuild_window_cache(gpu_index);
+    }
+    const WindowCache& cache = window_caches_[gpu_index];
+    return window(cache.title, cache.body) | (focused ? focus : dim);
   });
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <climits>
 #include <deque>
 #include <ftxui/component/component.hpp>
 
@@ -18,8 +19,19 @@ struct GpuStateSamples {
 
 class Sparklines {
  private:
-  std::vector<GpuStateSamples> samples_;
+  // Body of a window, rebuilt only after update() added a sample.
+  struct WindowCache {
+    unsigned long long generation = ULLONG_MAX;
+    ftxui::Element title;
+    ftxui::Element body;
+  };
+
   const std::vector<GpuState>& gpu_states_;
+  std::vector<GpuStateSamples> samples_;
+  unsigned long long generation_ = 0;
+  std::vector<WindowCache> window_caches_;
+  std::string buffer_;  // reused by every format call
+
   ftxui::Components sparkline_window_focus_components_;  // or naming whatever
   ftxui::Components sparkline_windows_;
   ftxui::Component main_component_;
@@ -29,9 +41,13 @@ class Sparklines {
   void update();
   ftxui::Component get_component() { return main_component_; };
 
-  static std::string get_sparkline_string(const std::deque<int>& data,
-                                          int min_val, int max_val);
+  /**
+   * @brief Format `data` as a sparkline into `out`, reusing its capacity.
+   */
+  static void format_sparkline(const std::deque<int>& data, int min_val,
+                               int max_val, std::string& out);
 
  private:
   ftxui::Component create_window(size_t gpu_index);
+  void rebuild_window_cache(size_t gpu_index);
 };
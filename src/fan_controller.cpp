@@ -0,0 +1,92 @@
+#include "fan_controller.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <iostream>
+
+FanController::FanController(NvmlManager& nvml) : nvml_(nvml) {}
+
+void FanController::configure(const ProfileManager& pm) {
+  const auto& gpus = nvml_.get_gpus();
+  std::vector<Channel> channels;
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    const FanCurve& curve = pm.get_fan_curve(gpus[i].uuid);
+    if (curve.enabled()) {
+      channels.emplace_back(i, curve);
+    }
+  }
+  for (const auto& old : channels_) {
+    bool kept = std::any_of(
+        channels.begin(), channels.end(),
+        [&](const Channel& c) { return c.gpu_index == old.gpu_index; });
+    if (!kept) {
+      nvml_.reset_fans(gpus[old.gpu_index]);
+      std::clog << fmt::format("Fans of GPU {} back on the stock curve.",
+                               old.gpu_index)
+                << std::endl;
+    }
+  }
+  channels_ = std::move(channels);
+  for (const auto& channel : channels_) {
+    std::clog << fmt::format("Fan curve for GPU {}: {} points.",
+                             channel.gpu_index, channel.curve.points.size())
+              << std::endl;
+  }
+}
+
+void FanController::tick() {
+  auto now = std::chrono::steady_clock::now();
+  for (auto& channel : channels_) {
+    const GpuState& gs = nvml_.get_gpus()[channel.gpu_index];
+    if (channel.failed) {
+      continue;
+    }
+    if (gs.temperature_c < 0) {
+      // Blind; let the driver's curve cool the GPU until readings return.
+      if (channel.duty >= 0) {
+        nvml_.reset_fans(gs);
+        channel.duty = -1;
+        std::cerr << fmt::format("Cannot read the temperature of GPU {}; "
+                                 "fans back on the stock curve.",
+                                 gs.index)
+                  << std::endl;
+      }
+      continue;
+    }
+    const FanCurve& curve = channel.curve;
+    int rising = curve.duty_at(gs.temperature_c);
+    int duty = channel.duty;
+    if (duty < 0 || rising > duty) {
+      duty = rising;
+    } else {
+      // Going down, follow the curve shifted by the hysteresis.
+      duty = std::min(duty, curve.duty_at(gs.temperature_c +
+                                          curve.hysteresis_c));
+    }
+    if (duty == channel.duty ||
+        (channel.duty >= 0 &&
+         now - channel.last_change <
+             std::chrono::seconds(curve.min_interval_s))) {
+      continue;
+    }
+    if (!nvml_.set_fan_duty(gs, duty)) {
+      channel.failed = true;
+      nvml_.reset_fans(gs);
+      std::cerr << fmt::format("Fan curve for GPU {} disabled.", gs.index)
+                << std::endl;
+      continue;
+    }
+    channel.duty = duty;
+    channel.last_change = now;
+  }
+}
+
+void FanController::restore() {
+  for (const auto& channel : channels_) {
+    nvml_.reset_fans(nvml_.get_gpus()[channel.gpu_index]);
+  }
+  if (!channels_.empty()) {
+    std::clog << "Fans back on the stock curve." << std::endl;
+  }
+}
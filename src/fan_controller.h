@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Drives the fans of GPUs that have a FanCurve, once per second, from the
+// resident helper. Fans are handed back to the driver when a curve is
+// removed, while the temperature cannot be read, and when the helper stops;
+// if it crashes, the systemd unit runs `nvtuner --reset-fans` (ExecStopPost)
+// to do the same.
+class FanController {
+ public:
+  explicit FanController(NvmlManager& nvml);
+
+  /**
+   * @brief Take the fan curves from `pm`. GPUs that lost their curve go back
+   * to the stock one.
+   */
+  void configure(const ProfileManager& pm);
+
+  bool active() const { return !channels_.empty(); }
+
+  /**
+   * @brief Call with freshly sampled dynamic state.
+   */
+  void tick();
+
+  /**
+   * @brief Hand every controlled GPU back to the stock curve.
+   */
+  void restore();
+
+ private:
+  struct Channel {
+    Channel(size_t gpu_index, FanCurve curve)
+        : gpu_index(gpu_index), curve(std::move(curve)) {}
+
+    size_t gpu_index = 0;
+    FanCurve curve;
+    int duty = -1;  // last written, -1: none yet or on the stock curve
+    bool failed = false;  // unsupported or denied; not retried
+    std::chrono::steady_clock::time_point last_change;
+  };
+
+  NvmlManager& nvml_;
+  std::vector<Channel> channels_;
+};
@@ -0,0 +1,243 @@
+#include "flight_recorder.h"
+
+#include <fmt/chrono.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+#include "nlohmann/json.hpp"
+#include "sys_utils.h"
+
+using json = nlohmann::json;
+
+namespace {
+// Captures waiting for the writer; more means the disk cannot keep up.
+const size_t MAX_QUEUED = 4;
+
+FlightRecorder::Sample to_sample(const GpuState& gs) {
+  return {gs.temperature_c,    gs.power_usage_w,
+          gs.power_limit_w,    gs.gpu_clock_mhz,
+          gs.gpu_util_percent, gs.mem_util_percent,
+          gs.fan_speed_percent, gs.pstate,
+          gs.clock_event_reasons};
+}
+
+std::string join(const std::vector<std::string>& names) {
+  std::string joined;
+  for (const auto& name : names) {
+    joined += joined.empty() ? name : ", " + name;
+  }
+  return joined;
+}
+}  // namespace
+
+FlightRecorder::FlightRecorder(std::string output_dir)
+    : output_dir_(std::move(output_dir)) {
+  thread_ = std::thread(&FlightRecorder::run, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+  finish_capture();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void FlightRecorder::configure(const RecorderConfig& config,
+                               const std::vector<GpuState>& gpus) {
+  finish_capture();
+  config_ = config;
+  gpus_.clear();
+  for (const auto& gs : gpus) {
+    gpus_.push_back({gs.index, gs.uuid, gs.name});
+  }
+  size_t frames =
+      config_.enabled() ? config_.pre_s * 1000 / config_.sample_ms + 1 : 0;
+  ring_times_.assign(frames, {});
+  ring_samples_.assign(frames * gpus_.size(), Sample{});
+  ring_next_ = 0;
+  ring_filled_ = 0;
+  holdoff_until_ = {};
+}
+
+std::string FlightRecorder::check_trigger(const RecorderConfig& config,
+                                          const Sample& prev,
+                                          const Sample& now) {
+  unsigned long long rising =
+      now.clock_event_reasons & ~prev.clock_event_reasons & config.event_mask;
+  if (rising) {
+    return "clock event " + join(clock_event_names(rising));
+  }
+  if (config.max_temp_c > 0 && prev.temperature_c <= config.max_temp_c &&
+      now.temperature_c > config.max_temp_c) {
+    return fmt::format("temperature {}C above {}C", now.temperature_c,
+                       config.max_temp_c);
+  }
+  if (config.clock_drop_percent > 0 && prev.gpu_clock_mhz > 0 &&
+      now.gpu_clock_mhz >= 0 &&
+      prev.gpu_util_percent >= BUSY_UTIL_PERCENT &&
+      now.gpu_util_percent >= BUSY_UTIL_PERCENT &&
+      (prev.gpu_clock_mhz - now.gpu_clock_mhz) * 100 >=
+          config.clock_drop_percent * prev.gpu_clock_mhz) {
+    return fmt::format("clock drop {}MHz to {}MHz", prev.gpu_clock_mhz,
+                       now.gpu_clock_mhz);
+  }
+  return {};
+}
+
+void FlightRecorder::add_sample(const std::vector<GpuState>& gpus) {
+  size_t frames = ring_times_.size();
+  size_t n = gpus_.size();
+  if (frames == 0 || gpus.size() != n) {
+    return;
+  }
+  auto now = std::chrono::system_clock::now();
+  Sample* row = &ring_samples_[ring_next_ * n];
+  const Sample* prev_row =
+      &ring_samples_[(ring_next_ + frames - 1) % frames * n];
+  bool has_prev = ring_filled_ > 0;
+  for (size_t g = 0; g < n; ++g) {
+    row[g] = to_sample(gpus[g]);
+  }
+  ring_times_[ring_next_] = now;
+  ring_next_ = (ring_next_ + 1) % frames;
+  ring_filled_ = std::min(ring_filled_ + 1, frames);
+
+  std::vector<Trigger> triggers;
+  for (size_t g = 0; has_prev && g < n; ++g) {
+    std::string reason = check_trigger(config_, prev_row[g], row[g]);
+    if (!reason.empty()) {
+      triggers.push_back({now, gpus_[g].index, std::move(reason)});
+    }
+  }
+
+  if (capture_) {
+    capture_->times.push_back(now);
+    capture_->samples.insert(capture_->samples.end(), row, row + n);
+    capture_->triggers.insert(capture_->triggers.end(), triggers.begin(),
+                              triggers.end());
+    if (--capture_->post_remaining == 0) {
+      finish_capture();
+    }
+    return;
+  }
+  auto steady_now = std::chrono::steady_clock::now();
+  if (triggers.empty() || steady_now < holdoff_until_) {
+    return;
+  }
+
+  for (const auto& trigger : triggers) {
+    std::clog << fmt::format("Flight recorder triggered on GPU {}: {}.",
+                             trigger.gpu, trigger.reason)
+              << std::endl;
+  }
+  holdoff_until_ = steady_now + std::chrono::seconds(config_.holdoff_s);
+  size_t post = static_cast<size_t>(config_.post_s) * 1000 / config_.sample_ms;
+  capture_.emplace();
+  capture_->gpus = gpus_;
+  capture_->sample_ms = config_.sample_ms;
+  capture_->times.reserve(ring_filled_ + post);
+  capture_->samples.reserve((ring_filled_ + post) * n);
+  // Oldest first; the newest is the sample that fired.
+  size_t oldest = (ring_next_ + frames - ring_filled_) % frames;
+  for (size_t k = 0; k < ring_filled_; ++k) {
+    size_t f = (oldest + k) % frames;
+    capture_->times.push_back(ring_times_[f]);
+    capture_->samples.insert(capture_->samples.end(),
+                             ring_samples_.begin() + f * n,
+                             ring_samples_.begin() + (f + 1) * n);
+  }
+  capture_->triggers = std::move(triggers);
+  capture_->post_remaining = post;
+  if (post == 0) {
+    finish_capture();
+  }
+}
+
+void FlightRecorder::finish_capture() {
+  if (!capture_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() < MAX_QUEUED) {
+      queue_.push_back(std::move(*capture_));
+    } else {
+      std::cerr << "Flight recorder is behind on writing; dropped a capture."
+                << std::endl;
+    }
+  }
+  capture_.reset();
+  wake_.notify_one();
+}
+
+void FlightRecorder::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;  // stopping, and everything is written
+    }
+    Capture capture = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    write(capture);
+    lock.lock();
+  }
+}
+
+void FlightRecorder::write(const Capture& capture) const {
+  const Trigger& first = capture.triggers.front();
+  std::filesystem::path dir(output_dir_);
+  std::filesystem::path path =
+      dir / fmt::format("flight-{:%Y%m%d-%H%M%S}-gpu{}.json",
+                        fmt::localtime(std::chrono::system_clock::to_time_t(
+                            first.time)),
+                        first.gpu);
+
+  auto seconds_from_trigger = [&first](auto time) {
+    return std::chrono::duration<double>(time - first.time).count();
+  };
+  json data;
+  data["sample_ms"] = capture.sample_ms;
+  data["triggers"] = json::array();
+  for (const auto& trigger : capture.triggers) {
+    data["triggers"].push_back(
+        {{"t", seconds_from_trigger(trigger.time)},
+         {"gpu", trigger.gpu},
+         {"reason", trigger.reason}});
+  }
+  data["gpus"] = json::array();
+  for (const auto& gpu : capture.gpus) {
+    data["gpus"].push_back(
+        {{"index", gpu.index}, {"uuid", gpu.uuid}, {"name", gpu.name}});
+  }
+  data["columns"] = {"temp_c",   "power_w", "power_limit_w",
+                     "clock_mhz", "util",    "mem_util",
+                     "fan",       "pstate",  "clock_events"};
+  data["samples"] = json::array();
+  size_t n = capture.gpus.size();
+  for (size_t k = 0; k < capture.times.size(); ++k) {
+    json row = json::array();
+    for (size_t g = 0; g < n; ++g) {
+      const Sample& s = capture.samples[k * n + g];
+      row.push_back({s.temperature_c, s.power_usage_w, s.power_limit_w,
+                     s.gpu_clock_mhz, s.gpu_util_percent, s.mem_util_percent,
+                     s.fan_speed_percent, s.pstate, s.clock_event_reasons});
+    }
+    data["samples"].push_back(
+        {{"t", seconds_from_trigger(capture.times[k])}, {"gpus", row}});
+  }
+
+  // The helper runs as root and writes into the user's config directory.
+  if (!SysUtils::create_file(path.string(), data.dump())) {
+    return;
+  }
+  std::clog << fmt::format("Flight recording written to {}.", path.string())
+            << std::endl;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Records what led up to a throttle or threshold event, so an overnight HT
+// slowdown leaves more behind than "HT:3h". The last RecorderConfig::pre_s
+// seconds of samples of every GPU are kept in a ring allocated up front.
+// When a trigger fires, the ring and the next post_s seconds are written to
+// a timestamped JSON file in the output directory. Files are written on a
+// background thread; the sampling side only moves the finished capture into
+// a queue. Run by the resident helper.
+class FlightRecorder {
+ public:
+  explicit FlightRecorder(std::string output_dir);
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  /**
+   * @brief Start over with `config`; a capture in progress is written out
+   * as it is.
+   */
+  void configure(const RecorderConfig& config,
+                 const std::vector<GpuState>& gpus);
+  bool active() const { return config_.enabled(); }
+  std::chrono::milliseconds period() const {
+    return std::chrono::milliseconds(config_.sample_ms);
+  }
+
+  /**
+   * @brief Record freshly sampled dynamic state; call every period().
+   */
+  void add_sample(const std::vector<GpuState>& gpus);
+
+  struct Sample {
+    int temperature_c;
+    int power_usage_w;
+    int power_limit_w;
+    int gpu_clock_mhz;
+    int gpu_util_percent;
+    int mem_util_percent;
+    int fan_speed_percent;
+    int pstate;
+    unsigned long long clock_event_reasons;
+  };
+
+  /**
+   * @return why going from `prev` to `now` fires a trigger, empty if it
+   * does not.
+   */
+  static std::string check_trigger(const RecorderConfig& config,
+                                   const Sample& prev, const Sample& now);
+
+  // Stops the clock drop trigger from firing when work simply ends.
+  static constexpr int BUSY_UTIL_PERCENT = 80;
+
+ private:
+  struct GpuInfo {
+    unsigned int index;
+    std::string uuid;
+    std::string name;
+  };
+  struct Trigger {
+    std::chrono::system_clock::time_point time;
+    unsigned int gpu;
+    std::string reason;
+  };
+  struct Capture {
+    std::vector<GpuInfo> gpus;
+    int sample_ms = 0;
+    std::vector<std::chrono::system_clock::time_point> times;
+    std::vector<Sample> samples;  // one row of gpu_count per time
+    std::vector<Trigger> triggers;
+    size_t post_remaining = 0;  // samples still to record
+  };
+
+  void finish_capture();
+  void run();
+  void write(const Capture& capture) const;
+
+  std::string output_dir_;
+  RecorderConfig config_;
+  std::vector<GpuInfo> gpus_;
+
+  // The last pre_s seconds, oldest at ring_next_ once full.
+  std::vector<std::chrono::system_clock::time_point> ring_times_;
+  std::vector<Sample> ring_samples_;  // one row of gpus_.size() per time
+  size_t ring_next_ = 0;
+  size_t ring_filled_ = 0;
+  std::optional<Capture> capture_;
+  std::chrono::steady_clock::time_point holdoff_until_;
+
+  std::mutex mutex_;  // guards queue_ and stop_
+  std::condition_variable wake_;
+  std::deque<Capture> queue_;
+  bool stop_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,289 @@
+#include "gpu_simulator.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+const double MIN_VOLTAGE = 0.70;    // at the idle clock
+const double BOOST_VOLTAGE = 1.05;  // top of the stock curve
+// Dynamic power ~ K * f * V^2, scaled so stock full load draws 300W.
+const double POWER_K = 300.0 / (2520 * BOOST_VOLTAGE * BOOST_VOLTAGE);
+// Supported memory clocks of a GDDR6X board.
+const std::vector<int> MEM_CLOCKS_MHZ = {405, 810, 5001, 9501, 10501};
+// Below this load the board drops from P0 to P2, whose offsets apply then.
+const double P2_MAX_LOAD = 0.6;
+const int P2 = 2;
+// Below this load the board idles in P8.
+const double P8_MAX_LOAD = 0.05;
+const int P8 = 8;
+const int SLOWDOWN_TEMP_C = 83;
+}  // namespace
+
+GpuSimulator::GpuSimulator(unsigned int gpu_count, unsigned int seed)
+    : sims_(gpu_count),
+      rng_(seed),
+      last_update_(std::chrono::steady_clock::now()) {
+  std::uniform_real_distribution<double> load(0.0, 1.0);
+  std::uniform_int_distribution<int> stable_offset(120, 220);
+  for (auto& sim : sims_) {
+    sim.load_target = load(rng_);
+    sim.power_limit_w = DEFAULT_POWER_LIMIT_W;
+    sim.max_clock_mhz = MAX_CLOCK_MHZ;
+    sim.min_mem_clock_mhz = MEM_CLOCKS_MHZ.front();
+    sim.max_mem_clock_mhz = MEM_CLOCKS_MHZ.back();
+    sim.stable_offset_mhz = stable_offset(rng_);
+  }
+}
+
+double GpuSimulator::stock_voltage(double clock_mhz) {
+  double t = (clock_mhz - IDLE_CLOCK_MHZ) / (BOOST_CLOCK_MHZ - IDLE_CLOCK_MHZ);
+  return MIN_VOLTAGE + std::clamp(t, 0.0, 1.0) * (BOOST_VOLTAGE - MIN_VOLTAGE);
+}
+
+double GpuSimulator::board_power(double load, double clock_mhz,
+                                 int offset_mhz) {
+  // A positive offset shifts the curve right: the same clock needs less
+  // voltage. That is what undervolting with offset + max clock exploits.
+  double voltage = stock_voltage(clock_mhz - offset_mhz);
+  return IDLE_POWER_W + load * POWER_K * clock_mhz * voltage * voltage;
+}
+
+std::vector<GpuState> GpuSimulator::create_gpus() const {
+  std::vector<GpuState> gpus;
+  gpus.reserve(sims_.size());
+  for (unsigned int i = 0; i < sims_.size(); ++i) {
+    GpuState gpu{};
+    gpu.index = i;
+    gpu.handle = nullptr;
+    gpu.uuid = fmt::format("GPU-00000000-0000-0000-0000-{:012}", i);
+    gpu.name = fmt::format("NVIDIA Simulated GPU {}", i);
+    gpu.name_short = fmt::format("*Simulated GPU {}*", i);
+    gpu.power_limit_min_w = 100;
+    gpu.power_limit_max_w = 450;
+    gpu.power_limit_default_w = DEFAULT_POWER_LIMIT_W;
+    gpu.clock_offset_min_mhz = -500;
+    gpu.clock_offset_max_mhz = 500;
+    gpu.gpu_max_clock_mhz = MAX_CLOCK_MHZ;
+    for (int clock = IDLE_CLOCK_MHZ; clock <= MAX_CLOCK_MHZ; clock += 15) {
+      gpu.gpu_clocks_mhz.push_back(clock);
+    }
+    gpu.mem_clock_offset_min_mhz = -1000;
+    gpu.mem_clock_offset_max_mhz = 3000;
+    gpu.mem_clocks_mhz = MEM_CLOCKS_MHZ;
+    gpu.pstate_offset_ranges = {{P2, -500, 500, -1000, 3000}};
+    gpu.slowdown_temp_c = SLOWDOWN_TEMP_C;
+    gpus.push_back(gpu);
+  }
+  return gpus;
+}
+
+void GpuSimulator::update(std::vector<GpuState>& gpus) {
+  auto now = std::chrono::steady_clock::now();
+  double dt_s = std::chrono::duration<double>(now - last_update_).count();
+  last_update_ = now;
+  step(gpus, std::min(dt_s, 2.0));
+}
+
+void GpuSimulator::skip_time(double dt_s) {
+  last_update_ -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(dt_s));
+}
+
+void GpuSimulator::step(std::vector<GpuState>& gpus, double dt_s) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  auto now = std::chrono::system_clock::now();
+
+  for (size_t i = 0; i < sims_.size() && i < gpus.size(); ++i) {
+    SimGpu& sim = sims_[i];
+    GpuState& gpu = gpus[i];
+
+    // Workloads start and stop now and then; load ramps within seconds.
+    if (sim.held_load >= 0) {
+      sim.load_target = sim.held_load;
+    } else if (uniform(rng_) < 0.02 * dt_s) {
+      sim.load_target = uniform(rng_) < 0.3 ? 0.0 : uniform(rng_);
+    }
+    int offset_mhz = sim.load < P2_MAX_LOAD ? sim.p2_clock_offset_mhz
+                                            : sim.clock_offset_mhz;
+    // A crash raises one Xid; the next comes once work restarts.
+    bool crashed = offset_mhz > sim.stable_offset_mhz && sim.load > 0.05;
+    if (crashed && !sim.crashed) {
+      xid_events_.push_back({static_cast<unsigned int>(i), 13});
+    }
+    sim.crashed = crashed || (sim.crashed && sim.load > 0.05);
+    // The crashed workload stays down until both offsets hold again.
+    // Otherwise it would recover in the stable P2 state and crash again on
+    // the way up to P0, averaging a utilization that looks alive.
+    sim.workload_down =
+        offset_mhz > sim.stable_offset_mhz ||
+        (sim.workload_down &&
+         std::max(sim.clock_offset_mhz, sim.p2_clock_offset_mhz) >
+             sim.stable_offset_mhz);
+    if (sim.workload_down) {
+      sim.load_target = 0.0;
+    }
+    sim.load += (sim.load_target - sim.load) * std::min(1.0, dt_s / 2.0);
+
+    // Clock follows load up to the top of the shifted V/F curve, capped by
+    // the locked max clock. Power is K * f * V^2 on that curve.
+    double boost = std::min<double>(BOOST_CLOCK_MHZ + sim.clock_offset_mhz,
+                                    sim.max_clock_mhz);
+    double clock = IDLE_CLOCK_MHZ + sim.load * (boost - IDLE_CLOCK_MHZ);
+    clock = std::max<double>(clock, std::min<double>(sim.min_clock_mhz, boost));
+    double power = board_power(sim.load, clock, offset_mhz);
+    unsigned long long reasons = 0;
+    if (power > sim.power_limit_w) {
+      // The power cap lowers the clock until the budget fits.
+      double lo = IDLE_CLOCK_MHZ;
+      double hi = clock;
+      for (int iter = 0; iter < 20; ++iter) {
+        double mid = (lo + hi) / 2;
+        if (board_power(sim.load, mid, offset_mhz) >
+            sim.power_limit_w) {
+          hi = mid;
+        } else {
+          lo = mid;
+        }
+      }
+      clock = lo;
+      power = sim.power_limit_w;
+      reasons |= nvmlClocksEventReasonSwPowerCap;
+    }
+
+    // First-order thermal model towards ambient + R * P. The stock fan curve
+    // is built into R; a manual duty above it cools better, one below worse.
+    int auto_fan =
+        std::clamp(static_cast<int>((sim.temperature_c - 30.0) * 2.0), 30, 100);
+    int fan = sim.fan_duty >= 0 ? sim.fan_duty : auto_fan;
+    double resistance = 0.18 * (1.0 + 0.4 * (auto_fan - fan) / 100.0);
+    double steady_temp = 25.0 + resistance * power;
+    sim.temperature_c +=
+        (steady_temp - sim.temperature_c) * std::min(1.0, dt_s / 20.0);
+    if (sim.temperature_c > SLOWDOWN_TEMP_C) {
+      clock *= 0.9;
+      reasons |= nvmlClocksEventReasonSwThermalSlowdown;
+    }
+
+    gpu.fan_speed_percent = fan;
+    gpu.fan_speed_rpm = gpu.fan_speed_percent * 30;
+    gpu.temperature_c = static_cast<int>(sim.temperature_c);
+    gpu.power_usage_w = static_cast<int>(power);
+    gpu.power_limit_w = sim.power_limit_w;
+    gpu.enforced_power_limit_w = sim.power_limit_w;
+    gpu.mem_total_mib = 24564;
+    gpu.mem_used_mib = static_cast<int>(500 + sim.load * 20000);
+    gpu.gpu_util_percent = static_cast<int>(sim.load * 100);
+    gpu.mem_util_percent = static_cast<int>(sim.load * 60);
+    gpu.gpu_clock_mhz = static_cast<int>(clock);
+    gpu.pstate = sim.load < P8_MAX_LOAD   ? P8
+                 : sim.load < P2_MAX_LOAD ? P2
+                                          : 0;
+    gpu.persistence_mode = sim.persistence_mode;
+    gpu.clock_event_reasons = reasons;
+
+    if (reasons & nvmlClocksEventReasonSwPowerCap) {
+      gpu.last_event_power_cap_time = now;
+    }
+    if (reasons & nvmlClocksEventReasonSwThermalSlowdown) {
+      gpu.last_event_swt_slowdown_time = now;
+    }
+  }
+}
+
+OcProfile GpuSimulator::get_settings(const GpuState& gs) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const SimGpu& sim = sims_.at(gs.index);
+  OcProfile settings;
+  settings.power_limit = sim.power_limit_w;
+  settings.gpu_clock_offset = sim.clock_offset_mhz;
+  settings.max_gpu_clock = sim.max_clock_mhz;
+  settings.latency_mode = sim.min_clock_mhz > 0;
+  settings.min_gpu_clock = sim.min_clock_mhz;
+  settings.mem_clock_offset = sim.mem_clock_offset_mhz;
+  settings.min_mem_clock = sim.min_mem_clock_mhz;
+  settings.max_mem_clock = sim.max_mem_clock_mhz;
+  settings.persistence_mode = sim.persistence_mode;
+  settings.pstate_clock_offsets[P2] = {sim.p2_clock_offset_mhz,
+                                       sim.p2_mem_clock_offset_mhz};
+  return settings;
+}
+
+bool GpuSimulator::set_power_limit(const GpuState& gs, int power_limit_w) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SimGpu& sim = sims_.at(gs.index);
+  if (sim.fail_power_limit) {
+    return false;
+  }
+  sim.power_limit_w = power_limit_w;
+  power_limit_writes_.emplace_back(gs.index, power_limit_w);
+  return true;
+}
+
+void GpuSimulator::set_clock_offset(const GpuState& gs, int clock_offset_mhz) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).clock_offset_mhz = clock_offset_mhz;
+}
+
+void GpuSimulator::set_locked_clocks(const GpuState& gs, int min_mhz,
+                                     int max_mhz) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).min_clock_mhz = min_mhz;
+  sims_.at(gs.index).max_clock_mhz = max_mhz;
+}
+
+void GpuSimulator::set_mem_clock_offset(const GpuState& gs,
+                                        int mem_clock_offset_mhz) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).mem_clock_offset_mhz = mem_clock_offset_mhz;
+}
+
+void GpuSimulator::set_mem_locked_clocks(const GpuState& gs, int min_mhz,
+                                         int max_mhz) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).min_mem_clock_mhz = min_mhz;
+  sims_.at(gs.index).max_mem_clock_mhz = max_mhz;
+}
+
+void GpuSimulator::set_pstate_clock_offset(const GpuState& gs, int pstate,
+                                           const PstateClockOffset& offset) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pstate == P2) {
+    sims_.at(gs.index).p2_clock_offset_mhz = offset.gpu;
+    sims_.at(gs.index).p2_mem_clock_offset_mhz = offset.mem;
+  }
+}
+
+void GpuSimulator::set_persistence_mode(const GpuState& gs, bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).persistence_mode = enabled;
+}
+
+std::vector<XidEvent> GpuSimulator::take_xid_events() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::exchange(xid_events_, {});
+}
+
+void GpuSimulator::fail_power_limit(const GpuState& gs, bool fail) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).fail_power_limit = fail;
+}
+
+std::vector<std::pair<unsigned int, int>>
+GpuSimulator::take_power_limit_writes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::exchange(power_limit_writes_, {});
+}
+
+void GpuSimulator::hold_load(const GpuState& gs, double load) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).held_load = load;
+}
+
+void GpuSimulator::set_fan_duty(const GpuState& gs, int duty_percent) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sims_.at(gs.index).fan_duty = duty_percent;
+}
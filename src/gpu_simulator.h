@@ -0,0 +1,131 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Synthetic GPUs to exercise the UI and controllers without hardware, e.g.
+// a 256-GPU node. Enabled with --simulate-gpus. Like NVML, it may be used
+// from several threads.
+class GpuSimulator {
+ public:
+  explicit GpuSimulator(unsigned int gpu_count, unsigned int seed = 1);
+
+  /**
+   * @brief Static info of the simulated GPUs. Handles are null.
+   */
+  std::vector<GpuState> create_gpus() const;
+
+  /**
+   * @brief Advance the model by the wall time since the last call and write
+   * the dynamic info of every GPU.
+   */
+  void update(std::vector<GpuState>& gpus);
+
+  /**
+   * @brief Advance the model by `dt_s` seconds of simulated time.
+   */
+  void step(std::vector<GpuState>& gpus, double dt_s);
+
+  /**
+   * @brief Make the next update() see `dt_s` more seconds of wall time, so
+   * tests driving it through NvmlManager need not wait.
+   */
+  void skip_time(double dt_s);
+
+  /**
+   * @brief Current OC settings, as the NVML getters would report them.
+   */
+  OcProfile get_settings(const GpuState& gs) const;
+  /**
+   * @return false if writes to the GPU were made to fail.
+   */
+  bool set_power_limit(const GpuState& gs, int power_limit_w);
+  void set_clock_offset(const GpuState& gs, int clock_offset_mhz);
+  /**
+   * @param min_mhz locked floor, or 0 for none.
+   */
+  void set_locked_clocks(const GpuState& gs, int min_mhz, int max_mhz);
+  void set_mem_clock_offset(const GpuState& gs, int mem_clock_offset_mhz);
+  void set_mem_locked_clocks(const GpuState& gs, int min_mhz, int max_mhz);
+  /**
+   * @brief Only P2 is adjustable; it runs below 60% load.
+   */
+  void set_pstate_clock_offset(const GpuState& gs, int pstate,
+                               const PstateClockOffset& offset);
+
+  void set_persistence_mode(const GpuState& gs, bool enabled);
+
+  /**
+   * @return Xid errors since the last call: an unstable clock offset crashes
+   * the workload with Xid 13.
+   */
+  std::vector<XidEvent> take_xid_events();
+
+  /**
+   * @brief Make power limit writes to one GPU fail, like a driver refusing
+   * them.
+   */
+  void fail_power_limit(const GpuState& gs, bool fail);
+  /**
+   * @return the power limit writes that succeeded since the last call, in
+   * order, as (GPU index, watts).
+   */
+  std::vector<std::pair<unsigned int, int>> take_power_limit_writes();
+
+  /**
+   * @brief Pin the load of one GPU, e.g. a steady benchmark while tuning.
+   * @param load 0..1, or negative to go back to random workloads.
+   */
+  void hold_load(const GpuState& gs, double load);
+
+  /**
+   * @param duty_percent manual fan duty, or negative for the automatic curve.
+   */
+  void set_fan_duty(const GpuState& gs, int duty_percent);
+
+ private:
+  struct SimGpu {
+    double load = 0;         // 0..1, follows load_target
+    double load_target = 0;
+    double held_load = -1;   // pinned load_target if >= 0
+    int fan_duty = -1;       // manual fan duty if >= 0
+    double temperature_c = 30;
+    int power_limit_w = 0;
+    bool fail_power_limit = false;
+    int clock_offset_mhz = 0;
+    int min_clock_mhz = 0;
+    int max_clock_mhz = 0;
+    int mem_clock_offset_mhz = 0;
+    int min_mem_clock_mhz = 0;
+    int max_mem_clock_mhz = 0;
+    int p2_clock_offset_mhz = 0;
+    int p2_mem_clock_offset_mhz = 0;
+    bool persistence_mode = false;
+    // Above this offset the workload crashes, like a real unstable OC.
+    int stable_offset_mhz = 0;
+    bool crashed = false;
+    bool workload_down = false;  // crashed and not restarted yet
+  };
+
+  // Stock V/F curve: voltage for `clock_mhz` with no offset.
+  static double stock_voltage(double clock_mhz);
+  // Board power for a clock, with the curve shifted by `offset_mhz`.
+  static double board_power(double load, double clock_mhz, int offset_mhz);
+
+  static const int BOOST_CLOCK_MHZ = 2520;
+  static const int MAX_CLOCK_MHZ = 3105;
+  static const int IDLE_CLOCK_MHZ = 210;
+  static const int IDLE_POWER_W = 25;
+  static const int DEFAULT_POWER_LIMIT_W = 350;
+
+  mutable std::mutex mutex_;  // guards sims_ and rng_
+  std::vector<SimGpu> sims_;
+  std::mt19937 rng_;
+  std::vector<XidEvent> xid_events_;
+  std::vector<std::pair<unsigned int, int>> power_limit_writes_;
+  std::chrono::steady_clock::time_point last_update_;
+};
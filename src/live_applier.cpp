@@ -0,0 +1,118 @@
+#include "live_applier.h"
+
+#include <fmt/core.h>
+
+#include <iostream>
+
+namespace {
+// Write once the value has been still for this long...
+const auto DEBOUNCE = std::chrono::milliseconds(150);
+// ...but at least this often while a key is held down.
+const auto MAX_DELAY = std::chrono::milliseconds(400);
+}  // namespace
+
+LiveApplier::LiveApplier(NvmlManager& nvml) : nvml_(nvml) {
+  thread_ = std::thread(&LiveApplier::run, this);
+}
+
+LiveApplier::~LiveApplier() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void LiveApplier::submit(size_t gpu_index, const OcProfile& profile) {
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = pending_.try_emplace(gpu_index);
+    it->second.profile = profile;
+    it->second.last_change = now;
+    if (inserted) {
+      it->second.first_change = now;
+    }
+  }
+  wake_.notify_one();
+}
+
+void LiveApplier::mark_saved() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  touched_.clear();
+}
+
+void LiveApplier::revert(const std::map<std::string, OcProfile>& saved) {
+  std::set<size_t> touched;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_.clear();
+    idle_.wait(lock, [this] { return !writing_; });
+    touched.swap(touched_);
+  }
+  if (touched.empty()) {
+    return;
+  }
+
+  std::clog << fmt::format("Reverting live changes on {} GPUs.",
+                           touched.size())
+            << std::endl;
+  for (size_t i : touched) {
+    const GpuState& gs = nvml_.get_gpus()[i];
+    std::vector<std::string> log;
+    ApplyResult result = nvml_.apply_profile(gs, saved.at(gs.uuid), log);
+    (result.success ? std::clog : std::cerr) << log.back() << std::endl;
+  }
+}
+
+void LiveApplier::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    // Find the GPU whose write is due first.
+    auto due = std::chrono::steady_clock::time_point::max();
+    for (const auto& [index, p] : pending_) {
+      due = std::min(due, std::min(p.last_change + DEBOUNCE,
+                                   p.first_change + MAX_DELAY));
+    }
+    if (stop_) {
+      return;
+    }
+    if (due == std::chrono::steady_clock::time_point::max()) {
+      wake_.wait(lock);
+      continue;
+    }
+    if (std::chrono::steady_clock::now() < due) {
+      wake_.wait_until(lock, due);
+      continue;
+    }
+
+    // Take every GPU that is due; the others keep collecting changes.
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<size_t, OcProfile>> writes;
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (std::min(it->second.last_change + DEBOUNCE,
+                   it->second.first_change + MAX_DELAY) <= now) {
+        writes.emplace_back(it->first, it->second.profile);
+        touched_.insert(it->first);
+        it = pending_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    writing_ = true;
+    lock.unlock();
+    for (const auto& [index, profile] : writes) {
+      const GpuState& gs = nvml_.get_gpus()[index];
+      std::vector<std::string> log;
+      ApplyResult result = nvml_.apply_profile(gs, profile, log);
+      // Only the outcome; the "Applying profile" line would flood the log.
+      (result.success ? std::clog : std::cerr)
+          << fmt::format("Live: {}", log.back()) << std::endl;
+    }
+    lock.lock();
+    writing_ = false;
+    idle_.notify_all();
+  }
+}
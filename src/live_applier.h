@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Applies OC slider changes to the hardware while tuning. Changes are
+// coalesced into one pending profile per GPU and written on a worker thread
+// once the slider has rested for a moment, so dragging a slider does not
+// queue up dozens of NVML writes.
+class LiveApplier {
+ public:
+  explicit LiveApplier(NvmlManager& nvml);
+  ~LiveApplier();
+
+  LiveApplier(const LiveApplier&) = delete;
+  LiveApplier& operator=(const LiveApplier&) = delete;
+
+  /**
+   * @brief Queue `profile` for GPU `gpu_index`, replacing any pending one.
+   */
+  void submit(size_t gpu_index, const OcProfile& profile);
+
+  /**
+   * @brief The hardware now matches what was saved; nothing to revert.
+   */
+  void mark_saved();
+
+  /**
+   * @brief Drop pending writes and write `saved` back to every GPU changed
+   * since the last mark_saved(). Blocks until done.
+   * @param saved profiles keyed by UUID.
+   */
+  void revert(const std::map<std::string, OcProfile>& saved);
+
+ private:
+  struct Pending {
+    OcProfile profile;
+    std::chrono::steady_clock::time_point first_change;
+    std::chrono::steady_clock::time_point last_change;
+  };
+
+  void run();
+
+  NvmlManager& nvml_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::map<size_t, Pending> pending_;  // by GPU index
+  std::set<size_t> touched_;           // written since the last save
+  bool writing_ = false;
+  bool stop_ = false;
+
+  std::thread thread_;
+};
@@ -3,6 +3,9 @@
 #include <unistd.h>     // For geteuid()
 #endif
 
+#include <atomic>
+#include <csignal>
+
 #include <fmt/chrono.h>
 #include <fmt/core.h>
 
@@ -11,13 +14,23 @@
 #include <ftxui/component/loop.hpp>
 #include <ftxui/component/screen_interactive.hpp>
 #include <iostream>
+#include <thread>
 
 #include "components/dashboard.h"
+#include "components/frame_profiler.h"
 #include "components/graphs_tab.h"
 #include "components/log_console.h"
 #include "components/oc_tab.h"
+#include "components/power_curve_tab.h"
+#include "components/residency_tab.h"
 #include "components/sparklines.h"
+#include "apply_daemon.h"
+#include "auto_tuner.h"
+#include "cli_options.h"
+#include "cluster.h"
 #include "nvtuner.h"
+#include "oc_watchdog.h"
+#include "sample_ticker.h"
 #include "stream_redirect.h"
 #include "sys_utils.h"
 
@@ -27,7 +40,185 @@ using namespace ftxui;
 #define APP_VERSION "unknown"
 #endif
 
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void stop_on_signals() {
+  std::signal(SIGINT, [](int) { stop_requested = true; });
+  std::signal(SIGTERM, [](int) { stop_requested = true; });
+}
+
+// --agent: headless, stops on SIGINT/SIGTERM.
+int run_agent(const CliOptions& options) {
+  std::unique_ptr<NvmlManager> nvml;
+  try {
+    nvml = std::make_unique<NvmlManager>(options.simulate_gpus);
+  } catch (const std::exception& e) {
+    std::cerr << "Fatal: Cannot initialize NVML: " << e.what() << std::endl;
+    return 1;
+  }
+  nvml->log_init_summary();
+
+  try {
+    ClusterAgent agent(*nvml, options.agent_endpoint);
+    stop_on_signals();
+    agent.run(stop_requested);
+  } catch (const std::exception& e) {
+    std::cerr << "Fatal: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// --auto-tune: headless, prints progress to the terminal.
+int run_auto_tune(const CliOptions& options, NvmlManager& nvml,
+                  const std::string& profile_path) {
+  const auto& gpus = nvml.get_gpus();
+  size_t index = static_cast<size_t>(options.auto_tune_gpu);
+  if (index >= gpus.size()) {
+    std::cerr << fmt::format("No GPU with index {}.", index) << std::endl;
+    return 1;
+  }
+
+  // Simulated GPUs are tuned in simulated time, so the search finishes at
+  // once instead of taking half an hour.
+  std::unique_ptr<TuningBackend> backend;
+  if (nvml.is_simulated()) {
+    backend = std::make_unique<SimulatedTuningBackend>(
+        static_cast<unsigned int>(gpus.size()), index);
+  } else {
+    backend = std::make_unique<NvmlTuningBackend>(nvml, index);
+  }
+
+  ProfileManager pm(profile_path, gpus);
+  OcProfile& profile = pm.get_profile(gpus[index].uuid);
+  AutoTuner tuner(*backend);
+  TuningResult result = tuner.run(profile);
+  if (!result.success) {
+    return 1;
+  }
+
+  profile = result.profile;
+  pm.save();
+  std::clog << fmt::format(
+                   "Tuned GPU {} in {} evaluations: {:.3f} -> {:.3f} perf/W "
+                   "({:.0f}W -> {:.0f}W, {:.0f}% of the performance).\n"
+                   "Saved profile: {}W, {:+}MHz, max {}MHz.",
+                   index, result.evaluations,
+                   result.baseline.perf_per_watt(), result.best.perf_per_watt(),
+                   result.baseline.power_w, result.best.power_w,
+                   result.best.perf() / result.baseline.perf() * 100,
+                   profile.power_limit, profile.gpu_clock_offset,
+                   profile.max_gpu_clock)
+            << std::endl;
+  return 0;
+}
+
+// --classify: headless, one line per GPU for job wrappers to print.
+int run_classify(NvmlManager& nvml) {
+  stop_on_signals();
+  // The first sample was taken by the NvmlManager constructor.
+  for (int i = 1; i < BottleneckClassifier::WINDOW_S && !stop_requested;
+       ++i) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    nvml.update_dynamic_state();
+  }
+  for (const auto& gs : nvml.get_gpus()) {
+    std::cout << fmt::format("GPU {}: {}, {}% confidence ({}% util, {}% "
+                             "mem util, {}MHz, {}W)",
+                             gs.index, bottleneck_name(gs.bottleneck),
+                             gs.bottleneck_confidence, gs.gpu_util_percent,
+                             gs.mem_util_percent, gs.gpu_clock_mhz,
+                             gs.power_usage_w)
+              << std::endl;
+  }
+  return 0;
+}
+
+// --connect: the Dashboard over all agents' GPUs. Logs are already redirected.
+int run_cluster_dashboard(ClusterClient& client) {
+  FrameProfiler& frame_profiler = FrameProfiler::instance();
+  std::vector<GpuState> gpus;
+
+  Component log_console = FrameProfiler::Profiled("Log Console", LogConsole());
+  Component dashboard =
+      FrameProfiler::Profiled("Dashboard", Dashboard(gpus));
+  Component main_renderer =
+      Renderer(dashboard, [&dashboard, &log_console, &client, &gpus] {
+        std::string title = fmt::format(
+            "NVTuner {} | Cluster: {}/{} agents connected | {} GPUs",
+            APP_VERSION, client.connected_count(), client.host_count(),
+            gpus.size());
+        return vbox({
+                   text(title) | bold | hcenter,
+                   separator(),
+                   dashboard->Render() | flex,
+                   separator(),
+                   log_console->Render(),
+               }) |
+               border;
+      });
+
+  auto screen = ScreenInteractive::Fullscreen();
+  auto catch_event =
+      CatchEvent(frame_profiler.Overlay(main_renderer), [&](Event event) {
+        if (event == Event::Character('q')) {
+          screen.ExitLoopClosure()();
+          return true;
+        }
+        return false;
+      });
+
+  // Agents send at most one update per second per host; syncing twice as
+  // often keeps the latency low without redrawing for nothing.
+  client.sync(gpus);
+  SampleTicker ticker(screen, std::chrono::milliseconds(500),
+                      [&] { client.sync(gpus); });
+  screen.Loop(catch_event);
+  return 0;
+}
+
+}  // namespace
+
 int main(int argc, char* argv[]) {
+  CliOptions options;
+  try {
+    options = parse_cli_options(argc, argv);
+    for (const auto& endpoint : options.connect_endpoints) {
+      parse_cluster_endpoint(endpoint);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n" << cli_usage();
+    return 1;
+  }
+
+#ifdef _WIN32
+  if (!options.agent_endpoint.empty() || !options.connect_endpoints.empty()) {
+    std::cerr << "Cluster mode is not supported on Windows yet." << std::endl;
+    return 1;
+  }
+#endif
+
+  if (!options.agent_endpoint.empty()) {
+    return run_agent(options);
+  }
+  bool cluster_mode = !options.connect_endpoints.empty();
+
+  if (options.reset_fans) {
+    try {
+      NvmlManager nvml(options.simulate_gpus, false);
+      bool success = true;
+      for (const auto& gs : nvml.get_gpus()) {
+        success = nvml.reset_fans(gs) && success;
+      }
+      return success ? 0 : 1;
+    } catch (const std::exception& e) {
+      std::cerr << "Fatal: Cannot initialize NVML: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
   std::filesystem::path config_dir = SysUtils::get_user_config_path();
   if (config_dir.empty()) {
     std::cerr << "Fatal: Cannot determine user config directory." << std::endl;
@@ -37,20 +228,58 @@ int main(int argc, char* argv[]) {
   std::filesystem::create_directories(config_dir);
   std::filesystem::path profile_path = config_dir / "profiles.json";
   std::filesystem::path log_path = config_dir / "nvtuner.log";
+  std::filesystem::path frame_profile_path = config_dir / "frame_profile.json";
+  std::filesystem::path boot_guard_path = config_dir / "boot_guard";
+  std::filesystem::path recording_dir = config_dir / "recordings";
+
+  if (options.boot_ok) {
+    BootGuard::disarm(boot_guard_path.string());
+    return 0;
+  }
 
   // --------------------------------------------------------------------------
-  // Initialize NVML; deal with --apply-profiles
+  // Initialize NVML; deal with --apply-profiles and --daemon
   // ---------------------------------------------------------------------------
 
+  // The cluster dashboard only shows remote GPUs and does not need NVML.
   std::unique_ptr<NvmlManager> nvml;
   try {
-    nvml = std::make_unique<NvmlManager>();
+    // Applying profiles only needs the static info; skip the first sample.
+    if (!cluster_mode) {
+      nvml = std::make_unique<NvmlManager>(
+          options.simulate_gpus, !options.apply_profiles && !options.daemon);
+    }
   } catch (const std::exception& e) {
     std::cerr << "Fatal: Cannot initialize NVML: " << e.what() << std::endl;
     return 1;
   }
+  // The TUI logs it once the log file is set up, below.
+  bool headless = options.daemon || options.apply_profiles ||
+                  options.auto_tune_gpu >= 0 || options.classify;
+  if (nvml && headless) {
+    nvml->log_init_summary();
+  }
+
+  if (options.daemon && nvml) {
+    try {
+      ApplyDaemon daemon(*nvml, profile_path.string(),
+                         SysUtils::get_user_name(),
+                         options.boot ? boot_guard_path.string() : "",
+                         recording_dir.string());
+      stop_on_signals();
+      daemon.run(stop_requested);
+    } catch (const std::exception& e) {
+      std::cerr << "Fatal: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
 
-  if (argc == 2 && std::string(argv[1]) == "--apply-profiles") {
+  if (options.apply_profiles && nvml) {
+    if (options.boot) {
+      BootGuard::check_and_arm(nvml->get_gpus(), profile_path.string(),
+                               boot_guard_path.string());
+    }
     ProfileManager pm(profile_path.string(), nvml->get_gpus());
     bool success = nvml->apply_profiles(pm.get_all_profiles());
     std::clog.flush();
@@ -59,6 +288,14 @@ int main(int argc, char* argv[]) {
     return success ? 0 : 1;
   }
 
+  if (options.auto_tune_gpu >= 0 && nvml) {
+    return run_auto_tune(options, *nvml, profile_path.string());
+  }
+
+  if (options.classify && nvml) {
+    return run_classify(*nvml);
+  }
+
   // ---------------------------------------------------------------------------
   // Redirect logs to file
   // ---------------------------------------------------------------------------
@@ -73,8 +310,9 @@ int main(int argc, char* argv[]) {
              << " ---\n"
              << std::endl;
   }
-  LogStreamBuffer clog_log_buffer("[Msg] ", log_file);
-  LogStreamBuffer cerr_log_buffer("[Err] ", log_file);
+  LogWriter log_writer(log_file);
+  LogStreamBuffer clog_log_buffer("[Msg] ", log_writer);
+  LogStreamBuffer cerr_log_buffer("[Err] ", log_writer);
   StreamRedirector redirect_clog(std::clog, &clog_log_buffer);
   StreamRedirector redirect_cerr(std::cerr, &cerr_log_buffer);
 
@@ -83,6 +321,31 @@ int main(int argc, char* argv[]) {
               << std::endl;
   }
 
+  // The terminal is drawn through std::cout; time it for the frame profiler.
+  TimedStreamBuffer cout_timer(std::cout.rdbuf());
+  StreamRedirector redirect_cout(std::cout, &cout_timer);
+
+  FrameProfiler& frame_profiler = FrameProfiler::instance();
+  frame_profiler.set_output_timer(&cout_timer);
+  frame_profiler.set_export_path(frame_profile_path.string());
+  frame_profiler.set_enabled(options.profile_frames);
+
+  if (cluster_mode) {
+    int ret;
+    {
+      ClusterClient client(options.connect_endpoints);
+      ret = run_cluster_dashboard(client);
+    }
+    if (options.profile_frames && frame_profiler.export_json()) {
+      std::clog << fmt::format("Frame profile exported to {}.",
+                               frame_profile_path.string())
+                << std::endl;
+    }
+    return ret;
+  }
+
+  nvml->log_init_summary();
+
   // ---------------------------------------------------------------------------
   // Load profiles
   // ---------------------------------------------------------------------------
@@ -93,10 +356,11 @@ int main(int argc, char* argv[]) {
   // FTXUI
   // ---------------------------------------------------------------------------
 
-  Component log_console = LogConsole();
+  Component log_console = FrameProfiler::Profiled("Log Console", LogConsole());
 
-  Component dashboard = Dashboard(nvml->get_gpus());
-  Component dashboard_tab = Renderer([&dashboard, &log_console]() {
+  Component dashboard =
+      FrameProfiler::Profiled("Dashboard", Dashboard(nvml->get_gpus()));
+  Component dashboard_tab = Renderer(dashboard, [&dashboard, &log_console]() {
     return vbox({
         dashboard->Render() | flex,
         separator(),
@@ -108,6 +372,10 @@ int main(int argc, char* argv[]) {
 
   Sparklines sparklines(nvml->get_gpus());
 
+  PowerCurveTab power_curve_tab(nvml->get_gpus(), pm);
+
+  ResidencyTab residency_tab(nvml->get_gpus());
+
   OCTab oc(pm, *nvml);
   auto oc_tab = Renderer(oc.get_component(), [&oc, &log_console]() {
     return vbox({
@@ -140,14 +408,17 @@ int main(int argc, char* argv[]) {
     });
   });
 
-  std::vector<std::string> tab_values{"Dashboard", "Graphs", "Sparklines",
-                                      "OC Profiles", "About"};
+  std::vector<std::string> tab_values{"Dashboard",   "Graphs",
+                                      "Sparklines",  "Residency",
+                                      "Power Curve", "OC Profiles",
+                                      "About"};
   int tab_selected = 0;
   auto tab_toggle = Toggle(&tab_values, &tab_selected);
-  auto tab_container =
-      Container::Tab({dashboard_tab, graphs_tab.get_component(),
-                      sparklines.get_component(), oc_tab, about_tab},
-                     &tab_selected);
+  auto tab_container = Container::Tab(
+      {dashboard_tab, graphs_tab.get_component(), sparklines.get_component(),
+       residency_tab.get_component(), power_curve_tab.get_component(), oc_tab,
+       about_tab},
+      &tab_selected);
 
   auto main_container = Container::Vertical({tab_toggle, tab_container});
 
@@ -174,7 +445,9 @@ int main(int argc, char* argv[]) {
   auto screen = ScreenInteractive::Fullscreen();
   // auto screen = ScreenInteractive::TerminalOutput();
 
-  auto catch_event = CatchEvent(main_renderer, [&](Event event) {
+  auto profiled_renderer = frame_profiler.Overlay(main_renderer);
+
+  auto catch_event = CatchEvent(profiled_renderer, [&](Event event) {
     if (event == Event::Character('q')) {
       screen.ExitLoopClosure()();
       return true;
@@ -182,25 +455,77 @@ int main(int argc, char* argv[]) {
     return false;
   });
 
-  // Loop loop(&screen, main_renderer);
-  Loop loop(&screen, catch_event);
-
-  unsigned long long frame_count = 0;
   nvml->update_dynamic_state();
   graphs_tab.update();
+  power_curve_tab.update();
+  residency_tab.update();
   sparklines.update();
-  while (!loop.HasQuitted()) {
-    frame_count++;
-    if (frame_count % 30 == 0) {
+
+  auto session_start = std::chrono::steady_clock::now();
+  auto last_cpu_report = session_start;
+  double cpu_start = SysUtils::get_process_cpu_seconds();
+  auto report_cpu_usage = [&] {
+    double minutes = std::chrono::duration<double, std::ratio<60>>(
+                         std::chrono::steady_clock::now() - session_start)
+                         .count();
+    double cpu_seconds = SysUtils::get_process_cpu_seconds() - cpu_start;
+    std::clog << fmt::format(
+                     "CPU time: {:.2f}s over {:.1f}min ({:.2f}s per hour, {} "
+                     "rendering).",
+                     cpu_seconds, minutes,
+                     minutes > 0 ? cpu_seconds * 60 / minutes : 0.0,
+                     options.continuous_render ? "continuous" : "on-demand")
+              << std::endl;
+  };
+
+  if (options.continuous_render) {
+    Loop loop(&screen, catch_event);
+
+    unsigned long long frame_count = 0;
+    while (!loop.HasQuitted()) {
+      frame_count++;
+      if (frame_count % 30 == 0) {
+        nvml->update_dynamic_state();
+        graphs_tab.update();
+        power_curve_tab.update();
+        residency_tab.update();
+      }
+      if (frame_count % 60 == 0) {
+        sparklines.update();
+      }
+      screen.RequestAnimationFrame();
+      loop.RunOnce();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
+    }
+  } else {
+    // Graphs take a sample per tick and sparklines every other tick, same as
+    // the 60 fps loop did. The relative clock event labels ("PC:12s") change
+    // at most once per second, so the sample ticks also keep them fresh.
+    unsigned long long tick_count = 0;
+    SampleTicker ticker(screen, std::chrono::milliseconds(500), [&] {
+      tick_count++;
       nvml->update_dynamic_state();
       graphs_tab.update();
-    }
-    if (frame_count % 60 == 0) {
-      sparklines.update();
-    }
-    screen.RequestAnimationFrame();
-    loop.RunOnce();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
+      power_curve_tab.update();
+      residency_tab.update();
+      if (tick_count % 2 == 0) {
+        sparklines.update();
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_cpu_report >= std::chrono::hours(1)) {
+        last_cpu_report = now;
+        report_cpu_usage();
+      }
+    });
+    screen.Loop(catch_event);
+  }
+
+  oc.revert_live_changes();
+  report_cpu_usage();
+  if (options.profile_frames && frame_profiler.export_json()) {
+    std::clog << fmt::format("Frame profile exported to {}.",
+                             frame_profile_path.string())
+              << std::endl;
   }
 
   return 0;
@@ -6,6 +6,11 @@ decltype(&nvmlDeviceGetClockOffsets) nvmlDeviceGetClockOffsets_p = nullptr;
 decltype(&nvmlDeviceSetClockOffsets) nvmlDeviceSetClockOffsets_p = nullptr;
 decltype(&nvmlDeviceGetFanSpeedRPM) nvmlDeviceGetFanSpeedRPM_p = nullptr;
 decltype(&nvmlDeviceGetTemperatureV) nvmlDeviceGetTemperatureV_p = nullptr;
+decltype(&nvmlDeviceGetNumFans) nvmlDeviceGetNumFans_p = nullptr;
+decltype(&nvmlDeviceGetMinMaxFanSpeed) nvmlDeviceGetMinMaxFanSpeed_p = nullptr;
+decltype(&nvmlDeviceSetFanSpeed_v2) nvmlDeviceSetFanSpeed_v2_p = nullptr;
+decltype(&nvmlDeviceSetDefaultFanSpeed_v2) nvmlDeviceSetDefaultFanSpeed_v2_p =
+    nullptr;
 
 #if defined(_WIN32) && defined(_MSC_VER)
 #include <windows.h>
@@ -27,6 +32,17 @@ void initialize_nvml_compat() {
   nvmlDeviceGetTemperatureV_p =
       (decltype(nvmlDeviceGetTemperatureV_p))GetProcAddress(
           hNvml, "nvmlDeviceGetTemperatureV");
+  nvmlDeviceGetNumFans_p = (decltype(nvmlDeviceGetNumFans_p))GetProcAddress(
+      hNvml, "nvmlDeviceGetNumFans");
+  nvmlDeviceGetMinMaxFanSpeed_p =
+      (decltype(nvmlDeviceGetMinMaxFanSpeed_p))GetProcAddress(
+          hNvml, "nvmlDeviceGetMinMaxFanSpeed");
+  nvmlDeviceSetFanSpeed_v2_p =
+      (decltype(nvmlDeviceSetFanSpeed_v2_p))GetProcAddress(
+          hNvml, "nvmlDeviceSetFanSpeed_v2");
+  nvmlDeviceSetDefaultFanSpeed_v2_p =
+      (decltype(nvmlDeviceSetDefaultFanSpeed_v2_p))GetProcAddress(
+          hNvml, "nvmlDeviceSetDefaultFanSpeed_v2");
 }
 
 #else
@@ -39,12 +55,26 @@ __attribute__((weak)) nvmlReturn_t
 nvmlDeviceGetFanSpeedRPM(nvmlDevice_t device, nvmlFanSpeedInfo_t* fanSpeedInfo);
 __attribute__((weak)) nvmlReturn_t
 nvmlDeviceGetTemperatureV(nvmlDevice_t device, nvmlTemperature_t* tempInfo);
+__attribute__((weak)) nvmlReturn_t nvmlDeviceGetNumFans(nvmlDevice_t device,
+                                                        unsigned int* numFans);
+__attribute__((weak)) nvmlReturn_t
+nvmlDeviceGetMinMaxFanSpeed(nvmlDevice_t device, unsigned int* minSpeed,
+                            unsigned int* maxSpeed);
+__attribute__((weak)) nvmlReturn_t
+nvmlDeviceSetFanSpeed_v2(nvmlDevice_t device, unsigned int fan,
+                         unsigned int speed);
+__attribute__((weak)) nvmlReturn_t
+nvmlDeviceSetDefaultFanSpeed_v2(nvmlDevice_t device, unsigned int fan);
 
 void initialize_nvml_compat() {
   nvmlDeviceGetClockOffsets_p = &nvmlDeviceGetClockOffsets;
   nvmlDeviceSetClockOffsets_p = &nvmlDeviceSetClockOffsets;
   nvmlDeviceGetFanSpeedRPM_p = &nvmlDeviceGetFanSpeedRPM;
   nvmlDeviceGetTemperatureV_p = &nvmlDeviceGetTemperatureV;
+  nvmlDeviceGetNumFans_p = &nvmlDeviceGetNumFans;
+  nvmlDeviceGetMinMaxFanSpeed_p = &nvmlDeviceGetMinMaxFanSpeed;
+  nvmlDeviceSetFanSpeed_v2_p = &nvmlDeviceSetFanSpeed_v2;
+  nvmlDeviceSetDefaultFanSpeed_v2_p = &nvmlDeviceSetDefaultFanSpeed_v2;
 }
 
 #endif
@@ -8,6 +8,11 @@ extern decltype(&nvmlDeviceGetClockOffsets) nvmlDeviceGetClockOffsets_p;
 extern decltype(&nvmlDeviceSetClockOffsets) nvmlDeviceSetClockOffsets_p;
 extern decltype(&nvmlDeviceGetFanSpeedRPM) nvmlDeviceGetFanSpeedRPM_p;
 extern decltype(&nvmlDeviceGetTemperatureV) nvmlDeviceGetTemperatureV_p;
+extern decltype(&nvmlDeviceGetNumFans) nvmlDeviceGetNumFans_p;
+extern decltype(&nvmlDeviceGetMinMaxFanSpeed) nvmlDeviceGetMinMaxFanSpeed_p;
+extern decltype(&nvmlDeviceSetFanSpeed_v2) nvmlDeviceSetFanSpeed_v2_p;
+extern decltype(&nvmlDeviceSetDefaultFanSpeed_v2)
+    nvmlDeviceSetDefaultFanSpeed_v2_p;
 
 void initialize_nvml_compat();
 #else
@@ -15,6 +20,10 @@ inline constexpr std::nullptr_t nvmlDeviceGetClockOffsets_p = nullptr;
 inline constexpr std::nullptr_t nvmlDeviceSetClockOffsets_p = nullptr;
 inline constexpr std::nullptr_t nvmlDeviceGetFanSpeedRPM_p = nullptr;
 inline constexpr std::nullptr_t nvmlDeviceGetTemperatureV_p = nullptr;
+inline constexpr std::nullptr_t nvmlDeviceGetNumFans_p = nullptr;
+inline constexpr std::nullptr_t nvmlDeviceGetMinMaxFanSpeed_p = nullptr;
+inline constexpr std::nullptr_t nvmlDeviceSetFanSpeed_v2_p = nullptr;
+inline constexpr std::nullptr_t nvmlDeviceSetDefaultFanSpeed_v2_p = nullptr;
 
 inline void initialize_nvml_compat() {}
 #endif
@@ -3,12 +3,17 @@
 #include <fmt/chrono.h>
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <regex>
 #include <stdexcept>
 
+#include "gpu_simulator.h"
 #include "nlohmann/json.hpp"
 #include "nvml_compat.h"
 
@@ -18,11 +23,80 @@
 
 using json = nlohmann::json;
 
+namespace {
+// The highest P-state NVML defines; clocks drop as the number grows.
+const int LAST_PSTATE = NVML_PSTATE_15;
+
+/**
+ * @brief Read the offset range of one clock in one P-state.
+ * @return false if the driver cannot report it; the range is then 0..0.
+ */
+bool get_clock_offset_range(nvmlDevice_t handle, nvmlClockType_t type,
+                            int pstate, int& min_mhz, int& max_mhz) {
+  nvmlClockOffset_t clock_info;
+  clock_info.version = nvmlClockOffset_v1;
+  clock_info.type = type;
+  clock_info.pstate = static_cast<nvmlPstates_t>(pstate);
+  if (nvmlDeviceGetClockOffsets_p(handle, &clock_info) != NVML_SUCCESS) {
+    min_mhz = 0;
+    max_mhz = 0;
+    return false;
+  }
+  min_mhz = clock_info.minClockOffsetMHz;
+  max_mhz = clock_info.maxClockOffsetMHz;
+  return true;
+}
+
+/**
+ * @brief Set one clock offset in one P-state, skipping the write if it
+ * already matches.
+ */
+nvmlReturn_t set_clock_offset(nvmlDevice_t handle, nvmlClockType_t type,
+                              int pstate, int offset_mhz, int& writes) {
+  nvmlClockOffset_t clock_offset_info;
+  clock_offset_info.version = nvmlClockOffset_v1;
+  clock_offset_info.type = type;
+  clock_offset_info.pstate = static_cast<nvmlPstates_t>(pstate);
+  bool matches =
+      nvmlDeviceGetClockOffsets_p &&
+      nvmlDeviceGetClockOffsets_p(handle, &clock_offset_info) ==
+          NVML_SUCCESS &&
+      clock_offset_info.clockOffsetMHz == offset_mhz;
+  if (matches) {
+    return NVML_SUCCESS;
+  }
+  clock_offset_info.version = nvmlClockOffset_v1;
+  clock_offset_info.type = type;
+  clock_offset_info.pstate = static_cast<nvmlPstates_t>(pstate);
+  clock_offset_info.clockOffsetMHz = offset_mhz;
+  writes++;
+  return nvmlDeviceSetClockOffsets_p(handle, &clock_offset_info);
+}
+}  // namespace
+
 // --- NvmlManager Implementation ---
 
-NvmlManager::NvmlManager() {
+NvmlManager::NvmlManager(unsigned int simulated_gpu_count,
+                         bool read_dynamic_state) {
+  if (simulated_gpu_count > 0) {
+    simulator_ = std::make_unique<GpuSimulator>(simulated_gpu_count);
+    driver_version_ = "simulated";
+    nvml_version_ = "simulated";
+    cuda_version_ = 0;
+    gpus_ = simulator_->create_gpus();
+    if (read_dynamic_state) {
+      update_dynamic_state();
+    }
+    return;
+  }
+
   initialize_nvml_compat();
+  // Without persistence mode, this is where the driver sets up every GPU
+  // that no other client holds open.
+  auto init_start = std::chrono::steady_clock::now();
   check(nvmlInit_v2(), "Failed to initialize NVML");
+  init_duration_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - init_start);
 
   // Get system-wide info
   char driver_buf[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
@@ -83,18 +157,9 @@ NvmlManager::NvmlManager() {
     }
 
     if (nvmlDeviceGetClockOffsets_p) {
-      nvmlClockOffset_t clock_info;
-      clock_info.version = nvmlClockOffset_v1;
-      clock_info.type = NVML_CLOCK_GRAPHICS;
-      clock_info.pstate = NVML_PSTATE_0;
-      if (nvmlDeviceGetClockOffsets_p(gpu.handle, &clock_info) ==
-          NVML_SUCCESS) {
-        gpu.clock_offset_min_mhz = clock_info.minClockOffsetMHz;
-        gpu.clock_offset_max_mhz = clock_info.maxClockOffsetMHz;
-      } else {
-        gpu.clock_offset_min_mhz = 0;
-        gpu.clock_offset_max_mhz = 0;
-      }
+      get_clock_offset_range(gpu.handle, NVML_CLOCK_GRAPHICS, NVML_PSTATE_0,
+                             gpu.clock_offset_min_mhz,
+                             gpu.clock_offset_max_mhz);
     } else {
       if (nvmlDeviceGetGpcClkMinMaxVfOffset(
               gpu.handle, &gpu.clock_offset_min_mhz,
@@ -106,15 +171,118 @@ NvmlManager::NvmlManager() {
     // gpu.clock_offset_min_mhz = (std::max)(gpu.clock_offset_min_mhz, -180);
     // gpu.clock_offset_max_mhz = (std::min)(gpu.clock_offset_max_mhz, 180);
 
+    gpu.mem_clock_offset_min_mhz = 0;
+    gpu.mem_clock_offset_max_mhz = 0;
+    if (nvmlDeviceGetClockOffsets_p) {
+      get_clock_offset_range(gpu.handle, NVML_CLOCK_MEM, NVML_PSTATE_0,
+                             gpu.mem_clock_offset_min_mhz,
+                             gpu.mem_clock_offset_max_mhz);
+
+      // Mid-load work runs in the intermediate P-states, which have offsets
+      // of their own. Most boards only expose a few of them.
+      for (int pstate = NVML_PSTATE_1; pstate <= LAST_PSTATE; ++pstate) {
+        PstateOffsetRange range{pstate, 0, 0, 0, 0};
+        get_clock_offset_range(gpu.handle, NVML_CLOCK_GRAPHICS, pstate,
+                               range.gpu_min_mhz, range.gpu_max_mhz);
+        get_clock_offset_range(gpu.handle, NVML_CLOCK_MEM, pstate,
+                               range.mem_min_mhz, range.mem_max_mhz);
+        if (range.gpu_min_mhz != range.gpu_max_mhz ||
+            range.mem_min_mhz != range.mem_max_mhz) {
+          gpu.pstate_offset_ranges.push_back(range);
+        }
+      }
+    } else if (nvmlDeviceGetMemClkMinMaxVfOffset(
+                   gpu.handle, &gpu.mem_clock_offset_min_mhz,
+                   &gpu.mem_clock_offset_max_mhz) != NVML_SUCCESS) {
+      gpu.mem_clock_offset_min_mhz = 0;
+      gpu.mem_clock_offset_max_mhz = 0;
+    }
+
+    unsigned int mem_clock_count = 0;
+    if (nvmlDeviceGetSupportedMemoryClocks(gpu.handle, &mem_clock_count,
+                                           nullptr) ==
+        NVML_ERROR_INSUFFICIENT_SIZE) {
+      std::vector<unsigned int> clocks(mem_clock_count);
+      if (nvmlDeviceGetSupportedMemoryClocks(gpu.handle, &mem_clock_count,
+                                             clocks.data()) == NVML_SUCCESS) {
+        gpu.mem_clocks_mhz.assign(clocks.begin(),
+                                  clocks.begin() + mem_clock_count);
+        std::sort(gpu.mem_clocks_mhz.begin(), gpu.mem_clocks_mhz.end());
+      }
+    }
+
+    // Graphics clocks depend on the memory clock; the top one offers them
+    // all.
+    unsigned int gpu_clock_count = 0;
+    unsigned int top_mem_clock =
+        gpu.mem_clocks_mhz.empty() ? 0 : gpu.mem_clocks_mhz.back();
+    if (!gpu.mem_clocks_mhz.empty() &&
+        nvmlDeviceGetSupportedGraphicsClocks(gpu.handle, top_mem_clock,
+                                             &gpu_clock_count, nullptr) ==
+            NVML_ERROR_INSUFFICIENT_SIZE) {
+      std::vector<unsigned int> clocks(gpu_clock_count);
+      if (nvmlDeviceGetSupportedGraphicsClocks(gpu.handle, top_mem_clock,
+                                               &gpu_clock_count,
+                                               clocks.data()) ==
+          NVML_SUCCESS) {
+        gpu.gpu_clocks_mhz.assign(clocks.begin(),
+                                  clocks.begin() + gpu_clock_count);
+        std::sort(gpu.gpu_clocks_mhz.begin(), gpu.gpu_clocks_mhz.end());
+      }
+    }
+
+    ret = nvmlDeviceGetTemperatureThreshold(
+        gpu.handle, NVML_TEMPERATURE_THRESHOLD_SLOWDOWN, &val);
+    gpu.slowdown_temp_c = (ret == NVML_SUCCESS) ? val : -1;
+
     gpus_.push_back(gpu);
   }
 
-  update_dynamic_state();
+  for (const auto& gpu : gpus_) {
+    nvmlEnableState_t persistence;
+    if (nvmlDeviceGetPersistenceMode(gpu.handle, &persistence) ==
+            NVML_SUCCESS &&
+        persistence == NVML_FEATURE_ENABLED) {
+      persistent_count_++;
+    }
+  }
+
+  if (read_dynamic_state) {
+    update_dynamic_state();
+  }
+}
+
+void NvmlManager::log_init_summary() const {
+  if (is_simulated()) {
+    return;
+  }
+  std::clog << fmt::format(
+                   "NVML initialized in {:.1f}ms with persistence mode on "
+                   "for {}/{} GPUs.",
+                   init_duration_.count() / 1000.0, persistent_count_,
+                   gpus_.size())
+            << std::endl;
 }
 
-NvmlManager::~NvmlManager() { nvmlShutdown(); }
+NvmlManager::~NvmlManager() {
+  if (!simulator_) {
+    if (xid_events_) {
+      nvmlEventSetFree(xid_events_);
+    }
+    nvmlShutdown();
+  }
+}
 
 void NvmlManager::update_dynamic_state() {
+  for (auto& gpu : gpus_) {
+    gpu.sample_generation++;
+  }
+  if (simulator_) {
+    simulator_->update(gpus_);
+    update_derived_state();
+    return;
+  }
+
   for (auto& gpu : gpus_) {
     unsigned int val;
     nvmlReturn_t ret;
@@ -174,7 +342,18 @@ void NvmlManager::update_dynamic_state() {
     ret = nvmlDeviceGetClockInfo(gpu.handle, NVML_CLOCK_GRAPHICS, &val);
     gpu.gpu_clock_mhz = (ret == NVML_SUCCESS) ? val : -1;
 
-    unsigned long long reasons;
+    nvmlPstates_t pstate;
+    ret = nvmlDeviceGetPerformanceState(gpu.handle, &pstate);
+    gpu.pstate = (ret == NVML_SUCCESS && pstate != NVML_PSTATE_UNKNOWN)
+                     ? static_cast<int>(pstate)
+                     : -1;
+
+    nvmlEnableState_t persistence;
+    ret = nvmlDeviceGetPersistenceMode(gpu.handle, &persistence);
+    gpu.persistence_mode =
+        (ret == NVML_SUCCESS) ? (persistence == NVML_FEATURE_ENABLED) : -1;
+
+    unsigned long long reasons = 0;
     if (nvmlDeviceGetCurrentClocksEventReasons(gpu.handle, &reasons) ==
         NVML_SUCCESS) {
       auto now = std::chrono::system_clock::now();
@@ -188,88 +367,474 @@ void NvmlManager::update_dynamic_state() {
         gpu.last_event_hwt_slowdown_time = now;
       }
     }
+    gpu.clock_event_reasons = reasons;
+  }
+  update_derived_state();
+}
+
+void NvmlManager::update_derived_state() {
+  auto now = std::chrono::steady_clock::now();
+  double dt_s = std::chrono::duration<double>(now - last_sample_time_).count();
+  last_sample_time_ = now;
+  forecasters_.resize(gpus_.size());
+  classifiers_.resize(gpus_.size());
+  for (size_t i = 0; i < gpus_.size(); ++i) {
+    GpuState& gpu = gpus_[i];
+    forecasters_[i].add_sample(dt_s, gpu.temperature_c, gpu.power_usage_w);
+    gpu.seconds_to_slowdown = forecasters_[i].seconds_to(gpu.slowdown_temp_c);
+
+    int power_limit_w = gpu.enforced_power_limit_w >= 0
+                            ? gpu.enforced_power_limit_w
+                            : gpu.power_limit_w;
+    classifiers_[i].add_sample(
+        dt_s,
+        {gpu.gpu_util_percent, gpu.mem_util_percent, gpu.gpu_clock_mhz,
+         gpu.gpu_max_clock_mhz, gpu.power_usage_w, power_limit_w,
+         gpu.clock_event_reasons});
+    gpu.bottleneck = classifiers_[i].bottleneck();
+    gpu.bottleneck_confidence = classifiers_[i].confidence();
   }
 }
 
 bool NvmlManager::apply_profiles(
-    const std::map<std::string, OcProfile>& profiles) {
+    const std::map<std::string, OcProfile>& profiles,
+    std::vector<ApplyResult>* results) {
   std::clog << fmt::format("Applying profiles for {} GPUs.", gpus_.size())
             << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  if (results) {
+    results->clear();
+  }
+
+  // NVML calls are thread-safe and each one can take milliseconds, so GPUs
+  // are done concurrently. Logs are kept per GPU to print them in order.
+  std::vector<std::vector<std::string>> logs(gpus_.size());
+  std::vector<std::future<ApplyResult>> futures;
+  for (size_t i = 0; i < gpus_.size(); ++i) {
+    const GpuState& gs = gpus_[i];
+    const OcProfile& profile = profiles.at(gs.uuid);
+    futures.push_back(std::async(
+        gpus_.size() > 1 ? std::launch::async : std::launch::deferred,
+        [this, &gs, &profile, &log = logs[i]] {
+          return apply_profile(gs, profile, log);
+        }));
+  }
 
   bool all_successful = true;
+  for (size_t i = 0; i < futures.size(); ++i) {
+    ApplyResult result = futures[i].get();
+    for (size_t j = 0; j < logs[i].size(); ++j) {
+      bool failure_line = !result.success && j + 1 == logs[i].size();
+      (failure_line ? std::cerr : std::clog) << logs[i][j] << std::endl;
+    }
+    all_successful = all_successful && result.success;
+    if (results) {
+      results->push_back(result);
+    }
+  }
 
-  for (const GpuState& gs : gpus_) {
-    const OcProfile& profile = profiles.at(gs.uuid);
+  std::clog << fmt::format(
+                   "Applied profiles in {:.1f}ms.",
+                   std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count())
+            << std::endl;
+  return all_successful;
+}
 
-    if (profile.power_limit == gs.power_limit_default_w &&
-        profile.gpu_clock_offset == 0 &&
-        profile.max_gpu_clock == gs.gpu_max_clock_mhz) {
-      std::clog << fmt::format(
-                       "Resetting OC for GPU {} because profile is default.",
-                       gs.index)
-                << std::endl;
-    } else {
-      std::string oc_text =
-          fmt::format("OC ({}W, {:+}MHz, <={}MHz)", profile.power_limit,
-                      profile.gpu_clock_offset, profile.max_gpu_clock);
-      std::clog << fmt::format("Applying profile {} for GPU {}.", oc_text,
-                               gs.index)
-                << std::endl;
+ApplyResult NvmlManager::apply_profile(const GpuState& gs,
+                                       const OcProfile& profile,
+                                       std::vector<std::string>& log) {
+  auto start = std::chrono::steady_clock::now();
+  ApplyResult result{gs.index, true, 0, {}};
+
+  bool mem_unlocked = mem_clocks_unlocked(gs, profile);
+  std::string pstate_text;
+  for (const auto& [pstate, offset] : profile.pstate_clock_offsets) {
+    if (offset != PstateClockOffset{}) {
+      pstate_text +=
+          fmt::format(", P{} {:+}/{:+}MHz", pstate, offset.gpu, offset.mem);
+    }
+  }
+  if (profile.power_limit == gs.power_limit_default_w &&
+      profile.gpu_clock_offset == 0 &&
+      profile.max_gpu_clock == gs.gpu_max_clock_mhz &&
+      !profile.latency_mode && profile.mem_clock_offset == 0 &&
+      mem_unlocked && pstate_text.empty()) {
+    log.push_back(fmt::format(
+        "Resetting OC for GPU {} because profile is default.", gs.index));
+  } else {
+    std::string mem_text;
+    if (profile.mem_clock_offset != 0) {
+      mem_text += fmt::format(", mem {:+}MHz", profile.mem_clock_offset);
+    }
+    if (!mem_unlocked) {
+      mem_text += fmt::format(", mem {}-{}MHz", profile.min_mem_clock,
+                              profile.max_mem_clock);
     }
+    std::string clock_text =
+        profile.latency_mode ? fmt::format("{}-{}MHz", profile.min_gpu_clock,
+                                           profile.max_gpu_clock)
+                             : fmt::format("<={}MHz", profile.max_gpu_clock);
+    std::string oc_text = fmt::format(
+        "OC ({}W, {:+}MHz, {}{}{})", profile.power_limit,
+        profile.gpu_clock_offset, clock_text, mem_text, pstate_text);
+    log.push_back(
+        fmt::format("Applying profile {} for GPU {}.", oc_text, gs.index));
+  }
+
+  // Read only what the diff needs. Locked clocks have no getter, so they are
+  // always written.
+  nvmlReturn_t ret_pl = NVML_SUCCESS;
+  nvmlReturn_t ret_co = NVML_SUCCESS;
+  nvmlReturn_t ret_lc = NVML_SUCCESS;
+  nvmlReturn_t ret_mo = NVML_SUCCESS;
+  nvmlReturn_t ret_ml = NVML_SUCCESS;
+  nvmlReturn_t ret_pm = NVML_SUCCESS;
+  bool enabled_persistence = false;
 
+  if (simulator_) {
+    OcProfile current = simulator_->get_settings(gs);
+    if (current.power_limit != profile.power_limit) {
+      simulator_->set_power_limit(gs, profile.power_limit);
+      result.writes++;
+    }
+    if (current.gpu_clock_offset != profile.gpu_clock_offset) {
+      simulator_->set_clock_offset(gs, profile.gpu_clock_offset);
+      result.writes++;
+    }
+    simulator_->set_locked_clocks(gs, locked_min_gpu_clock(profile),
+                                  profile.max_gpu_clock);
+    result.writes++;
+    if (current.mem_clock_offset != profile.mem_clock_offset) {
+      simulator_->set_mem_clock_offset(gs, profile.mem_clock_offset);
+      result.writes++;
+    }
+    simulator_->set_mem_locked_clocks(gs, profile.min_mem_clock,
+                                      profile.max_mem_clock);
+    result.writes++;
+    for (const auto& range : gs.pstate_offset_ranges) {
+      PstateClockOffset offset = pstate_clock_offset(profile, range.pstate);
+      if (pstate_clock_offset(current, range.pstate) != offset) {
+        simulator_->set_pstate_clock_offset(gs, range.pstate, offset);
+        result.writes++;
+      }
+    }
+    if (profile.persistence_mode && !current.persistence_mode) {
+      simulator_->set_persistence_mode(gs, true);
+      result.writes++;
+      enabled_persistence = true;
+    }
+  } else {
     // 1. Set Power Limit
-    nvmlReturn_t ret_pl = NVML_SUCCESS;
-    unsigned int dummy_val;
-    if (nvmlDeviceGetPowerManagementLimit(gs.handle, &dummy_val) !=
+    unsigned int current_pl_mw;
+    if (nvmlDeviceGetPowerManagementLimit(gs.handle, &current_pl_mw) !=
         NVML_SUCCESS) {
       // PL setter is unsupported, so skip it
-    } else {
+    } else if (current_pl_mw != static_cast<unsigned int>(
+                                    profile.power_limit * 1000)) {
       ret_pl = nvmlDeviceSetPowerManagementLimit(gs.handle,
                                                  profile.power_limit * 1000);
+      result.writes++;
     }
 
     // 2. Set Clock Offset
-    nvmlReturn_t ret_co;
     if (nvmlDeviceSetClockOffsets_p) {
-      nvmlClockOffset_t clock_offset_info;
-      clock_offset_info.version = nvmlClockOffset_v1;
-      clock_offset_info.type = NVML_CLOCK_GRAPHICS;
-      clock_offset_info.pstate = NVML_PSTATE_0;
-      clock_offset_info.clockOffsetMHz = profile.gpu_clock_offset;
-      ret_co = nvmlDeviceSetClockOffsets_p(gs.handle, &clock_offset_info);
+      ret_co = set_clock_offset(gs.handle, NVML_CLOCK_GRAPHICS, NVML_PSTATE_0,
+                                profile.gpu_clock_offset, result.writes);
     } else {
-      ret_co = nvmlDeviceSetGpcClkVfOffset(gs.handle, profile.gpu_clock_offset);
-      std::clog << "Using deprecated API to set clock offset. Please consider "
-                   "updating the driver for better compatibility."
-                << std::endl;
+      int current_offset;
+      if (nvmlDeviceGetGpcClkVfOffset(gs.handle, &current_offset) !=
+              NVML_SUCCESS ||
+          current_offset != profile.gpu_clock_offset) {
+        ret_co =
+            nvmlDeviceSetGpcClkVfOffset(gs.handle, profile.gpu_clock_offset);
+        result.writes++;
+        log.push_back(
+            "Using deprecated API to set clock offset. Please consider "
+            "updating the driver for better compatibility.");
+      }
     }
 
-    // 3. Set Max Locked Clock
-    nvmlReturn_t ret_lc;
-    if (profile.max_gpu_clock >= gs.gpu_max_clock_mhz) {
+    // 3. Set Locked Clocks
+    int min_clock = locked_min_gpu_clock(profile);
+    if (min_clock == 0 && profile.max_gpu_clock >= gs.gpu_max_clock_mhz) {
       ret_lc = nvmlDeviceResetGpuLockedClocks(gs.handle);
     } else {
-      ret_lc =
-          nvmlDeviceSetGpuLockedClocks(gs.handle, 0, profile.max_gpu_clock);
+      ret_lc = nvmlDeviceSetGpuLockedClocks(gs.handle, min_clock,
+                                            profile.max_gpu_clock);
+    }
+    result.writes++;
+
+    // 4. Set Memory Clock Offset
+    if (nvmlDeviceSetClockOffsets_p) {
+      ret_mo = set_clock_offset(gs.handle, NVML_CLOCK_MEM, NVML_PSTATE_0,
+                                profile.mem_clock_offset, result.writes);
+    } else {
+      int current_offset;
+      if (nvmlDeviceGetMemClkVfOffset(gs.handle, &current_offset) !=
+              NVML_SUCCESS ||
+          current_offset != profile.mem_clock_offset) {
+        ret_mo =
+            nvmlDeviceSetMemClkVfOffset(gs.handle, profile.mem_clock_offset);
+        result.writes++;
+      }
+    }
+    if (ret_mo == NVML_ERROR_NOT_SUPPORTED && profile.mem_clock_offset == 0) {
+      ret_mo = NVML_SUCCESS;  // nothing to undo on boards without it
+    }
+
+    // 4b. Set Clock Offsets of the other P-states. Failures are reported
+    // with the P0 offset of the same clock. Only the newer API has P-state
+    // offsets; without its setter they are skipped, as in steps 2 and 4.
+    if (nvmlDeviceSetClockOffsets_p) {
+      for (const auto& range : gs.pstate_offset_ranges) {
+        PstateClockOffset offset = pstate_clock_offset(profile, range.pstate);
+        if (range.gpu_min_mhz != range.gpu_max_mhz) {
+          nvmlReturn_t ret = set_clock_offset(gs.handle, NVML_CLOCK_GRAPHICS,
+                                              range.pstate, offset.gpu,
+                                              result.writes);
+          if (ret_co == NVML_SUCCESS) {
+            ret_co = ret;
+          }
+        }
+        if (range.mem_min_mhz != range.mem_max_mhz) {
+          nvmlReturn_t ret = set_clock_offset(gs.handle, NVML_CLOCK_MEM,
+                                              range.pstate, offset.mem,
+                                              result.writes);
+          if (ret_mo == NVML_SUCCESS) {
+            ret_mo = ret;
+          }
+        }
+      }
+    }
+
+    // 5. Set Memory Locked Clocks. No getter either, so always written.
+    if (!gs.mem_clocks_mhz.empty()) {
+      if (mem_unlocked) {
+        ret_ml = nvmlDeviceResetMemoryLockedClocks(gs.handle);
+        if (ret_ml == NVML_ERROR_NOT_SUPPORTED) {
+          ret_ml = NVML_SUCCESS;
+        }
+      } else {
+        ret_ml = nvmlDeviceSetMemoryLockedClocks(
+            gs.handle, profile.min_mem_clock, profile.max_mem_clock);
+      }
+      result.writes++;
     }
 
-    if (ret_pl == NVML_SUCCESS && ret_co == NVML_SUCCESS &&
-        ret_lc == NVML_SUCCESS) {
-      std::clog << fmt::format("Profile Successfully Applied for GPU {}.",
+    // 6. Enable Persistence Mode. Never disabled here, as another service may
+    // have enabled it.
+    nvmlEnableState_t persistence;
+    if (profile.persistence_mode) {
+      ret_pm = nvmlDeviceGetPersistenceMode(gs.handle, &persistence);
+      if (ret_pm == NVML_SUCCESS && persistence != NVML_FEATURE_ENABLED) {
+        ret_pm = nvmlDeviceSetPersistenceMode(gs.handle, NVML_FEATURE_ENABLED);
+        result.writes++;
+        enabled_persistence = ret_pm == NVML_SUCCESS;
+      } else if (ret_pm == NVML_ERROR_NOT_SUPPORTED) {
+        log.push_back(fmt::format(
+            "Persistence mode is not supported on GPU {} (Linux only).",
+            gs.index));
+        ret_pm = NVML_SUCCESS;
+      }
+    }
+  }
+
+  if (enabled_persistence) {
+    log.push_back(fmt::format(
+        "Enabled persistence mode for GPU {}. NVML took {:.1f}ms to "
+        "initialize in this process; later ones skip driver setup.",
+        gs.index, init_duration_.count() / 1000.0));
+  }
+
+  result.duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  double ms = result.duration.count() / 1000.0;
+  if (ret_pl == NVML_SUCCESS && ret_co == NVML_SUCCESS &&
+      ret_lc == NVML_SUCCESS && ret_mo == NVML_SUCCESS &&
+      ret_ml == NVML_SUCCESS && ret_pm == NVML_SUCCESS) {
+    log.push_back(fmt::format(
+        "Profile Successfully Applied for GPU {} ({} writes, {:.1f}ms).",
+        gs.index, result.writes, ms));
+  } else {
+    log.push_back(fmt::format(
+        "Failed to apply profile for GPU {}. States: PL({}), CO({}), LC({}), "
+        "MO({}), ML({}), PM({}). ({:.1f}ms)",
+        gs.index, nvmlErrorString(ret_pl), nvmlErrorString(ret_co),
+        nvmlErrorString(ret_lc), nvmlErrorString(ret_mo),
+        nvmlErrorString(ret_ml), nvmlErrorString(ret_pm), ms));
+    result.success = false;
+  }
+  return result;
+}
+
+bool NvmlManager::set_power_limit(const GpuState& gs, int power_limit_w) {
+  if (simulator_) {
+    if (!simulator_->set_power_limit(gs, power_limit_w)) {
+      std::cerr << fmt::format("Failed to set power limit for GPU {}: "
+                               "simulated failure",
                                gs.index)
                 << std::endl;
+      return false;
+    }
+    return true;
+  }
+  unsigned int current_mw;
+  if (nvmlDeviceGetPowerManagementLimit(gs.handle, &current_mw) ==
+          NVML_SUCCESS &&
+      current_mw == static_cast<unsigned int>(power_limit_w * 1000)) {
+    return true;
+  }
+  nvmlReturn_t ret =
+      nvmlDeviceSetPowerManagementLimit(gs.handle, power_limit_w * 1000);
+  if (ret != NVML_SUCCESS) {
+    std::cerr << fmt::format("Failed to set power limit for GPU {}: {}",
+                             gs.index, nvmlErrorString(ret))
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::vector<unsigned int> NvmlManager::get_process_ids(const GpuState& gs) {
+  std::vector<unsigned int> pids;
+  if (simulator_) {
+    return pids;  // simulated GPUs run no processes
+  }
+  using Getter = nvmlReturn_t (*)(nvmlDevice_t, unsigned int*,
+                                  nvmlProcessInfo_t*);
+  for (Getter getter : {nvmlDeviceGetComputeRunningProcesses_v3,
+                        nvmlDeviceGetGraphicsRunningProcesses_v3}) {
+    // The list can grow between the two calls; retry once with room to spare.
+    std::vector<nvmlProcessInfo_t> infos(16);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      unsigned int count = static_cast<unsigned int>(infos.size());
+      nvmlReturn_t ret = getter(gs.handle, &count, infos.data());
+      if (ret == NVML_ERROR_INSUFFICIENT_SIZE) {
+        infos.resize(count + 8);
+        continue;
+      }
+      if (ret == NVML_SUCCESS) {
+        for (unsigned int i = 0; i < count; ++i) {
+          pids.push_back(infos[i].pid);
+        }
+      }
+      break;
+    }
+  }
+  std::sort(pids.begin(), pids.end());
+  pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+  return pids;
+}
+
+bool NvmlManager::set_fan_duty(const GpuState& gs, int duty_percent) {
+  if (simulator_) {
+    simulator_->set_fan_duty(gs, std::clamp(duty_percent, 0, 100));
+    return true;
+  }
+  unsigned int fans = 0;
+  if (!nvmlDeviceSetFanSpeed_v2_p || !nvmlDeviceGetNumFans_p ||
+      nvmlDeviceGetNumFans_p(gs.handle, &fans) != NVML_SUCCESS) {
+    std::cerr << fmt::format("Fan control is not supported on GPU {}.",
+                             gs.index)
+              << std::endl;
+    return false;
+  }
+  unsigned int min_duty = 0, max_duty = 100;
+  if (nvmlDeviceGetMinMaxFanSpeed_p) {
+    nvmlDeviceGetMinMaxFanSpeed_p(gs.handle, &min_duty, &max_duty);
+  }
+  unsigned int duty = std::clamp(static_cast<unsigned int>(
+                                     std::max(duty_percent, 0)),
+                                 min_duty, max_duty);
+  for (unsigned int fan = 0; fan < fans; ++fan) {
+    nvmlReturn_t ret = nvmlDeviceSetFanSpeed_v2_p(gs.handle, fan, duty);
+    if (ret != NVML_SUCCESS) {
+      std::cerr << fmt::format("Failed to set fan {} of GPU {}: {}", fan,
+                               gs.index, nvmlErrorString(ret))
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool NvmlManager::reset_fans(const GpuState& gs) {
+  if (simulator_) {
+    simulator_->set_fan_duty(gs, -1);
+    return true;
+  }
+  unsigned int fans = 0;
+  if (!nvmlDeviceSetDefaultFanSpeed_v2_p || !nvmlDeviceGetNumFans_p ||
+      nvmlDeviceGetNumFans_p(gs.handle, &fans) != NVML_SUCCESS) {
+    return true;  // nothing was ever set
+  }
+  bool success = true;
+  for (unsigned int fan = 0; fan < fans; ++fan) {
+    nvmlReturn_t ret = nvmlDeviceSetDefaultFanSpeed_v2_p(gs.handle, fan);
+    if (ret != NVML_SUCCESS) {
+      std::cerr << fmt::format("Failed to reset fan {} of GPU {}: {}", fan,
+                               gs.index, nvmlErrorString(ret))
+                << std::endl;
+      success = false;
+    }
+  }
+  return success;
+}
+
+bool NvmlManager::watch_xid_events() {
+  if (simulator_ || xid_events_) {
+    return true;
+  }
+  if (nvmlEventSetCreate(&xid_events_) != NVML_SUCCESS) {
+    xid_events_ = nullptr;
+    return false;
+  }
+  bool any = false;
+  for (const auto& gpu : gpus_) {
+    nvmlReturn_t ret = nvmlDeviceRegisterEvents(
+        gpu.handle, nvmlEventTypeXidCriticalError, xid_events_);
+    if (ret == NVML_SUCCESS) {
+      any = true;
     } else {
-      std::cerr << fmt::format(
-                       "Failed to apply profile for GPU {}. States: PL({}), "
-                       "CO({}), LC({}).",
-                       gs.index, nvmlErrorString(ret_pl),
-                       nvmlErrorString(ret_co), nvmlErrorString(ret_lc))
+      std::cerr << fmt::format("Cannot watch Xid errors of GPU {}: {}",
+                               gpu.index, nvmlErrorString(ret))
                 << std::endl;
-      all_successful = false;
     }
   }
+  return any;
+}
 
-  return all_successful;
+std::vector<XidEvent> NvmlManager::poll_xid_events() {
+  if (simulator_) {
+    return simulator_->take_xid_events();
+  }
+  std::vector<XidEvent> events;
+  if (!xid_events_) {
+    return events;
+  }
+  nvmlEventData_t data;
+  while (nvmlEventSetWait_v2(xid_events_, &data, 0) == NVML_SUCCESS) {
+    if (!(data.eventType & nvmlEventTypeXidCriticalError)) {
+      continue;
+    }
+    for (const auto& gpu : gpus_) {
+      if (gpu.handle == data.device) {
+        events.push_back({gpu.index, data.eventData});
+      }
+    }
+  }
+  return events;
+}
+
+bool NvmlManager::is_gpu_lost(const GpuState& gs) {
+  if (simulator_) {
+    return false;
+  }
+  unsigned int temperature;
+  return nvmlDeviceGetTemperature(gs.handle, NVML_TEMPERATURE_GPU,
+                                  &temperature) == NVML_ERROR_GPU_IS_LOST;
 }
 
 void NvmlManager::check(nvmlReturn_t result, const std::string& error_msg) {
@@ -290,18 +855,597 @@ nvmlDevice_t NvmlManager::get_handle_by_uuid(const std::string& uuid) {
 
 // --- ProfileManager Implementation ---
 
+GovernorConfig GovernorConfig::defaults(Mode mode) {
+  GovernorConfig config;
+  config.mode = mode;
+  config.max_step_w = 10;
+  if (mode == Mode::Temperature) {
+    // Temperature lags power by tens of seconds: gentle P, slow I, and D to
+    // brake before overshooting into thermal slowdown.
+    config.target = 80;
+    config.deadband = 1;
+    config.kp = 4;
+    config.ki = 0.4;
+    config.kd = 8;
+  } else if (mode == Mode::Power) {
+    // Power follows the limit within a second.
+    config.target = 200;
+    config.deadband = 3;
+    config.kp = 0.3;
+    config.ki = 0.5;
+  }
+  return config;
+}
+
+int FanCurve::duty_at(int temperature_c) const {
+  if (points.empty()) {
+    return -1;
+  }
+  if (temperature_c <= points.front().first) {
+    return points.front().second;
+  }
+  for (size_t i = 1; i < points.size(); ++i) {
+    const auto& [t0, d0] = points[i - 1];
+    const auto& [t1, d1] = points[i];
+    if (temperature_c <= t1) {
+      return d0 + (d1 - d0) * (temperature_c - t0) / std::max(t1 - t0, 1);
+    }
+  }
+  return points.back().second;
+}
+
+namespace {
+const char* governor_mode_name(GovernorConfig::Mode mode) {
+  switch (mode) {
+    case GovernorConfig::Mode::Temperature:
+      return "temperature";
+    case GovernorConfig::Mode::Power:
+      return "power";
+    default:
+      return "off";
+  }
+}
+
+GovernorConfig load_governor(const json& governor_json, const GpuState& gpu) {
+  std::string mode_name = governor_json.value("mode", "off");
+  GovernorConfig::Mode mode = GovernorConfig::Mode::Off;
+  if (mode_name == "temperature") {
+    mode = GovernorConfig::Mode::Temperature;
+  } else if (mode_name == "power") {
+    mode = GovernorConfig::Mode::Power;
+  } else if (mode_name != "off") {
+    std::cerr << fmt::format("Unknown governor mode \"{}\" for GPU {}.",
+                             mode_name, gpu.index)
+              << std::endl;
+  }
+
+  GovernorConfig config = GovernorConfig::defaults(mode);
+  if (mode == GovernorConfig::Mode::Off) {
+    return config;
+  }
+  if (gpu.power_limit_min_w < 0) {
+    std::cerr << fmt::format(
+                     "GPU {} has no adjustable power limit. Governor disabled.",
+                     gpu.index)
+              << std::endl;
+    return GovernorConfig{};
+  }
+  config.target = governor_json.value("target", config.target);
+  if (mode == GovernorConfig::Mode::Temperature) {
+    config.target = std::clamp(config.target, 40, 95);
+  } else {
+    config.target = std::clamp(config.target, gpu.power_limit_min_w,
+                               gpu.power_limit_max_w);
+  }
+  config.deadband = std::max(0, governor_json.value("deadband", config.deadband));
+  config.kp = std::max(0.0, governor_json.value("kp", config.kp));
+  config.ki = std::max(0.0, governor_json.value("ki", config.ki));
+  config.kd = std::max(0.0, governor_json.value("kd", config.kd));
+  config.max_step_w =
+      std::max(1, governor_json.value("max_step_w", config.max_step_w));
+  return config;
+}
+
+int nearest_mem_clock(const GpuState& gpu, int clock_mhz) {
+  const auto& clocks = gpu.mem_clocks_mhz;
+  if (clocks.empty()) {
+    return 0;
+  }
+  auto it = std::lower_bound(clocks.begin(), clocks.end(), clock_mhz);
+  if (it == clocks.end()) {
+    return clocks.back();
+  }
+  if (it != clocks.begin() && clock_mhz - *(it - 1) < *it - clock_mhz) {
+    --it;
+  }
+  return *it;
+}
+
+void load_oc_profile(const json& profile_json, const GpuState& gpu,
+                     OcProfile& profile) {
+  int loaded_power = profile_json.value("power_limit", profile.power_limit);
+  profile.power_limit =
+      std::clamp(loaded_power, gpu.power_limit_min_w, gpu.power_limit_max_w);
+
+  int loaded_offset =
+      profile_json.value("gpu_clock_offset", profile.gpu_clock_offset);
+  profile.gpu_clock_offset = std::clamp(
+      loaded_offset, gpu.clock_offset_min_mhz, gpu.clock_offset_max_mhz);
+
+  int loaded_max_clock =
+      profile_json.value("max_gpu_clock", profile.max_gpu_clock);
+  profile.max_gpu_clock =
+      std::clamp(loaded_max_clock, 0, gpu.gpu_max_clock_mhz);
+
+  // The floor must be a supported clock no higher than the cap. Without a
+  // list of supported clocks there is nothing to lock to.
+  int loaded_min_clock = std::min(
+      profile_json.value("min_gpu_clock", profile.min_gpu_clock),
+      profile.max_gpu_clock);
+  auto floor_it = std::upper_bound(gpu.gpu_clocks_mhz.begin(),
+                                   gpu.gpu_clocks_mhz.end(), loaded_min_clock);
+  if (floor_it != gpu.gpu_clocks_mhz.begin()) {
+    --floor_it;
+  }
+  profile.min_gpu_clock = gpu.gpu_clocks_mhz.empty() ? 0 : *floor_it;
+  profile.latency_mode =
+      !gpu.gpu_clocks_mhz.empty() &&
+      profile_json.value("latency_mode", profile.latency_mode);
+
+  profile.persistence_mode =
+      profile_json.value("persistence_mode", profile.persistence_mode);
+
+  int loaded_mem_offset =
+      profile_json.value("mem_clock_offset", profile.mem_clock_offset);
+  profile.mem_clock_offset =
+      std::clamp(loaded_mem_offset, gpu.mem_clock_offset_min_mhz,
+                 gpu.mem_clock_offset_max_mhz);
+
+  // Locked memory clocks must be supported ones.
+  profile.min_mem_clock = nearest_mem_clock(
+      gpu, profile_json.value("min_mem_clock", profile.min_mem_clock));
+  profile.max_mem_clock = nearest_mem_clock(
+      gpu, profile_json.value("max_mem_clock", profile.max_mem_clock));
+  if (profile.min_mem_clock > profile.max_mem_clock) {
+    std::swap(profile.min_mem_clock, profile.max_mem_clock);
+  }
+
+  // "pstate_clock_offsets": {"P2": {"gpu_clock_offset": ..., ...}}. Only
+  // P-states this GPU can adjust are kept.
+  json pstates_json = profile_json.value("pstate_clock_offsets", json::object());
+  std::map<int, PstateClockOffset> pstate_offsets;
+  for (const auto& range : gpu.pstate_offset_ranges) {
+    PstateClockOffset offset = pstate_clock_offset(profile, range.pstate);
+    std::string key = fmt::format("P{}", range.pstate);
+    if (pstates_json.is_object() && pstates_json.contains(key)) {
+      offset.gpu = pstates_json[key].value("gpu_clock_offset", offset.gpu);
+      offset.mem = pstates_json[key].value("mem_clock_offset", offset.mem);
+    }
+    offset.gpu = std::clamp(offset.gpu, range.gpu_min_mhz, range.gpu_max_mhz);
+    offset.mem = std::clamp(offset.mem, range.mem_min_mhz, range.mem_max_mhz);
+    pstate_offsets[range.pstate] = offset;
+  }
+  profile.pstate_clock_offsets = std::move(pstate_offsets);
+}
+
+json save_oc_profile(const OcProfile& profile) {
+  json profile_json;
+  profile_json["power_limit"] = profile.power_limit;
+  profile_json["gpu_clock_offset"] = profile.gpu_clock_offset;
+  profile_json["max_gpu_clock"] = profile.max_gpu_clock;
+  profile_json["latency_mode"] = profile.latency_mode;
+  profile_json["min_gpu_clock"] = profile.min_gpu_clock;
+  profile_json["persistence_mode"] = profile.persistence_mode;
+  profile_json["mem_clock_offset"] = profile.mem_clock_offset;
+  profile_json["min_mem_clock"] = profile.min_mem_clock;
+  profile_json["max_mem_clock"] = profile.max_mem_clock;
+  for (const auto& [pstate, offset] : profile.pstate_clock_offsets) {
+    if (offset != PstateClockOffset{}) {
+      json& pstate_json =
+          profile_json["pstate_clock_offsets"][fmt::format("P{}", pstate)];
+      pstate_json["gpu_clock_offset"] = offset.gpu;
+      pstate_json["mem_clock_offset"] = offset.mem;
+    }
+  }
+  return profile_json;
+}
+
+/**
+ * @brief Save what a preset changes from `main`, so the rest keeps following
+ * the main profile when that is edited.
+ * @param keys keys the preset set itself; they are kept even where they
+ * match `main`.
+ */
+json save_preset(const OcProfile& preset, const OcProfile& main,
+                 const std::set<std::string>& keys) {
+  json preset_json = save_oc_profile(preset);
+  json main_json = save_oc_profile(main);
+  // save_oc_profile leaves zero P-state offsets out, which on load would
+  // mean the main profile's.
+  if (main_json.contains("pstate_clock_offsets")) {
+    json& pstates_json = preset_json["pstate_clock_offsets"];
+    for (const auto& [pstate, offset] : preset.pstate_clock_offsets) {
+      std::string key = fmt::format("P{}", pstate);
+      if (main_json["pstate_clock_offsets"].contains(key) &&
+          !pstates_json.contains(key)) {
+        pstates_json[key] = {{"gpu_clock_offset", offset.gpu},
+                             {"mem_clock_offset", offset.mem}};
+      }
+    }
+  }
+  json overrides = json::object();
+  for (const auto& [key, value] : preset_json.items()) {
+    if (keys.count(key) || !main_json.contains(key) ||
+        main_json[key] != value) {
+      overrides[key] = value;
+    }
+  }
+  return overrides;
+}
+
+/**
+ * @brief Parse "HH:MM" into minutes of the day.
+ * @return -1 if malformed.
+ */
+int parse_minute_of_day(const std::string& text) {
+  int hours, minutes;
+  char colon, end;
+  if (std::sscanf(text.c_str(), "%d%c%d%c", &hours, &colon, &minutes, &end) !=
+          3 ||
+      colon != ':' || hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+    return -1;
+  }
+  return hours * 60 + minutes;
+}
+
+std::string format_minute_of_day(int minute) {
+  return fmt::format("{:02}:{:02}", minute / 60, minute % 60);
+}
+
+std::optional<ProfileRule> load_rule(const json& rule_json) {
+  if (!rule_json.is_object()) {
+    return std::nullopt;
+  }
+  ProfileRule rule;
+  try {
+    rule.preset = rule_json.at("preset").get<std::string>();
+    rule.process = rule_json.value("process", "");
+    rule.cgroup = rule_json.value("cgroup", "");
+    if (rule_json.contains("gpus")) {
+      rule.gpus = rule_json["gpus"].get<std::vector<unsigned int>>();
+    }
+    if (rule_json.contains("time")) {
+      // "HH:MM-HH:MM", local time; may wrap past midnight.
+      std::string window = rule_json["time"].get<std::string>();
+      size_t dash = window.find('-');
+      if (dash == std::string::npos) {
+        return std::nullopt;
+      }
+      rule.start_minute = parse_minute_of_day(window.substr(0, dash));
+      rule.end_minute = parse_minute_of_day(window.substr(dash + 1));
+      if (rule.start_minute < 0 || rule.end_minute < 0) {
+        return std::nullopt;
+      }
+    }
+  } catch (const json::exception&) {
+    return std::nullopt;
+  }
+  if (rule.preset.empty()) {
+    return std::nullopt;
+  }
+  return rule;
+}
+
+json save_rule(const ProfileRule& rule) {
+  json rule_json = {{"preset", rule.preset}};
+  if (!rule.process.empty()) {
+    rule_json["process"] = rule.process;
+  }
+  if (!rule.cgroup.empty()) {
+    rule_json["cgroup"] = rule.cgroup;
+  }
+  if (!rule.gpus.empty()) {
+    rule_json["gpus"] = rule.gpus;
+  }
+  if (rule.start_minute >= 0) {
+    rule_json["time"] = format_minute_of_day(rule.start_minute) + "-" +
+                        format_minute_of_day(rule.end_minute);
+  }
+  return rule_json;
+}
+
+FanCurve load_fan_curve(const json& curve_json, const GpuState& gpu) {
+  FanCurve curve;
+  try {
+    for (const json& point : curve_json.at("points")) {
+      int temperature = std::clamp(point.at(0).get<int>(), 0, 110);
+      int duty = std::clamp(point.at(1).get<int>(), 0, 100);
+      curve.points.emplace_back(temperature, duty);
+    }
+  } catch (const json::exception&) {
+    std::cerr << fmt::format(
+                     "Invalid fan curve for GPU {}; expected \"points\": "
+                     "[[celsius, percent], ...]. Using the stock curve.",
+                     gpu.index)
+              << std::endl;
+    return FanCurve{};
+  }
+  std::sort(curve.points.begin(), curve.points.end());
+  // A curve must not slow the fans down as it gets hotter.
+  for (size_t i = 1; i < curve.points.size(); ++i) {
+    curve.points[i].second =
+        std::max(curve.points[i].second, curve.points[i - 1].second);
+  }
+  curve.hysteresis_c =
+      std::clamp(curve_json.value("hysteresis_c", curve.hysteresis_c), 0, 20);
+  curve.min_interval_s = std::clamp(
+      curve_json.value("min_interval_s", curve.min_interval_s), 1, 60);
+  return curve;
+}
+
+json save_fan_curve(const FanCurve& curve) {
+  json points = json::array();
+  for (const auto& [temperature, duty] : curve.points) {
+    points.push_back({temperature, duty});
+  }
+  return {{"points", points},
+          {"hysteresis_c", curve.hysteresis_c},
+          {"min_interval_s", curve.min_interval_s}};
+}
+
+// Clock event reasons by their name in profiles.json.
+const std::pair<const char*, unsigned long long> CLOCK_EVENTS[] = {
+    {"power_cap", nvmlClocksEventReasonSwPowerCap},
+    {"hw_slowdown", nvmlClocksThrottleReasonHwSlowdown},
+    {"sw_thermal", nvmlClocksEventReasonSwThermalSlowdown},
+    {"hw_thermal", nvmlClocksThrottleReasonHwThermalSlowdown},
+    {"power_brake", nvmlClocksThrottleReasonHwPowerBrakeSlowdown},
+};
+
+RecorderConfig load_recorder(const json& recorder_json) {
+  RecorderConfig config;
+  for (const json& name : recorder_json.value("events", json::array())) {
+    auto it = std::find_if(
+        std::begin(CLOCK_EVENTS), std::end(CLOCK_EVENTS),
+        [&](const auto& event) { return name == event.first; });
+    if (it == std::end(CLOCK_EVENTS)) {
+      std::cerr << fmt::format("Ignoring unknown recorder event {}.",
+                               name.dump())
+                << std::endl;
+      continue;
+    }
+    config.event_mask |= it->second;
+  }
+  config.max_temp_c =
+      std::max(recorder_json.value("max_temp_c", config.max_temp_c), 0);
+  config.clock_drop_percent = std::clamp(
+      recorder_json.value("clock_drop_percent", config.clock_drop_percent), 0,
+      100);
+  config.pre_s = std::clamp(recorder_json.value("pre_s", config.pre_s), 1, 600);
+  config.post_s =
+      std::clamp(recorder_json.value("post_s", config.post_s), 0, 600);
+  config.sample_ms =
+      std::clamp(recorder_json.value("sample_ms", config.sample_ms), 50, 1000);
+  config.holdoff_s =
+      std::clamp(recorder_json.value("holdoff_s", config.holdoff_s), 0, 86400);
+  return config;
+}
+
+json save_recorder(const RecorderConfig& config) {
+  return {{"events", clock_event_names(config.event_mask)},
+          {"max_temp_c", config.max_temp_c},
+          {"clock_drop_percent", config.clock_drop_percent},
+          {"pre_s", config.pre_s},
+          {"post_s", config.post_s},
+          {"sample_ms", config.sample_ms},
+          {"holdoff_s", config.holdoff_s}};
+}
+
+json save_governor(const GovernorConfig& config) {
+  return {{"mode", governor_mode_name(config.mode)},
+          {"target", config.target},
+          {"deadband", config.deadband},
+          {"kp", config.kp},
+          {"ki", config.ki},
+          {"kd", config.kd},
+          {"max_step_w", config.max_step_w}};
+}
+
+UnstableProfile load_unstable(const json& unstable_json, const GpuState& gpu) {
+  UnstableProfile unstable{ProfileManager::default_profile(gpu),
+                           unstable_json.value("preset", ""),
+                           unstable_json.value("reason", ""),
+                           unstable_json.value("time", "")};
+  if (unstable_json.contains("profile")) {
+    load_oc_profile(unstable_json["profile"], gpu, unstable.profile);
+  }
+  return unstable;
+}
+
+bool same_unstable(const UnstableProfile& a, const UnstableProfile& b) {
+  return a.profile == b.profile && a.preset == b.preset &&
+         a.reason == b.reason && a.time == b.time;
+}
+
+/**
+ * @brief Load a GPU's "presets" on top of its main profile `profile`, so
+ * they can name only what they change.
+ * @param keys receives the keys each preset sets itself.
+ */
+void load_presets(const json& presets_json, const GpuState& gpu,
+                  const OcProfile& profile,
+                  std::map<std::string, OcProfile>& presets,
+                  std::map<std::string, std::set<std::string>>& keys) {
+  for (const auto& [name, preset_json] : presets_json.items()) {
+    OcProfile preset = profile;
+    load_oc_profile(preset_json, gpu, preset);
+    presets[name] = preset;
+    if (preset_json.is_object()) {
+      for (const auto& item : preset_json.items()) {
+        keys[name].insert(item.key());
+      }
+    }
+  }
+}
+}  // namespace
+
+std::vector<std::string> clock_event_names(unsigned long long reasons) {
+  std::vector<std::string> names;
+  for (const auto& [name, bit] : CLOCK_EVENTS) {
+    if (reasons & bit) {
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
 ProfileManager::ProfileManager(const std::string& file_path,
                                const std::vector<GpuState>& gpus)
     : file_path_(file_path), gpus_(gpus) {
   for (const auto& gpu : gpus_) {
-    OcProfile& profile = profiles_[gpu.uuid];
-    profile.power_limit = gpu.power_limit_default_w;
-    profile.gpu_clock_offset = 0;
-    profile.max_gpu_clock = gpu.gpu_max_clock_mhz;
+    profiles_[gpu.uuid] = default_profile(gpu);
+    governors_[gpu.uuid] = GovernorConfig{};
+    fan_curves_[gpu.uuid] = FanCurve{};
   }
   load();
 }
 
+OcProfile ProfileManager::default_profile(const GpuState& gpu) {
+  OcProfile profile;
+  profile.power_limit = gpu.power_limit_default_w;
+  profile.gpu_clock_offset = 0;
+  profile.max_gpu_clock = gpu.gpu_max_clock_mhz;
+  profile.latency_mode = false;
+  profile.min_gpu_clock =
+      gpu.gpu_clocks_mhz.empty() ? 0 : gpu.gpu_clocks_mhz.front();
+  profile.mem_clock_offset = 0;
+  profile.persistence_mode = false;
+  profile.min_mem_clock =
+      gpu.mem_clocks_mhz.empty() ? 0 : gpu.mem_clocks_mhz.front();
+  profile.max_mem_clock =
+      gpu.mem_clocks_mhz.empty() ? 0 : gpu.mem_clocks_mhz.back();
+  for (const auto& range : gpu.pstate_offset_ranges) {
+    profile.pstate_clock_offsets[range.pstate] = PstateClockOffset{};
+  }
+  return profile;
+}
+
+std::optional<OcProfile> ProfileManager::get_last_known_good(
+    const std::string& uuid) const {
+  auto it = last_known_good_.find(uuid);
+  if (it == last_known_good_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+void ProfileManager::set_last_known_good(const std::string& uuid,
+                                         const OcProfile& profile) {
+  last_known_good_[uuid] = profile;
+  watchdog_state_changed_ = true;
+}
+
+std::optional<UnstableProfile> ProfileManager::get_unstable(
+    const std::string& uuid) const {
+  auto it = unstable_.find(uuid);
+  if (it == unstable_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+bool ProfileManager::roll_back(const std::string& uuid,
+                               const std::string& preset,
+                               const std::string& reason) {
+  auto gpu = std::find_if(gpus_.begin(), gpus_.end(),
+                          [&](const GpuState& gs) { return gs.uuid == uuid; });
+  if (gpu == gpus_.end()) {
+    return false;
+  }
+  OcProfile* failed_ptr = &profiles_.at(uuid);
+  if (!preset.empty()) {
+    auto presets = presets_.find(uuid);
+    if (presets == presets_.end()) {
+      return false;
+    }
+    auto it = presets->second.find(preset);
+    if (it == presets->second.end()) {
+      return false;  // removed from profiles.json since it was applied
+    }
+    failed_ptr = &it->second;
+  }
+  OcProfile& failed = *failed_ptr;
+
+  OcProfile fallback = default_profile(*gpu);
+  auto good = last_known_good_.find(uuid);
+  if (good != last_known_good_.end()) {
+    if (good->second == failed) {
+      last_known_good_.erase(good);  // it was not so good after all
+    } else {
+      fallback = good->second;
+    }
+  }
+  if (failed == fallback) {
+    return false;
+  }
+
+  std::time_t now = std::time(nullptr);
+  unstable_[uuid] = {failed, preset, reason,
+                     fmt::format("{:%Y-%m-%d %H:%M:%S}", fmt::localtime(now))};
+  failed = fallback;
+  watchdog_state_changed_ = true;
+  return true;
+}
+
+void ProfileManager::reload_watchdog_state() {
+  std::ifstream file(SysUtils::make_path_string(file_path_));
+  json data = json::parse(file, nullptr, false);
+  if (!data.is_object()) {
+    return;  // missing or broken; what load() found is all there is
+  }
+  for (const auto& gpu : gpus_) {
+    std::optional<UnstableProfile> known = get_unstable(gpu.uuid);
+    last_known_good_.erase(gpu.uuid);
+    unstable_.erase(gpu.uuid);
+    auto profile_json = data.find(gpu.uuid);
+    if (profile_json == data.end() || !profile_json->is_object()) {
+      continue;
+    }
+    auto good = profile_json->find("last_known_good");
+    if (good != profile_json->end() && good->is_object()) {
+      OcProfile profile = default_profile(gpu);
+      load_oc_profile(*good, gpu, profile);
+      last_known_good_[gpu.uuid] = profile;
+    }
+    auto unstable = profile_json->find("unstable");
+    if (unstable == profile_json->end() || !unstable->is_object()) {
+      continue;
+    }
+    unstable_[gpu.uuid] = load_unstable(*unstable, gpu);
+    if (known && same_unstable(*known, unstable_[gpu.uuid])) {
+      continue;
+    }
+
+    // Rolled back since we loaded: what we hold for this GPU may be the
+    // profile that crashed it, so take the rolled back one from disk.
+    OcProfile& profile = profiles_.at(gpu.uuid);
+    profile = default_profile(gpu);
+    load_oc_profile(*profile_json, gpu, profile);
+    presets_.erase(gpu.uuid);
+    preset_keys_.erase(gpu.uuid);
+    auto presets = profile_json->find("presets");
+    if (presets != profile_json->end() && presets->is_object()) {
+      load_presets(*presets, gpu, profile, presets_[gpu.uuid],
+                   preset_keys_[gpu.uuid]);
+    }
+    std::cerr << fmt::format("GPU {} was rolled back after {}; its profile "
+                             "and presets were reloaded, changes to them are "
+                             "lost.",
+                             gpu.index, unstable_[gpu.uuid].reason)
+              << std::endl;
+  }
+}
+
 void ProfileManager::load() {
   std::clog << fmt::format("Loading profiles from {}.", file_path_)
             << std::endl;
@@ -324,6 +1468,30 @@ void ProfileManager::load() {
     return;
   }
 
+  if (data.contains("node") && data["node"].is_object()) {
+    const json& node_json = data["node"];
+    int budget = node_json.value("power_budget_w", node_.power_budget_w);
+    int min_total = 0;
+    for (const auto& gpu : gpus_) {
+      min_total += std::max(gpu.power_limit_min_w, 0);
+    }
+    if (budget > 0 && budget < min_total) {
+      std::cerr << fmt::format(
+                       "Power budget {}W is below the GPUs' minimum limits "
+                       "({}W). Using {}W.",
+                       budget, min_total, min_total)
+                << std::endl;
+      budget = min_total;
+    }
+    node_.power_budget_w = std::max(budget, 0);
+    node_.budget_period_s = std::clamp(
+        node_json.value("budget_period_s", node_.budget_period_s), 1, 60);
+  }
+
+  if (data.contains("recorder") && data["recorder"].is_object()) {
+    recorder_ = load_recorder(data["recorder"]);
+  }
+
   for (const auto& gpu : gpus_) {
     if (!data.contains(gpu.uuid)) {
       continue;
@@ -331,20 +1499,60 @@ void ProfileManager::load() {
 
     const json& profile_json = data[gpu.uuid];
     OcProfile& profile = profiles_.at(gpu.uuid);
+    load_oc_profile(profile_json, gpu, profile);
+
+    if (profile_json.contains("governor") &&
+        profile_json["governor"].is_object()) {
+      governors_.at(gpu.uuid) = load_governor(profile_json["governor"], gpu);
+    }
+
+    if (profile_json.contains("fan_curve") &&
+        profile_json["fan_curve"].is_object()) {
+      fan_curves_.at(gpu.uuid) = load_fan_curve(profile_json["fan_curve"], gpu);
+    }
 
-    int loaded_power = profile_json.value("power_limit", profile.power_limit);
-    profile.power_limit =
-        std::clamp(loaded_power, gpu.power_limit_min_w, gpu.power_limit_max_w);
+    if (profile_json.contains("last_known_good") &&
+        profile_json["last_known_good"].is_object()) {
+      OcProfile good = default_profile(gpu);
+      load_oc_profile(profile_json["last_known_good"], gpu, good);
+      last_known_good_[gpu.uuid] = good;
+    }
 
-    int loaded_offset =
-        profile_json.value("gpu_clock_offset", profile.gpu_clock_offset);
-    profile.gpu_clock_offset = std::clamp(
-        loaded_offset, gpu.clock_offset_min_mhz, gpu.clock_offset_max_mhz);
+    if (profile_json.contains("unstable") &&
+        profile_json["unstable"].is_object()) {
+      unstable_[gpu.uuid] = load_unstable(profile_json["unstable"], gpu);
+    }
 
-    int loaded_max_clock =
-        profile_json.value("max_gpu_clock", profile.max_gpu_clock);
-    profile.max_gpu_clock =
-        std::clamp(loaded_max_clock, 0, gpu.gpu_max_clock_mhz);
+    if (profile_json.contains("presets") &&
+        profile_json["presets"].is_object()) {
+      load_presets(profile_json["presets"], gpu, profile, presets_[gpu.uuid],
+                   preset_keys_[gpu.uuid]);
+    }
+  }
+
+  if (data.contains("rules") && data["rules"].is_array()) {
+    for (const json& rule_json : data["rules"]) {
+      std::optional<ProfileRule> rule = load_rule(rule_json);
+      if (!rule) {
+        std::cerr << fmt::format("Ignoring invalid profile rule: {}",
+                                 rule_json.dump())
+                  << std::endl;
+        rejected_rules_.emplace_back(rules_.size(), rule_json.dump());
+        continue;
+      }
+      bool known = std::any_of(
+          presets_.begin(), presets_.end(),
+          [&](const auto& entry) { return entry.second.count(rule->preset); });
+      if (!known) {
+        std::cerr << fmt::format(
+                         "Ignoring profile rule for unknown preset \"{}\".",
+                         rule->preset)
+                  << std::endl;
+        rejected_rules_.emplace_back(rules_.size(), rule_json.dump());
+        continue;
+      }
+      rules_.push_back(*rule);
+    }
   }
 
   std::clog << fmt::format(
@@ -353,20 +1561,66 @@ void ProfileManager::load() {
 }
 
 void ProfileManager::save() {
+  if (!watchdog_state_changed_) {
+    reload_watchdog_state();
+  }
   json data;
   for (const auto& [uuid, profile] : profiles_) {
-    json profile_json;
-    profile_json["power_limit"] = profile.power_limit;
-    profile_json["gpu_clock_offset"] = profile.gpu_clock_offset;
-    profile_json["max_gpu_clock"] = profile.max_gpu_clock;
+    json profile_json = save_oc_profile(profile);
+    const GovernorConfig& governor = governors_.at(uuid);
+    if (governor.mode != GovernorConfig::Mode::Off) {
+      profile_json["governor"] = save_governor(governor);
+    }
+    const FanCurve& fan_curve = fan_curves_.at(uuid);
+    if (fan_curve.enabled()) {
+      profile_json["fan_curve"] = save_fan_curve(fan_curve);
+    }
+    auto presets = presets_.find(uuid);
+    if (presets != presets_.end()) {
+      for (const auto& [name, preset] : presets->second) {
+        profile_json["presets"][name] = save_preset(
+            preset, profile, preset_keys_[uuid][name]);
+      }
+    }
+    auto good = last_known_good_.find(uuid);
+    if (good != last_known_good_.end()) {
+      profile_json["last_known_good"] = save_oc_profile(good->second);
+    }
+    auto unstable = unstable_.find(uuid);
+    if (unstable != unstable_.end()) {
+      profile_json["unstable"] = {
+          {"profile", save_oc_profile(unstable->second.profile)},
+          {"preset", unstable->second.preset},
+          {"reason", unstable->second.reason},
+          {"time", unstable->second.time}};
+    }
     data[uuid] = profile_json;
   }
+  if (!rules_.empty() || !rejected_rules_.empty()) {
+    data["rules"] = json::array();
+    auto rejected = rejected_rules_.begin();
+    for (size_t i = 0; i <= rules_.size(); ++i) {
+      for (; rejected != rejected_rules_.end() && rejected->first == i;
+           ++rejected) {
+        data["rules"].push_back(json::parse(rejected->second));
+      }
+      if (i < rules_.size()) {
+        data["rules"].push_back(save_rule(rules_[i]));
+      }
+    }
+  }
+  if (node_.power_budget_w > 0) {
+    data["node"] = {{"power_budget_w", node_.power_budget_w},
+                    {"budget_period_s", node_.budget_period_s}};
+  }
+  if (recorder_.enabled()) {
+    data["recorder"] = save_recorder(recorder_);
+  }
 
-  std::ofstream outfile(SysUtils::make_path_string(file_path_));
-  if (!outfile) {
-    std::cerr << fmt::format("Failed to open {}.", file_path_) << std::endl;
+  // The resident helper saves here as root, in the user's config directory.
+  if (!SysUtils::replace_file(file_path_, data.dump(4))) {
+    std::cerr << fmt::format("Failed to save {}.", file_path_) << std::endl;
   } else {
-    outfile << data.dump(4);
     std::clog << fmt::format("Profiles saved to {}.", file_path_) << std::endl;
   }
 }
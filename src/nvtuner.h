@@ -4,20 +4,164 @@
 
 #include <chrono>
 #include <map>
+#include <memory>
 #include <optional>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "bottleneck.h"
 #include "sys_utils.h"
+#include "thermal_forecast.h"
+
+// Clock offsets of one P-state, in MHz.
+struct PstateClockOffset {
+  int gpu = 0;
+  int mem = 0;
+
+  bool operator==(const PstateClockOffset &other) const {
+    return gpu == other.gpu && mem == other.mem;
+  }
+  bool operator!=(const PstateClockOffset &other) const {
+    return !(*this == other);
+  }
+};
 
 struct OcProfile {
   int power_limit;       // in Watts
   int gpu_clock_offset;  // in MHz
   int max_gpu_clock;     // in MHz
+  // Latency mode locks the graphics clock to min_gpu_clock..max_gpu_clock,
+  // so bursts start at full speed instead of waiting for DVFS to ramp up.
+  // min_gpu_clock is a supported clock and kept while the mode is off.
+  bool latency_mode;
+  int min_gpu_clock;  // in MHz
+  int mem_clock_offset;  // in MHz
+  // Locked memory clock range in MHz; the full supported range is unlocked.
+  int min_mem_clock;
+  int max_mem_clock;
+  // Offsets of the adjustable P-states after P0, by P-state number. P0 uses
+  // gpu_clock_offset and mem_clock_offset.
+  std::map<int, PstateClockOffset> pstate_clock_offsets;
+  // Enable persistence mode on apply (Linux), so the driver stays
+  // initialized between NVML clients. Off leaves the mode as it is, e.g. to
+  // nvidia-persistenced.
+  bool persistence_mode;
+
+  bool operator==(const OcProfile &other) const {
+    return power_limit == other.power_limit &&
+           gpu_clock_offset == other.gpu_clock_offset &&
+           max_gpu_clock == other.max_gpu_clock &&
+           latency_mode == other.latency_mode &&
+           min_gpu_clock == other.min_gpu_clock &&
+           mem_clock_offset == other.mem_clock_offset &&
+           min_mem_clock == other.min_mem_clock &&
+           max_mem_clock == other.max_mem_clock &&
+           pstate_clock_offsets == other.pstate_clock_offsets &&
+           persistence_mode == other.persistence_mode;
+  }
+  bool operator!=(const OcProfile &other) const { return !(*this == other); }
+};
+
+// Power-limit governor settings, kept next to the profile in profiles.json
+// and run by the resident helper. The controller itself is PowerGovernor.
+struct GovernorConfig {
+  enum class Mode { Off, Temperature, Power };
+  Mode mode = Mode::Off;
+  int target = 0;    // in °C or W, by mode
+  int deadband = 0;  // no correction within target +- deadband
+  // PID gains in W of power limit per °C (or W) of error; ki is per second.
+  double kp = 0;
+  double ki = 0;
+  double kd = 0;
+  int max_step_w = 0;  // rate limit, W per second
+
+  /**
+   * @brief Tuned defaults for `mode`; loaded values override them.
+   */
+  static GovernorConfig defaults(Mode mode);
+};
+
+// Fan curve run by the resident helper, "fan_curve" in a GPU's entry of
+// profiles.json. Without points the stock curve stays in charge.
+struct FanCurve {
+  std::vector<std::pair<int, int>> points;  // (°C, duty %), by temperature
+  // The duty only drops once the temperature is this far below the point
+  // that raised it, so the fans do not hunt around a threshold.
+  int hysteresis_c = 3;
+  int min_interval_s = 2;  // between two duty changes
+
+  bool enabled() const { return !points.empty(); }
+  /**
+   * @return duty for `temperature_c`, linear between points.
+   */
+  int duty_at(int temperature_c) const;
+};
+
+// Node-wide settings, under the reserved "node" key of profiles.json.
+struct NodeConfig {
+  int power_budget_w = 0;  // shared by all GPUs, 0 to disable
+  int budget_period_s = 5;  // how often the budget is redistributed
+};
+
+// Flight recorder triggers, under the reserved "recorder" key of
+// profiles.json. Run by the resident helper (see FlightRecorder).
+struct RecorderConfig {
+  // nvmlClocksEventReason* bits that trigger as they come on; in the file,
+  // their names (see clock_event_names).
+  unsigned long long event_mask = 0;
+  int max_temp_c = 0;  // trigger as it is exceeded, 0 to disable
+  // Trigger when the clock falls by this much from one sample to the next
+  // while the GPU stays busy, 0 to disable.
+  int clock_drop_percent = 0;
+  int pre_s = 60;   // kept before a trigger
+  int post_s = 30;  // recorded after it
+  int sample_ms = 100;
+  int holdoff_s = 300;  // no new capture this soon after one
+
+  bool enabled() const {
+    return event_mask != 0 || max_temp_c > 0 || clock_drop_percent > 0;
+  }
+};
+
+/**
+ * @return names of the clock event bits in `reasons` that RecorderConfig
+ * knows, e.g. {"power_cap", "sw_thermal"}.
+ */
+std::vector<std::string> clock_event_names(unsigned long long reasons);
+
+// Switches a GPU to a named preset (see ProfileManager::get_presets) while
+// it matches, under the reserved "rules" key of profiles.json. All given
+// conditions must hold; the first matching rule wins. Run by the resident
+// helper.
+struct ProfileRule {
+  std::string preset;
+  // Name of a process on the GPU, as comm or the base name of argv[0];
+  // empty: any.
+  std::string process;
+  std::string cgroup;   // substring of that process's cgroup; empty: any
+  // Local time window [start, end) in minutes of the day, may wrap past
+  // midnight; -1: any time.
+  int start_minute = -1;
+  int end_minute = -1;
+  std::vector<unsigned int> gpus;  // GPU indices; empty: all
+
+  bool needs_process() const { return !process.empty() || !cgroup.empty(); }
+};
+
+// Offset ranges of one P-state in MHz; min == max if a clock is fixed.
+struct PstateOffsetRange {
+  int pstate;
+  int gpu_min_mhz;
+  int gpu_max_mhz;
+  int mem_min_mhz;
+  int mem_max_mhz;
 };
 
 struct GpuState {
   // Static Info
+  std::string host;  // agent host name in cluster mode, empty for local GPUs
   unsigned int index;
   nvmlDevice_t handle;
   std::string uuid;
@@ -29,8 +173,20 @@ struct GpuState {
   int clock_offset_min_mhz;
   int clock_offset_max_mhz;
   int gpu_max_clock_mhz;
+  // Supported graphics clocks at the top memory clock, ascending; empty if
+  // they cannot be locked.
+  std::vector<int> gpu_clocks_mhz;
+  int mem_clock_offset_min_mhz;
+  int mem_clock_offset_max_mhz;
+  // Supported memory clocks, ascending; empty if they cannot be locked.
+  std::vector<int> mem_clocks_mhz;
+  // P-states after P0 with an adjustable offset, ascending. Needs the
+  // per-P-state offset API of recent drivers; empty otherwise.
+  std::vector<PstateOffsetRange> pstate_offset_ranges;
+  int slowdown_temp_c;  // software thermal slowdown threshold, -1 if unknown
 
   // Dynamic Info
+  unsigned long long sample_generation;  // bumped by every update
   int fan_speed_percent;
   int fan_speed_rpm;
   int temperature_c;
@@ -42,6 +198,16 @@ struct GpuState {
   int gpu_util_percent;
   int mem_util_percent;
   int gpu_clock_mhz;
+  int pstate;  // 0 (P0, fastest) .. 15, -1 if unknown
+  int persistence_mode;  // 1 on, 0 off, -1 unsupported
+  // Forecast seconds until slowdown_temp_c at the current power, 0 if there,
+  // -1 if not expected soon (see ThermalForecaster).
+  int seconds_to_slowdown;
+  unsigned long long clock_event_reasons;  // nvmlClocksEventReason* bits
+  // What limited the GPU over the last few samples, and the percent of them
+  // that agree (see BottleneckClassifier).
+  Bottleneck bottleneck;
+  int bottleneck_confidence;
 
   std::optional<std::chrono::system_clock::time_point>
       last_event_power_cap_time;
@@ -51,31 +217,166 @@ struct GpuState {
       last_event_hwt_slowdown_time;
 };
 
+/**
+ * @return offsets of `pstate` in `profile`, zero if it has none.
+ */
+inline PstateClockOffset pstate_clock_offset(const OcProfile &profile,
+                                             int pstate) {
+  auto it = profile.pstate_clock_offsets.find(pstate);
+  return it == profile.pstate_clock_offsets.end() ? PstateClockOffset{}
+                                                  : it->second;
+}
+
+/**
+ * @return lower end of the locked graphics clock range, 0 if none.
+ */
+inline int locked_min_gpu_clock(const OcProfile &profile) {
+  return profile.latency_mode ? profile.min_gpu_clock : 0;
+}
+
+/**
+ * @return true if `profile` locks no memory clocks on `gs`.
+ */
+inline bool mem_clocks_unlocked(const GpuState &gs, const OcProfile &profile) {
+  return gs.mem_clocks_mhz.empty() ||
+         (profile.min_mem_clock <= gs.mem_clocks_mhz.front() &&
+          profile.max_mem_clock >= gs.mem_clocks_mhz.back());
+}
+
+// A critical Xid error reported by the driver, see
+// NvmlManager::poll_xid_events.
+struct XidEvent {
+  unsigned int index;  // GPU index
+  unsigned long long xid;
+};
+
+// Outcome of applying one GPU's profile.
+struct ApplyResult {
+  unsigned int index;
+  bool success;
+  int writes;  // setter calls made; settings that already matched are skipped
+  std::chrono::microseconds duration;
+};
+
+class GpuSimulator;
+
 class NvmlManager {
  public:
-  NvmlManager();
+  /**
+   * @param simulated_gpu_count if non-zero, NVML is not used and this many
+   * simulated GPUs are created instead.
+   * @param read_dynamic_state false to only read static info, e.g. when just
+   * applying profiles.
+   */
+  explicit NvmlManager(unsigned int simulated_gpu_count = 0,
+                       bool read_dynamic_state = true);
   ~NvmlManager();
 
   void update_dynamic_state();
 
   /**
+   * @brief Apply profiles to all GPUs concurrently, writing only the settings
+   * that differ from the hardware.
+   * @param results if given, receives one entry per GPU in index order.
    * @return true on success
    */
-  bool apply_profiles(const std::map<std::string, OcProfile> &profiles);
+  bool apply_profiles(const std::map<std::string, OcProfile> &profiles,
+                      std::vector<ApplyResult> *results = nullptr);
 
   const std::string &get_driver_version() const { return driver_version_; }
   const std::string &get_nvml_version() const { return nvml_version_; }
   const int &get_cuda_version() const { return cuda_version_; }
+  /**
+   * @return how long nvmlInit took in this process; zero when simulated.
+   */
+  std::chrono::microseconds get_init_duration() const {
+    return init_duration_;
+  }
+  /**
+   * @brief Log the init time and persistence mode. Left to the caller, so
+   * the TUI can do it once its log file is set up.
+   */
+  void log_init_summary() const;
   const std::vector<GpuState> &get_gpus() const { return gpus_; }
+  bool is_simulated() const { return simulator_ != nullptr; }
+  /**
+   * @return the simulator behind the GPUs, or null on real hardware. For
+   * tests that drive controllers through this manager.
+   */
+  GpuSimulator *get_simulator() { return simulator_.get(); }
+
+  /**
+   * @brief Apply one GPU's profile, writing only what differs. Safe to call
+   * from a worker thread while the UI thread samples.
+   * @param log receives the lines to print for this GPU.
+   */
+  ApplyResult apply_profile(const GpuState &gs, const OcProfile &profile,
+                            std::vector<std::string> &log);
+
+  /**
+   * @brief Set only the power limit, skipping the write if it matches.
+   * @return true on success
+   */
+  bool set_power_limit(const GpuState &gs, int power_limit_w);
+
+  /**
+   * @return PIDs of the compute and graphics processes running on the GPU.
+   */
+  std::vector<unsigned int> get_process_ids(const GpuState &gs);
+
+  /**
+   * @brief Drive all fans of the GPU at `duty_percent`, clamped to what the
+   * board allows.
+   * @return true on success
+   */
+  bool set_fan_duty(const GpuState &gs, int duty_percent);
+  /**
+   * @brief Hand the fans back to the driver's automatic curve.
+   * @return true on success
+   */
+  bool reset_fans(const GpuState &gs);
+
+  /**
+   * @brief Subscribe to critical Xid errors of all GPUs, for
+   * poll_xid_events.
+   * @return false if the driver does not report them.
+   */
+  bool watch_xid_events();
+  /**
+   * @return Xid errors since the last call, without waiting.
+   */
+  std::vector<XidEvent> poll_xid_events();
+  /**
+   * @return true if the GPU fell off the bus or stopped answering.
+   */
+  bool is_gpu_lost(const GpuState &gs);
 
  private:
   void check(nvmlReturn_t result, const std::string &error_msg);
   nvmlDevice_t get_handle_by_uuid(const std::string &uuid);
+  // Forecasts and bottlenecks, from the samples just taken.
+  void update_derived_state();
 
   std::string driver_version_;
   std::string nvml_version_;
   int cuda_version_;  // major is value/1000, minor is (value%1000)/10
+  std::chrono::microseconds init_duration_{0};
+  size_t persistent_count_ = 0;  // GPUs with persistence mode on at init
   std::vector<GpuState> gpus_;
+  std::unique_ptr<GpuSimulator> simulator_;
+  nvmlEventSet_t xid_events_ = nullptr;
+  std::vector<ThermalForecaster> forecasters_;      // by GPU index
+  std::vector<BottleneckClassifier> classifiers_;  // by GPU index
+  std::chrono::steady_clock::time_point last_sample_time_;
+};
+
+// A profile that crashed a GPU and was rolled back, kept under "unstable"
+// in the GPU's entry of profiles.json.
+struct UnstableProfile {
+  OcProfile profile;
+  std::string preset;  // empty for the main profile
+  std::string reason;  // e.g. "Xid 79"
+  std::string time;    // local time of the fault
 };
 
 class ProfileManager {
@@ -83,6 +384,11 @@ class ProfileManager {
   ProfileManager(const std::string &file_path,
                  const std::vector<GpuState> &gpus);
 
+  /**
+   * @return stock settings of `gpu`, what a missing profile means.
+   */
+  static OcProfile default_profile(const GpuState &gpu);
+
   void load();
   void save();
 
@@ -93,12 +399,73 @@ class ProfileManager {
   const OcProfile &get_profile(const std::string &uuid) const {
     return profiles_.at(uuid);
   }
+  const GovernorConfig &get_governor(const std::string &uuid) const {
+    return governors_.at(uuid);
+  }
+  const NodeConfig &get_node_config() const { return node_; }
+  const RecorderConfig &get_recorder_config() const { return recorder_; }
+  const FanCurve &get_fan_curve(const std::string &uuid) const {
+    return fan_curves_.at(uuid);
+  }
+  /**
+   * @return named presets of one GPU, empty if it has none.
+   */
+  const std::map<std::string, OcProfile> &get_presets(
+      const std::string &uuid) const {
+    static const std::map<std::string, OcProfile> none;
+    auto it = presets_.find(uuid);
+    return it == presets_.end() ? none : it->second;
+  }
+  const std::vector<ProfileRule> &get_rules() const { return rules_; }
   OcProfile &get_profile(const std::string &uuid) {
     return profiles_.at(uuid);
   };
 
+  /**
+   * @return the last profile that ran long enough without a fault, if any.
+   */
+  std::optional<OcProfile> get_last_known_good(const std::string &uuid) const;
+  void set_last_known_good(const std::string &uuid, const OcProfile &profile);
+  /**
+   * @return the latest profile rolled back after a fault, if any.
+   */
+  std::optional<UnstableProfile> get_unstable(const std::string &uuid) const;
+  /**
+   * @brief Replace a GPU's main profile, or its preset `preset`, with the
+   * last-known-good profile (the defaults if there is none or it is the one
+   * that failed) and record the replaced one as unstable.
+   * @return false if it already matched or the preset no longer exists, so
+   * there was nothing to roll back.
+   */
+  bool roll_back(const std::string &uuid, const std::string &preset,
+                 const std::string &reason);
+
  private:
+  // Re-reads "last_known_good" and "unstable" from disk. A GPU rolled back
+  // since also gets its profile and presets from disk.
+  void reload_watchdog_state();
+
   std::string file_path_;
   const std::vector<GpuState> &gpus_;
   std::map<std::string, OcProfile> profiles_;  // Key is UUID
+  std::map<std::string, GovernorConfig> governors_;  // Key is UUID
+  std::map<std::string, FanCurve> fan_curves_;  // Key is UUID
+  NodeConfig node_;
+  RecorderConfig recorder_;
+  // Key is UUID, then preset name.
+  std::map<std::string, std::map<std::string, OcProfile>> presets_;
+  // Keys each preset sets in the file; the rest follows the main profile.
+  std::map<std::string, std::map<std::string, std::set<std::string>>>
+      preset_keys_;
+  std::vector<ProfileRule> rules_;
+  // Rules load() ignored, as found in the file, so that saving keeps them
+  // for the user to fix. Each goes before rules_[first].
+  std::vector<std::pair<size_t, std::string>> rejected_rules_;
+  std::map<std::string, OcProfile> last_known_good_;  // Key is UUID
+  std::map<std::string, UnstableProfile> unstable_;   // Key is UUID
+  // The two above belong to the OC watchdog of the resident helper. Unless
+  // this instance changed them, save() keeps what is on disk, which may be
+  // a rollback that happened after load(); then the GPU's profile and
+  // presets on disk win over the ones held here.
+  bool watchdog_state_changed_ = false;
 };
@@ -0,0 +1,171 @@
+#include "oc_watchdog.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "sys_utils.h"
+
+namespace {
+// Xids an unstable clock typically causes: graphics engine exceptions (13),
+// MMU faults (31), stopped channels (43), internal microcontroller faults
+// (61, 62, 119, 120), graphics engine class errors (69), ECC faults on the
+// memory bus (109) and the GPU falling off the bus (79). Application bugs
+// raise 13, 31 and 43 as well, so an OC that runs stable is still rolled back
+// if a buggy program crashes under it; the unstable entry says so.
+const unsigned long long OC_XIDS[] = {13, 31,  43,  61,  62,
+                                      69, 79, 109, 119, 120};
+
+bool is_oc_xid(unsigned long long xid) {
+  return std::find(std::begin(OC_XIDS), std::end(OC_XIDS), xid) !=
+         std::end(OC_XIDS);
+}
+}  // namespace
+
+OcWatchdog::OcWatchdog(NvmlManager& nvml, std::string profile_path,
+                       std::string boot_guard_path)
+    : nvml_(nvml),
+      profile_path_(std::move(profile_path)),
+      boot_guard_path_(std::move(boot_guard_path)) {}
+
+void OcWatchdog::configure(const ProfileManager& pm) {
+  if (!watching_xid_) {
+    watching_xid_ = nvml_.watch_xid_events();
+    if (!watching_xid_) {
+      std::cerr << "Xid errors are not reported; the OC watchdog only "
+                   "catches GPUs falling off the bus."
+                << std::endl;
+    }
+  }
+  auto now = std::chrono::steady_clock::now();
+  const auto& gpus = nvml_.get_gpus();
+  channels_.clear();
+  for (const auto& gs : gpus) {
+    Channel channel;
+    channel.running = pm.get_profile(gs.uuid);
+    channel.running_since = now;
+    channel.last_known_good = pm.get_last_known_good(gs.uuid);
+    channels_.push_back(std::move(channel));
+  }
+  configured_at_ = now;
+}
+
+bool OcWatchdog::tick(const ProfileSwitcher& switcher) {
+  const auto& gpus = nvml_.get_gpus();
+  auto now = std::chrono::steady_clock::now();
+  bool rolled_back = false;
+
+  for (const auto& event : nvml_.poll_xid_events()) {
+    std::cerr << fmt::format("GPU {}: Xid {}.", event.index, event.xid)
+              << std::endl;
+    if (event.index < channels_.size() && is_oc_xid(event.xid)) {
+      rolled_back |=
+          handle_fault(event.index, switcher.active_preset(event.index),
+                       fmt::format("Xid {}", event.xid));
+    }
+  }
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    Channel& channel = channels_[i];
+    if (!channel.lost && nvml_.is_gpu_lost(gpus[i])) {
+      channel.lost = true;
+      std::cerr << fmt::format("GPU {} fell off the bus.", i) << std::endl;
+      rolled_back |=
+          handle_fault(i, switcher.active_preset(i), "fell off the bus");
+    }
+  }
+  if (rolled_back) {
+    return true;
+  }
+
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    Channel& channel = channels_[i];
+    const OcProfile& running = switcher.applied_profile(i);
+    if (running != channel.running) {
+      channel.running = running;
+      channel.running_since = now;
+      continue;
+    }
+    if (channel.lost || now - channel.running_since < STABLE_AFTER ||
+        channel.last_known_good == running ||
+        running == ProfileManager::default_profile(gpus[i])) {
+      continue;
+    }
+    ProfileManager pm(profile_path_, gpus);
+    pm.set_last_known_good(gpus[i].uuid, running);
+    pm.save();
+    channel.last_known_good = running;
+    std::clog << fmt::format("GPU {}: profile stable for {} minutes, kept as "
+                             "last known good.",
+                             i, STABLE_AFTER.count())
+              << std::endl;
+  }
+
+  if (!boot_guard_path_.empty() && now - configured_at_ >= STABLE_AFTER) {
+    BootGuard::disarm(boot_guard_path_);
+    boot_guard_path_.clear();
+  }
+  return false;
+}
+
+bool OcWatchdog::handle_fault(size_t gpu_index, const std::string& preset,
+                              const std::string& reason) {
+  const GpuState& gs = nvml_.get_gpus()[gpu_index];
+  ProfileManager pm(profile_path_, nvml_.get_gpus());
+  if (!pm.roll_back(gs.uuid, preset, reason)) {
+    std::cerr << fmt::format("GPU {}: already on stock or last known good "
+                             "settings, or the preset is gone; nothing to "
+                             "roll back.",
+                             gpu_index)
+              << std::endl;
+    return false;
+  }
+  pm.save();
+  std::cerr << fmt::format("GPU {}: {} rolled back after {}.", gpu_index,
+                           preset.empty() ? "profile"
+                                          : fmt::format("preset {}", preset),
+                           reason)
+            << std::endl;
+  return true;
+}
+
+namespace BootGuard {
+
+void check_and_arm(const std::vector<GpuState>& gpus,
+                   const std::string& profile_path,
+                   const std::string& guard_path) {
+  std::string boot_id = SysUtils::get_boot_id();
+  if (boot_id.empty()) {
+    return;
+  }
+  std::string armed_by;
+  {
+    std::ifstream file(SysUtils::make_path_string(guard_path));
+    std::getline(file, armed_by);
+  }
+  // The same boot arming again is the unit restarting, not a crash.
+  if (!armed_by.empty() && armed_by != boot_id) {
+    std::cerr << "The previous boot did not shut down cleanly with the "
+                 "profiles applied; rolling them back."
+              << std::endl;
+    ProfileManager pm(profile_path, gpus);
+    bool any = false;
+    for (const auto& gs : gpus) {
+      any |= pm.roll_back(gs.uuid, "", "previous boot did not shut down "
+                                       "cleanly");
+    }
+    if (any) {
+      pm.save();
+    }
+  }
+  SysUtils::replace_file(guard_path, boot_id + "\n");
+}
+
+void disarm(const std::string& guard_path) {
+  std::error_code ec;
+  std::filesystem::remove(SysUtils::make_path_string(guard_path), ec);
+}
+
+}  // namespace BootGuard
@@ -0,0 +1,77 @@
+#pragma once
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nvtuner.h"
+#include "profile_switcher.h"
+
+// Rolls back overclocks that crash a GPU, from the resident helper. Faults
+// are critical Xid errors an unstable clock typically raises and GPUs that
+// fell off the bus. The profile running on the faulty GPU (main profile or
+// preset) is replaced in profiles.json by the last-known-good one and kept
+// under "unstable"; the helper then applies the saved profiles again. A
+// profile that runs STABLE_AFTER without a fault becomes the new
+// last-known-good.
+class OcWatchdog {
+ public:
+  /**
+   * @param boot_guard_path disarmed once the profiles ran STABLE_AFTER; see
+   * BootGuard. Empty when the helper was not started at boot.
+   */
+  OcWatchdog(NvmlManager& nvml, std::string profile_path,
+             std::string boot_guard_path);
+
+  /**
+   * @brief Take the last-known-good profiles from `pm`, after the saved
+   * profiles were applied.
+   */
+  void configure(const ProfileManager& pm);
+
+  /**
+   * @param switcher says which profile each GPU runs.
+   * @return true if profiles.json was rolled back and must be applied again.
+   */
+  bool tick(const ProfileSwitcher& switcher);
+
+  static constexpr std::chrono::minutes STABLE_AFTER{10};
+
+ private:
+  struct Channel {
+    OcProfile running;
+    std::chrono::steady_clock::time_point running_since;
+    std::optional<OcProfile> last_known_good;
+    bool lost = false;  // reported once
+  };
+
+  /**
+   * @return true if the running profile was rolled back.
+   */
+  bool handle_fault(size_t gpu_index, const std::string& preset,
+                    const std::string& reason);
+
+  NvmlManager& nvml_;
+  std::string profile_path_;
+  std::string boot_guard_path_;
+  bool watching_xid_ = false;
+  std::vector<Channel> channels_;  // by GPU index
+  std::chrono::steady_clock::time_point configured_at_;
+};
+
+// Catches boots that crashed or hung with the profiles applied, so a bad
+// overclock cannot boot-loop the machine. The startup unit arms the guard
+// right before applying (`--boot`); a clean shutdown (`--boot-ok`, run as
+// ExecStop) or a stable run under the resident helper disarms it. Finding
+// it armed by another boot means that boot never ended cleanly. Linux only.
+namespace BootGuard {
+/**
+ * @brief If an earlier boot left the guard armed, roll back every main
+ * profile in `profile_path` (see ProfileManager::roll_back). Then arm the
+ * guard for this boot.
+ */
+void check_and_arm(const std::vector<GpuState>& gpus,
+                   const std::string& profile_path,
+                   const std::string& guard_path);
+void disarm(const std::string& guard_path);
+}  // namespace BootGuard
@@ -0,0 +1,165 @@
+#include "power_budget.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+// Idle GPUs still get a share, so they can ramp up before the next period.
+const double MIN_WEIGHT = 0.05;
+// Weight of the newest period against the history.
+const double SMOOTHING = 0.5;
+// Only log redistributions that move some limit at least this much.
+const int LOG_THRESHOLD_W = 10;
+}  // namespace
+
+std::vector<int> PowerBudget::allocate(const std::vector<Demand>& demands,
+                                       int budget_w) {
+  std::vector<int> limits(demands.size());
+  std::vector<double> shares(demands.size());
+  std::vector<bool> fixed(demands.size(), false);
+
+  // Everyone gets the minimum; the rest is filled by weight. A GPU whose
+  // share would pass its maximum is capped there and the excess goes round
+  // again to the others.
+  double remaining = budget_w;
+  for (size_t i = 0; i < demands.size(); ++i) {
+    shares[i] = demands[i].min_w;
+    remaining -= demands[i].min_w;
+  }
+  while (remaining > 0.5) {
+    double total_weight = 0;
+    for (size_t i = 0; i < demands.size(); ++i) {
+      if (!fixed[i]) {
+        total_weight += demands[i].weight;
+      }
+    }
+    if (total_weight <= 0) {
+      break;  // everyone is at the maximum
+    }
+    double handed_out = 0;
+    for (size_t i = 0; i < demands.size(); ++i) {
+      if (fixed[i]) {
+        continue;
+      }
+      double extra = remaining * demands[i].weight / total_weight;
+      if (shares[i] + extra >= demands[i].max_w) {
+        extra = demands[i].max_w - shares[i];
+        fixed[i] = true;
+      }
+      shares[i] += extra;
+      handed_out += extra;
+    }
+    remaining -= handed_out;
+    if (handed_out <= 0.5) {
+      break;
+    }
+  }
+
+  // Round down so rounding can never push the sum over the budget.
+  for (size_t i = 0; i < demands.size(); ++i) {
+    limits[i] = std::max(demands[i].min_w, static_cast<int>(shares[i]));
+  }
+  return limits;
+}
+
+PowerBudget::PowerBudget(NvmlManager& nvml) : nvml_(nvml) {}
+
+void PowerBudget::configure(const NodeConfig& node) {
+  config_ = node;
+  channels_.clear();
+  logged_limits_.clear();
+  elapsed_s_ = 0;
+  if (!active()) {
+    return;
+  }
+  const auto& gpus = nvml_.get_gpus();
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    if (gpus[i].power_limit_min_w >= 0) {
+      channels_.push_back({i});
+    }
+  }
+  std::clog << fmt::format(
+                   "Power budget: {}W across {} GPUs, redistributed every "
+                   "{}s.",
+                   config_.power_budget_w, channels_.size(),
+                   config_.budget_period_s)
+            << std::endl;
+}
+
+void PowerBudget::tick(double dt_s) {
+  if (!active()) {
+    return;
+  }
+  auto now = std::chrono::system_clock::now();
+  for (auto& channel : channels_) {
+    const GpuState& gs = nvml_.get_gpus()[channel.gpu_index];
+    channel.util_sum += std::max(gs.gpu_util_percent, 0) / 100.0;
+    bool capped = gs.last_event_power_cap_time &&
+                  now - *gs.last_event_power_cap_time < std::chrono::seconds(2);
+    channel.pressure_sum += capped ? 1.0 : 0.0;
+    channel.samples++;
+  }
+  elapsed_s_ += dt_s;
+  if (elapsed_s_ >= config_.budget_period_s) {
+    redistribute();
+  }
+}
+
+void PowerBudget::redistribute() {
+  elapsed_s_ = 0;
+  const auto& gpus = nvml_.get_gpus();
+  std::vector<Demand> demands;
+  for (auto& channel : channels_) {
+    const GpuState& gs = gpus[channel.gpu_index];
+    // A GPU held back by its power cap needs watts more than a busy one that
+    // is not, so throttling counts on top of utilization.
+    double weight = 1.0;
+    if (channel.samples > 0) {
+      double period_weight =
+          (channel.util_sum + channel.pressure_sum) / channel.samples;
+      weight = channel.weight > 0 ? SMOOTHING * period_weight +
+                                        (1 - SMOOTHING) * channel.weight
+                                  : period_weight;
+    }
+    channel.weight = std::max(weight, MIN_WEIGHT);
+    channel.util_sum = channel.pressure_sum = 0;
+    channel.samples = 0;
+    demands.push_back({gs.power_limit_min_w, gs.power_limit_max_w,
+                       channel.weight});
+  }
+
+  std::vector<int> limits = allocate(demands, config_.power_budget_w);
+
+  // Decreases first: until they are done, the increases could overshoot.
+  bool decreases_ok = true;
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    const GpuState& gs = gpus[channels_[i].gpu_index];
+    if (limits[i] < gs.power_limit_w &&
+        !nvml_.set_power_limit(gs, limits[i])) {
+      decreases_ok = false;
+    }
+  }
+  if (!decreases_ok) {
+    std::cerr << "Power budget: a decrease failed, holding increases back."
+              << std::endl;
+    return;
+  }
+  bool moved = logged_limits_.size() != limits.size();
+  std::string summary;
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    const GpuState& gs = gpus[channels_[i].gpu_index];
+    if (limits[i] > gs.power_limit_w) {
+      nvml_.set_power_limit(gs, limits[i]);
+    }
+    moved = moved || std::abs(limits[i] - logged_limits_[i]) >= LOG_THRESHOLD_W;
+    summary += fmt::format("{}GPU {} {}W", i ? ", " : "", gs.index, limits[i]);
+  }
+  if (moved) {
+    logged_limits_ = limits;
+    std::clog << fmt::format("Power budget: {}.", summary) << std::endl;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+
+#include "nvtuner.h"
+
+// Shares one node-wide power budget between GPUs (NodeConfig in
+// profiles.json). Every period the budget is split in proportion to each
+// GPU's utilization and power-cap throttling over that period, within the
+// GPUs' own limit constraints. Run by the resident helper.
+//
+// When limits move, decreases are written before increases, so the sum of
+// the limits never exceeds the budget, not even between two writes.
+class PowerBudget {
+ public:
+  struct Demand {
+    int min_w;
+    int max_w;
+    double weight;  // > 0
+  };
+
+  /**
+   * @brief Split `budget_w` by weight, water-filling around the min/max
+   * constraints. Pure, for testing and reuse.
+   * @return one limit per demand; the sum is at most `budget_w` unless the
+   * minimums alone exceed it.
+   */
+  static std::vector<int> allocate(const std::vector<Demand>& demands,
+                                   int budget_w);
+
+  explicit PowerBudget(NvmlManager& nvml);
+
+  /**
+   * @brief Take the budget from `node` and restart. Limits currently on the
+   * GPUs are kept until the first redistribution.
+   */
+  void configure(const NodeConfig& node);
+
+  bool active() const { return config_.power_budget_w > 0; }
+
+  /**
+   * @brief Accumulate one sample; redistribute once a period has passed.
+   * Call with freshly sampled dynamic state.
+   */
+  void tick(double dt_s);
+
+  /**
+   * @brief Redistribute now from the samples so far (or evenly if none).
+   */
+  void redistribute();
+
+ private:
+  struct Channel {
+    size_t gpu_index;
+    double util_sum = 0;
+    double pressure_sum = 0;
+    int samples = 0;
+    double weight = 0;  // smoothed across periods
+  };
+
+  NvmlManager& nvml_;
+  NodeConfig config_;
+  std::vector<Channel> channels_;
+  double elapsed_s_ = 0;
+  std::vector<int> logged_limits_;
+};
@@ -0,0 +1,157 @@
+#include "power_governor.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+// Only log limit changes at least this large, to keep the journal readable.
+const int LOG_THRESHOLD_W = 10;
+// A limit is binding when the board draws at least this fraction of it.
+const double BINDING_RATIO = 0.9;
+// Hold the limit when thermal slowdown is forecast within this many seconds.
+const int SLOWDOWN_LEAD_S = 30;
+}  // namespace
+
+PowerGovernor::PowerGovernor(NvmlManager& nvml) : nvml_(nvml) {}
+
+void PowerGovernor::configure(const ProfileManager& pm) {
+  channels_.clear();
+  const auto& gpus = nvml_.get_gpus();
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    const GovernorConfig& config = pm.get_governor(gpus[i].uuid);
+    if (config.mode == GovernorConfig::Mode::Off) {
+      continue;
+    }
+    if (pm.get_node_config().power_budget_w > 0) {
+      // Two controllers on one power limit would fight.
+      std::clog << fmt::format(
+                       "Governor: GPU {} ignored, the node power budget owns "
+                       "the power limits.",
+                       i)
+                << std::endl;
+      continue;
+    }
+    int limit = pm.get_profile(gpus[i].uuid).power_limit;
+    channels_.push_back({i, config, limit, static_cast<double>(limit), limit,
+                         limit});
+    std::clog << fmt::format(
+                     "Governor: GPU {} holds {} {}{} (+-{}), starting at {}W.",
+                     i,
+                     config.mode == GovernorConfig::Mode::Temperature
+                         ? "temperature"
+                         : "power",
+                     config.target,
+                     config.mode == GovernorConfig::Mode::Temperature ? "C"
+                                                                      : "W",
+                     config.deadband, limit)
+              << std::endl;
+  }
+}
+
+bool PowerGovernor::governs(size_t gpu_index) const {
+  return std::any_of(channels_.begin(), channels_.end(),
+                     [&](const Channel& c) { return c.gpu_index == gpu_index; });
+}
+
+void PowerGovernor::tick(double dt_s) {
+  if (dt_s <= 0) {
+    return;
+  }
+  for (auto& channel : channels_) {
+    step(channel, dt_s);
+  }
+}
+
+void PowerGovernor::step(Channel& channel, double dt_s) {
+  const GpuState& gs = nvml_.get_gpus()[channel.gpu_index];
+  const GovernorConfig& config = channel.config;
+  double measured = config.mode == GovernorConfig::Mode::Temperature
+                        ? gs.temperature_c
+                        : gs.power_usage_w;
+  if (measured < 0) {
+    return;  // sensor unavailable this sample
+  }
+
+  // Positive error: too hot / too much power, so the limit has to come down.
+  double error = measured - config.target;
+  if (std::abs(error) <= config.deadband) {
+    error = 0;
+  }
+
+  double delta = 0;
+  if (channel.samples > 0) {
+    delta -= config.kp * (error - channel.error);
+    // Derivative on the measurement, so target changes do not kick.
+    if (channel.samples > 1) {
+      delta -= config.kd *
+               (measured - 2 * channel.measured + channel.prev_measured) / dt_s;
+    }
+  }
+  delta -= config.ki * error * dt_s;
+
+  // Thermal slowdown already cut the clocks: back off at full rate.
+  auto now = std::chrono::system_clock::now();
+  auto recent = [&](const auto& event_time) {
+    return event_time && now - *event_time < std::chrono::seconds(2);
+  };
+  if (recent(gs.last_event_swt_slowdown_time) ||
+      recent(gs.last_event_hwt_slowdown_time)) {
+    delta = std::min(delta, -config.max_step_w * dt_s);
+  }
+  // Slowdown is forecast soon: do not raise the limit on the way there.
+  if (gs.seconds_to_slowdown >= 0 &&
+      gs.seconds_to_slowdown < SLOWDOWN_LEAD_S) {
+    delta = std::min(delta, 0.0);
+  }
+
+  // Raising a limit the GPU is not even reaching only stores up an overshoot
+  // for when the load comes back. Lowering one has no effect until it reaches
+  // the actual draw, so once over target start from there.
+  if (delta > 0 && gs.power_usage_w < channel.limit_w * BINDING_RATIO) {
+    delta = 0;
+  }
+  if (delta < 0 && error > 0 && gs.power_usage_w > 0 &&
+      gs.power_usage_w < channel.limit_w) {
+    channel.limit_w = gs.power_usage_w;
+  }
+
+  double max_delta = config.max_step_w * dt_s;
+  delta = std::clamp(delta, -max_delta, max_delta);
+  channel.limit_w = std::clamp(channel.limit_w + delta,
+                               static_cast<double>(gs.power_limit_min_w),
+                               static_cast<double>(gs.power_limit_max_w));
+
+  channel.prev_measured = channel.measured;
+  channel.measured = measured;
+  channel.error = error;
+  channel.samples = std::min(channel.samples + 1, 2);
+
+  int limit = static_cast<int>(std::lround(channel.limit_w));
+  if (limit == channel.written_w) {
+    return;
+  }
+  if (!nvml_.set_power_limit(gs, limit)) {
+    channel.limit_w = channel.written_w;
+    return;
+  }
+  channel.written_w = limit;
+  if (std::abs(limit - channel.logged_w) >= LOG_THRESHOLD_W) {
+    channel.logged_w = limit;
+    std::clog << fmt::format("Governor: GPU {} power limit {}W ({}C, {}W).",
+                             gs.index, limit, gs.temperature_c,
+                             gs.power_usage_w)
+              << std::endl;
+  }
+}
+
+void PowerGovernor::restore() {
+  for (const auto& channel : channels_) {
+    if (channel.written_w != channel.profile_limit_w) {
+      nvml_.set_power_limit(nvml_.get_gpus()[channel.gpu_index],
+                            channel.profile_limit_w);
+    }
+  }
+}
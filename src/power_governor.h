@@ -0,0 +1,57 @@
+#pragma once
+#include <chrono>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Closed-loop power limit control for GPUs with a governor configured in
+// profiles.json: adjusts the power limit once per second to hold a target
+// temperature (below the thermal slowdown point, so clocks stay as high as
+// the cooling allows) or a target board power. Run by the resident helper.
+//
+// The PID runs in velocity form: each tick computes a change of the limit,
+// not the limit itself, so clamping to the hardware range and the rate limit
+// cannot wind up an integral term.
+class PowerGovernor {
+ public:
+  explicit PowerGovernor(NvmlManager& nvml);
+
+  /**
+   * @brief Take the governor settings and base power limits from `pm`,
+   * resetting all controller state. Call again after profiles are applied.
+   * Governors are off while a node power budget is set.
+   */
+  void configure(const ProfileManager& pm);
+
+  bool active() const { return !channels_.empty(); }
+  bool governs(size_t gpu_index) const;
+
+  /**
+   * @brief One control step. Call with freshly sampled dynamic state.
+   */
+  void tick(double dt_s);
+
+  /**
+   * @brief Put the profiles' power limits back, e.g. when the helper stops.
+   */
+  void restore();
+
+ private:
+  struct Channel {
+    size_t gpu_index;
+    GovernorConfig config;
+    int profile_limit_w;
+    double limit_w;  // controller output, written rounded
+    int written_w;
+    int logged_w;
+    int samples = 0;  // valid history entries, up to 2
+    double error = 0;
+    double measured = 0;
+    double prev_measured = 0;
+  };
+
+  void step(Channel& channel, double dt_s);
+
+  NvmlManager& nvml_;
+  std::vector<Channel> channels_;
+};
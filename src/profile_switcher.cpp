@@ -0,0 +1,170 @@
+#include "profile_switcher.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+namespace {
+int local_minute_of_day() {
+  std::time_t now = std::chrono::system_clock::to_time_t(
+      std::chrono::system_clock::now());
+  std::tm local = *std::localtime(&now);
+  return local.tm_hour * 60 + local.tm_min;
+}
+
+bool in_window(const ProfileRule& rule, int minute) {
+  if (rule.start_minute < 0) {
+    return true;
+  }
+  if (rule.start_minute <= rule.end_minute) {
+    return minute >= rule.start_minute && minute < rule.end_minute;
+  }
+  return minute >= rule.start_minute || minute < rule.end_minute;  // wraps
+}
+
+std::string describe(const ProfileRule& rule) {
+  std::string text;
+  if (!rule.process.empty()) {
+    text += fmt::format("process {}", rule.process);
+  }
+  if (!rule.cgroup.empty()) {
+    text += fmt::format("{}cgroup {}", text.empty() ? "" : ", ", rule.cgroup);
+  }
+  if (rule.start_minute >= 0) {
+    text += fmt::format("{}{:02}:{:02}-{:02}:{:02}", text.empty() ? "" : ", ",
+                        rule.start_minute / 60, rule.start_minute % 60,
+                        rule.end_minute / 60, rule.end_minute % 60);
+  }
+  return text.empty() ? "always" : text;
+}
+}  // namespace
+
+ProfileSwitcher::ProfileSwitcher(NvmlManager& nvml) : nvml_(nvml) {}
+
+void ProfileSwitcher::configure(const ProfileManager& pm,
+                                std::vector<bool> keep_power_limit) {
+  const auto& gpus = nvml_.get_gpus();
+  rules_ = pm.get_rules();
+  keep_power_limit_ = std::move(keep_power_limit);
+  keep_power_limit_.resize(gpus.size(), false);
+  profiles_.clear();
+  presets_.clear();
+  for (const auto& gs : gpus) {
+    profiles_.push_back(pm.get_profile(gs.uuid));
+    presets_.push_back(pm.get_presets(gs.uuid));
+  }
+  active_.assign(gpus.size(), "");
+  if (active()) {
+    std::clog << fmt::format("Profile rules: {} loaded.", rules_.size())
+              << std::endl;
+  }
+}
+
+const OcProfile& ProfileSwitcher::applied_profile(size_t gpu_index) const {
+  const std::string& preset = active_.at(gpu_index);
+  return preset.empty() ? profiles_.at(gpu_index)
+                        : presets_.at(gpu_index).at(preset);
+}
+
+void ProfileSwitcher::tick() {
+  const auto& gpus = nvml_.get_gpus();
+  int minute = local_minute_of_day();
+  std::set<unsigned int> seen;
+
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    const GpuState& gs = gpus[i];
+    std::vector<unsigned int> pids = nvml_.get_process_ids(gs);
+    seen.insert(pids.begin(), pids.end());
+
+    std::optional<size_t> rule = select(i, minute, pids);
+    std::string preset = rule ? rules_[*rule].preset : "";
+    if (preset == active_[i]) {
+      continue;
+    }
+    active_[i] = preset;
+
+    OcProfile profile = preset.empty() ? profiles_[i] : presets_[i].at(preset);
+    if (keep_power_limit_[i] && gs.power_limit_w >= 0) {
+      profile.power_limit = gs.power_limit_w;
+    }
+    if (preset.empty()) {
+      std::clog << fmt::format("Switching GPU {} back to its profile.", i)
+                << std::endl;
+    } else {
+      std::clog << fmt::format("Switching GPU {} to preset \"{}\" ({}).", i,
+                               preset, describe(rules_[*rule]))
+                << std::endl;
+    }
+    std::vector<std::string> log;
+    ApplyResult result = nvml_.apply_profile(gs, profile, log);
+    (result.success ? std::clog : std::cerr) << log.back() << std::endl;
+  }
+
+  // Forget processes that left every GPU; PIDs get reused.
+  for (auto it = processes_.begin(); it != processes_.end();) {
+    it = seen.count(it->first) ? std::next(it) : processes_.erase(it);
+  }
+}
+
+std::optional<size_t> ProfileSwitcher::select(
+    size_t gpu_index, int minute_of_day,
+    const std::vector<unsigned int>& pids) {
+  for (size_t r = 0; r < rules_.size(); ++r) {
+    const ProfileRule& rule = rules_[r];
+    if (!presets_[gpu_index].count(rule.preset) ||
+        !in_window(rule, minute_of_day)) {
+      continue;
+    }
+    if (!rule.gpus.empty() &&
+        std::find(rule.gpus.begin(), rule.gpus.end(), gpu_index) ==
+            rule.gpus.end()) {
+      continue;
+    }
+    if (!rule.needs_process()) {
+      return r;
+    }
+    for (unsigned int pid : pids) {
+      const ProcessInfo& info = lookup(pid);
+      if ((rule.process.empty() || info.name == rule.process ||
+           info.exe_name == rule.process) &&
+          (rule.cgroup.empty() ||
+           info.cgroup.find(rule.cgroup) != std::string::npos)) {
+        return r;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+const ProfileSwitcher::ProcessInfo& ProfileSwitcher::lookup(unsigned int pid) {
+  auto it = processes_.find(pid);
+  if (it != processes_.end()) {
+    return it->second;
+  }
+  ProcessInfo info;
+#ifndef _WIN32
+  std::ifstream comm(fmt::format("/proc/{}/comm", pid));
+  std::getline(comm, info.name);
+  // comm is cut to 15 characters; argv[0] is not.
+  std::ifstream cmdline(fmt::format("/proc/{}/cmdline", pid));
+  std::string argv0;
+  std::getline(cmdline, argv0, '\0');
+  info.exe_name = argv0.substr(argv0.rfind('/') + 1);
+  // cgroup v2 is a single "0::/path" line; v1 has one line per hierarchy,
+  // all of which are searched.
+  std::ifstream cgroup(fmt::format("/proc/{}/cgroup", pid));
+  std::string line;
+  while (std::getline(cgroup, line)) {
+    size_t path = line.find(':', line.find(':') + 1);
+    if (path != std::string::npos) {
+      info.cgroup += line.substr(path + 1) + "\n";
+    }
+  }
+#endif
+  return processes_.emplace(pid, std::move(info)).first->second;
+}
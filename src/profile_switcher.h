@@ -0,0 +1,65 @@
+#pragma once
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nvtuner.h"
+
+// Applies named presets while matching workloads run (ProfileRule), and the
+// main profile again once they stop. Run by the resident helper twice a
+// second.
+//
+// Processes come from NVML's per-GPU process list, which already says which
+// GPU a workload is on. Only PIDs not seen before are looked up in /proc
+// (name and cgroup), and forgotten once they leave the list, so a tick is a
+// couple of NVML calls in the steady state.
+class ProfileSwitcher {
+ public:
+  explicit ProfileSwitcher(NvmlManager& nvml);
+
+  /**
+   * @brief Take presets and rules from `pm`. The main profiles are assumed
+   * to be applied; the next tick switches wherever a rule matches.
+   * @param keep_power_limit per GPU index: true if another controller owns
+   * the power limit, so presets must not write it.
+   */
+  void configure(const ProfileManager& pm, std::vector<bool> keep_power_limit);
+
+  bool active() const { return !rules_.empty(); }
+
+  /**
+   * @return name of the preset on a GPU, empty for the main profile.
+   */
+  const std::string& active_preset(size_t gpu_index) const {
+    return active_.at(gpu_index);
+  }
+  /**
+   * @return profile on a GPU: its active preset or the main profile.
+   */
+  const OcProfile& applied_profile(size_t gpu_index) const;
+
+  void tick();
+
+ private:
+  struct ProcessInfo {
+    std::string name;      // comm
+    std::string exe_name;  // argv[0] without its directory
+    std::string cgroup;
+  };
+
+  /**
+   * @return index into rules_ of the first match, or nothing.
+   */
+  std::optional<size_t> select(size_t gpu_index, int minute_of_day,
+                               const std::vector<unsigned int>& pids);
+  const ProcessInfo& lookup(unsigned int pid);
+
+  NvmlManager& nvml_;
+  std::vector<ProfileRule> rules_;
+  std::vector<OcProfile> profiles_;                            // by GPU index
+  std::vector<std::map<std::string, OcProfile>> presets_;      // by GPU index
+  std::vector<bool> keep_power_limit_;
+  std::vector<std::string> active_;  // preset per GPU, empty: main profile
+  std::map<unsigned int, ProcessInfo> processes_;  // by PID
+};
@@ -0,0 +1,23 @@
+#include "residency.h"
+
+#include <algorithm>
+
+void Residency::add_sample(const GpuState& gs, double dt_s) {
+  if (dt_s <= 0) {
+    return;
+  }
+  if (gs.gpu_clock_mhz >= 0) {
+    clock_seconds_[std::min(gs.gpu_clock_mhz / CLOCK_BIN_MHZ,
+                            CLOCK_BINS - 1)] += dt_s;
+  }
+  if (gs.pstate >= 0 && gs.pstate < PSTATES) {
+    pstate_seconds_[gs.pstate] += dt_s;
+  }
+  if (gs.temperature_c >= 0) {
+    temp_seconds_[std::min(gs.temperature_c / TEMP_BIN_C, TEMP_BINS - 1)] +=
+        dt_s;
+  }
+  total_seconds_ += dt_s;
+}
+
+void Residency::reset() { *this = Residency{}; }
@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+
+#include "nvtuner.h"
+
+// Time one GPU spent in each graphics clock bin, P-state and temperature
+// bin since the last reset. Averages hide a GPU that alternates between
+// boost and power-capped clocks; residency shows both modes. Each sample
+// is weighted by the time since the previous one, so the result does not
+// depend on how regularly the caller samples.
+class Residency {
+ public:
+  /**
+   * @brief Add a sample taken `dt_s` after the previous one. Unknown
+   * readings (-1) leave their histogram alone.
+   */
+  void add_sample(const GpuState& gs, double dt_s);
+  void reset();
+
+  static constexpr int CLOCK_BIN_MHZ = 100;
+  static constexpr int CLOCK_BINS = 40;  // the last bin takes the rest
+  static constexpr int PSTATES = 16;     // P0 .. P15
+  static constexpr int TEMP_BIN_C = 5;
+  static constexpr int TEMP_BINS = 22;
+
+  const std::array<double, CLOCK_BINS>& clock_seconds() const {
+    return clock_seconds_;
+  }
+  const std::array<double, PSTATES>& pstate_seconds() const {
+    return pstate_seconds_;
+  }
+  const std::array<double, TEMP_BINS>& temp_seconds() const {
+    return temp_seconds_;
+  }
+  double total_seconds() const { return total_seconds_; }
+
+ private:
+  std::array<double, CLOCK_BINS> clock_seconds_{};
+  std::array<double, PSTATES> pstate_seconds_{};
+  std::array<double, TEMP_BINS> temp_seconds_{};
+  double total_seconds_ = 0;
+};
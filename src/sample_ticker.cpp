@@ -0,0 +1,36 @@
+#include "sample_ticker.h"
+
+SampleTicker::SampleTicker(ftxui::ScreenInteractive& screen,
+                           std::chrono::milliseconds period,
+                           std::function<void()> on_tick)
+    : screen_(screen), period_(period), on_tick_(std::move(on_tick)) {
+  thread_ = std::thread(&SampleTicker::run, this);
+}
+
+SampleTicker::~SampleTicker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void SampleTicker::run() {
+  auto next = std::chrono::steady_clock::now() + period_;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!cv_.wait_until(lock, next, [this] { return stop_; })) {
+    // on_tick_ touches state that is rendered, so it must run on the UI
+    // thread. A posted task alone does not redraw; the event that follows it
+    // through the same queue does, once the task has run.
+    screen_.Post(on_tick_);
+    screen_.PostEvent(ftxui::Event::Custom);
+    next += period_;
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      next = now + period_;  // e.g. after a suspend, don't burst
+    }
+  }
+}
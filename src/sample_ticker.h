@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <ftxui/component/screen_interactive.hpp>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Posts `on_tick` to the UI thread at a fixed period, followed by an
+// Event::Custom that makes the screen redraw. The screen only redraws when an
+// event arrives, so an idle nvtuner wakes up once per tick instead of 60
+// times per second.
+class SampleTicker {
+ public:
+  SampleTicker(ftxui::ScreenInteractive& screen,
+               std::chrono::milliseconds period, std::function<void()> on_tick);
+  ~SampleTicker();
+
+  SampleTicker(const SampleTicker&) = delete;
+  SampleTicker& operator=(const SampleTicker&) = delete;
+
+ private:
+  void run();
+
+  ftxui::ScreenInteractive& screen_;
+  std::chrono::milliseconds period_;
+  std::function<void()> on_tick_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,68 @@
+#include "straggler.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+StragglerDetector::StragglerDetector(size_t gpu_count, int threshold,
+                                     Direction slow)
+    : gpu_count_(gpu_count),
+      threshold_(threshold),
+      slow_sign_(slow == Direction::Low ? -1 : 1),
+      deviations_(WINDOW * gpu_count, 0),
+      sums_(gpu_count, 0),
+      slow_counts_(gpu_count, 0) {
+  scratch_.reserve(gpu_count);
+}
+
+void StragglerDetector::add_sample(const std::vector<int>& values) {
+  size_t n = std::min(values.size(), gpu_count_);
+  scratch_.assign(values.begin(), values.begin() + n);
+  median_ = median_of(scratch_);
+  if (median_ < 0) {
+    return;
+  }
+
+  // Replace the oldest row; a single pass of selects and adds, which the
+  // compiler can vectorize.
+  int* row = &deviations_[next_row_ * gpu_count_];
+  const int threshold = threshold_;
+  const int slow_sign = slow_sign_;
+  for (size_t g = 0; g < gpu_count_; ++g) {
+    int old_deviation = row[g];
+    int deviation = g < n && values[g] >= 0 ? values[g] - median_ : 0;
+    row[g] = deviation;
+    sums_[g] += deviation - old_deviation;
+    slow_counts_[g] += (deviation * slow_sign >= threshold) -
+                       (old_deviation * slow_sign >= threshold);
+  }
+  next_row_ = (next_row_ + 1) % WINDOW;
+  filled_ = std::min(filled_ + 1, WINDOW);
+}
+
+int StragglerDetector::median_of(std::vector<int>& values) {
+  values.erase(std::remove_if(values.begin(), values.end(),
+                              [](int v) { return v < 0; }),
+               values.end());
+  if (values.empty()) {
+    return -1;
+  }
+  auto mid = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), mid, values.end());
+  if (values.size() % 2 == 1) {
+    return *mid;
+  }
+  return (*mid + *std::max_element(values.begin(), mid)) / 2;
+}
+
+double StragglerDetector::mean_deviation(size_t gpu) const {
+  return filled_ > 0 ? static_cast<double>(sums_[gpu]) / filled_ : 0.0;
+}
+
+bool StragglerDetector::outlier(size_t gpu) const {
+  return enabled() && std::abs(mean_deviation(gpu)) >= threshold_;
+}
+
+bool StragglerDetector::straggler(size_t gpu) const {
+  return enabled() && filled_ == WINDOW &&
+         slow_counts_[gpu] >= PERSISTENT_FRACTION * WINDOW;
+}
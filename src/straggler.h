@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Compares one metric across the GPUs of a node, e.g. the graphics clock,
+// where in data-parallel work the slowest GPU sets the pace. Each sample is
+// reduced to every GPU's deviation from the node median. The deviations of
+// the last WINDOW samples are kept in one flat sample-major array, and the
+// per-GPU sums and slow counts are updated incrementally, so a sample costs
+// a median plus one pass over the GPUs however long the window is.
+class StragglerDetector {
+ public:
+  // Side a slow GPU deviates to, e.g. low clocks or high temperatures.
+  enum class Direction { Low, High };
+
+  /**
+   * @param threshold deviation from the median that counts as off.
+   */
+  StragglerDetector(size_t gpu_count, int threshold, Direction slow);
+
+  /**
+   * @param values one per GPU; negative (unknown) values are left out of
+   * the median and count as on it.
+   */
+  void add_sample(const std::vector<int>& values);
+
+  /**
+   * @return median of the last sample, -1 if none.
+   */
+  int median() const { return median_; }
+  /**
+   * @return mean deviation from the median over the window, in the
+   * metric's unit.
+   */
+  double mean_deviation(size_t gpu) const;
+  /**
+   * @return true if the mean deviation is `threshold` or more either way.
+   */
+  bool outlier(size_t gpu) const;
+  /**
+   * @return true if the GPU was `threshold` or more on the slow side in
+   * PERSISTENT_FRACTION of a full window.
+   */
+  bool straggler(size_t gpu) const;
+
+  /**
+   * @return median of the non-negative `values`, -1 if none. Drops the
+   * negative ones and reorders the rest.
+   */
+  static int median_of(std::vector<int>& values);
+
+  static constexpr size_t WINDOW = 120;
+  // With two GPUs the median is their mean and both would deviate.
+  static constexpr size_t MIN_GPUS = 3;
+  static constexpr double PERSISTENT_FRACTION = 0.9;
+
+ private:
+  bool enabled() const { return gpu_count_ >= MIN_GPUS && filled_ > 0; }
+
+  size_t gpu_count_;
+  int threshold_;
+  int slow_sign_;  // -1 for Direction::Low, 1 for Direction::High
+
+  std::vector<int> deviations_;  // WINDOW rows of gpu_count_
+  std::vector<long long> sums_;
+  std::vector<int> slow_counts_;
+  std::vector<int> scratch_;  // reused for the median
+  size_t next_row_ = 0;
+  size_t filled_ = 0;
+  int median_ = -1;
+};
@@ -1,48 +1,227 @@
 #include "stream_redirect.h"
 
-std::vector<std::string> LogStreamBuffer::log_messages_;
-std::mutex LogStreamBuffer::log_mutex_;
+#include <fmt/core.h>
 
-int LogStreamBuffer::sync() {
-  std::string content = str();
-  if (content.empty()) {
-    return 0;
+#include <algorithm>
+#include <utility>
+
+namespace {
+const size_t RECENT_LINES = 100;
+const auto FLUSH_INTERVAL = std::chrono::milliseconds(250);
+const auto IDLE_WAKEUP = std::chrono::seconds(1);
+}  // namespace
+
+// --- LogRing ---
+
+LogRing::LogRing(size_t capacity_pow2)
+    : slots_(new Slot[capacity_pow2]), mask_(capacity_pow2 - 1) {
+  for (size_t i = 0; i < capacity_pow2; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool LogRing::try_push(std::string& line) {
+  size_t pos = head_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[pos & mask_];
+    size_t seq = slot.sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<std::ptrdiff_t>(seq) -
+                static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        slot.line = std::move(line);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
   }
+}
+
+bool LogRing::try_pop(std::string& line) {
+  Slot& slot = slots_[tail_ & mask_];
+  if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+    return false;  // empty, or the producer is still writing this slot
+  }
+  line = std::move(slot.line);
+  slot.line = std::string();
+  slot.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+  tail_++;
+  return true;
+}
+
+// --- LogWriter ---
 
-  str("");
+std::deque<std::string> LogWriter::recent_;
+std::mutex LogWriter::recent_mutex_;
+std::atomic<unsigned long long> LogWriter::generation_{0};
+
+LogWriter::LogWriter(std::ofstream& log_file) : log_file_(log_file) {
+  thread_ = std::thread(&LogWriter::run, this);
+}
+
+LogWriter::~LogWriter() {
+  stop_ = true;
+  wake_.notify_one();
+  thread_.join();
+}
+
+void LogWriter::push(std::string line) {
+  if (!ring_.try_push(line)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // Only the first line of a burst pays for the wakeup.
+  if (!pending_.exchange(true, std::memory_order_acq_rel)) {
+    wake_.notify_one();
+  }
+}
+
+bool LogWriter::get_messages(int count, unsigned long long& generation,
+                             std::vector<std::string>& out) {
+  unsigned long long current = generation_.load(std::memory_order_acquire);
+  if (current == generation) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(recent_mutex_);
+  generation = generation_.load(std::memory_order_relaxed);
+  size_t start = recent_.size() > static_cast<size_t>(count)
+                     ? recent_.size() - count
+                     : 0;
+  out.assign(recent_.begin() + start, recent_.end());
+  return true;
+}
+
+void LogWriter::run() {
+  std::string line;
+  std::string batch;
+  bool unflushed = false;
+  auto last_flush = std::chrono::steady_clock::now();
 
-  size_t start = 0;
   while (true) {
-    size_t end = content.find('\n', start);
-    if (end == std::string::npos) {
-      sputn(content.c_str() + start, content.length() - start);
-      break;
+    // A missed notification only delays the batch until the timeout.
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, unflushed ? FLUSH_INTERVAL : IDLE_WAKEUP, [this] {
+        return stop_.load() || pending_.load();
+      });
     }
-    std::string prefixed_line = prefix_ + content.substr(start, end - start);
+    pending_.store(false, std::memory_order_release);
+    bool stopping = stop_.load();
 
+    size_t popped = 0;
     {
-      std::lock_guard<std::mutex> lock(log_mutex_);
-      log_messages_.push_back(prefixed_line);
-      if (log_messages_.size() > 100) {
-        log_messages_.erase(log_messages_.begin(),
-                            log_messages_.begin() + log_messages_.size() - 90);
+      std::lock_guard<std::mutex> lock(recent_mutex_);
+      while (ring_.try_pop(line)) {
+        batch += line;
+        batch += '\n';
+        recent_.push_back(std::move(line));
+        popped++;
+      }
+      size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+      if (dropped > 0) {
+        recent_.push_back(fmt::format(
+            "[Err] Log buffer full, {} lines dropped.", dropped));
+        batch += recent_.back() + '\n';
+        popped++;
       }
+      while (recent_.size() > RECENT_LINES) {
+        recent_.pop_front();
+      }
+    }
+    if (popped > 0) {
+      generation_.fetch_add(1, std::memory_order_release);
     }
 
-    if (log_file_.is_open()) {
-      log_file_ << prefixed_line << std::endl;
+    if (!batch.empty() && log_file_.is_open()) {
+      log_file_.write(batch.data(), batch.size());
+      unflushed = true;
     }
-    start = end + 1;
+    batch.clear();
+
+    auto now = std::chrono::steady_clock::now();
+    if (unflushed && (stopping || now - last_flush >= FLUSH_INTERVAL)) {
+      log_file_.flush();
+      unflushed = false;
+      last_flush = now;
+    }
+    if (stopping) {
+      break;
+    }
+  }
+}
+
+// --- LogStreamBuffer ---
+
+LogStreamBuffer::~LogStreamBuffer() {
+  std::string& line = pending_line();
+  if (!line.empty()) {
+    writer_.push(prefix_ + line);
+    line.clear();
+  }
+}
+
+std::string& LogStreamBuffer::pending_line() {
+  // One partial line per stream per thread. A handful of streams exist, so a
+  // linear lookup is fine.
+  thread_local std::vector<std::pair<const LogStreamBuffer*, std::string>>
+      lines;
+  for (auto& [owner, line] : lines) {
+    if (owner == this) return line;
   }
-  return 0;
+  lines.emplace_back(this, std::string());
+  return lines.back().second;
 }
 
-std::vector<std::string> LogStreamBuffer::get_messages(int count) {
-  std::lock_guard<std::mutex> lock(log_mutex_);
-  std::vector<std::string> result;
-  int start_index = std::max(0, (int)log_messages_.size() - count);
-  for (size_t i = start_index; i < log_messages_.size(); ++i) {
-    result.push_back(log_messages_[i]);
+LogStreamBuffer::int_type LogStreamBuffer::overflow(int_type ch) {
+  if (traits_type::eq_int_type(ch, traits_type::eof())) {
+    return traits_type::not_eof(ch);
+  }
+  char c = traits_type::to_char_type(ch);
+  xsputn(&c, 1);
+  return ch;
+}
+
+std::streamsize LogStreamBuffer::xsputn(const char* s, std::streamsize count) {
+  std::string& line = pending_line();
+  const char* end = s + count;
+  while (s < end) {
+    const char* newline = std::find(s, end, '\n');
+    line.append(s, newline);
+    if (newline == end) {
+      break;
+    }
+    writer_.push(prefix_ + line);
+    line.clear();
+    s = newline + 1;
   }
-  return result;
+  return count;
+}
+
+TimedStreamBuffer::int_type TimedStreamBuffer::overflow(int_type ch) {
+  auto start = std::chrono::steady_clock::now();
+  int_type ret = traits_type::eq_int_type(ch, traits_type::eof())
+                     ? traits_type::not_eof(ch)
+                     : target_->sputc(traits_type::to_char_type(ch));
+  total_time_ += std::chrono::steady_clock::now() - start;
+  return ret;
+}
+
+std::streamsize TimedStreamBuffer::xsputn(const char* s,
+                                          std::streamsize count) {
+  auto start = std::chrono::steady_clock::now();
+  std::streamsize ret = target_->sputn(s, count);
+  total_time_ += std::chrono::steady_clock::now() - start;
+  return ret;
+}
+
+int TimedStreamBuffer::sync() {
+  auto start = std::chrono::steady_clock::now();
+  int ret = target_->pubsync();
+  total_time_ += std::chrono::steady_clock::now() - start;
+  return ret;
 }
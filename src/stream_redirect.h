@@ -1,28 +1,100 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <memory>
 #include <mutex>
-#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-// to buffer log messages to a static shared vector
-class LogStreamBuffer : public std::stringbuf {
+// bounded lock-free queue of log lines: any number of producers, one consumer
+// (Vyukov's MPMC ring with the consumer side simplified)
+class LogRing {
  public:
-  explicit LogStreamBuffer(std::string prefix, std::ofstream& log_file)
-      : prefix_(std::move(prefix)), log_file_(log_file) {}
-  ~LogStreamBuffer() override { pubsync(); }
+  explicit LogRing(size_t capacity_pow2);
 
-  static std::vector<std::string> get_messages(int count);
+  /**
+   * @return false if the ring is full; `line` is left untouched then.
+   */
+  bool try_push(std::string& line);
+  /**
+   * @brief Only call from the consumer thread.
+   */
+  bool try_pop(std::string& line);
 
- protected:
-  int sync() override;
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    std::string line;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) size_t tail_ = 0;
+};
+
+// drains the ring on a background thread: batches file writes, flushes them
+// on a timer and keeps the last lines for the log console
+class LogWriter {
+ public:
+  explicit LogWriter(std::ofstream& log_file);
+  ~LogWriter();
+
+  LogWriter(const LogWriter&) = delete;
+  LogWriter& operator=(const LogWriter&) = delete;
+
+  /**
+   * @brief Never blocks. The line is dropped (and counted) if the ring is full.
+   */
+  void push(std::string line);
+
+  /**
+   * @brief Copy the last `count` lines into `out`, unless nothing was logged
+   * since `generation` was last updated by this call.
+   * @return true if `out` was updated.
+   */
+  static bool get_messages(int count, unsigned long long& generation,
+                           std::vector<std::string>& out);
 
  private:
-  std::string prefix_;
+  void run();
+
   std::ofstream& log_file_;
+  LogRing ring_{4096};
+  std::atomic<size_t> dropped_{0};
 
-  static std::vector<std::string> log_messages_;
-  static std::mutex log_mutex_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> pending_{false};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::thread thread_;
+
+  static std::deque<std::string> recent_;
+  static std::mutex recent_mutex_;
+  static std::atomic<unsigned long long> generation_;
+};
+
+// to split a stream into prefixed log lines. Lines are assembled per thread,
+// so std::clog/std::cerr may be used from any thread.
+class LogStreamBuffer : public std::streambuf {
+ public:
+  LogStreamBuffer(std::string prefix, LogWriter& writer)
+      : prefix_(std::move(prefix)), writer_(writer) {}
+  ~LogStreamBuffer() override;
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char* s, std::streamsize count) override;
+
+ private:
+  std::string& pending_line();
+
+  std::string prefix_;
+  LogWriter& writer_;
 };
 
 // to redirect stream to a LogStreamBuffer
@@ -40,3 +112,20 @@ class StreamRedirector {
   std::ostream& stream_;
   std::streambuf* old_buf_;
 };
+
+// to measure time spent writing to another streambuf (e.g. terminal flushes)
+class TimedStreamBuffer : public std::streambuf {
+ public:
+  explicit TimedStreamBuffer(std::streambuf* target) : target_(target) {}
+
+  std::chrono::nanoseconds total_time() const { return total_time_; }
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char* s, std::streamsize count) override;
+  int sync() override;
+
+ private:
+  std::streambuf* target_;
+  std::chrono::nanoseconds total_time_{0};
+};
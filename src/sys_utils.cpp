@@ -9,10 +9,14 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
 #include <linux/limits.h>
 #include <pwd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstring>
 
 #endif
@@ -21,7 +25,33 @@
 
 namespace {
 const char* SERVICE_NAME = "nvtuner";
+
+#ifndef _WIN32
+bool write_all(int fd, const std::string& content) {
+  for (size_t written = 0; written < content.size();) {
+    ssize_t ret =
+        ::write(fd, content.data() + written, content.size() - written);
+    if (ret < 0 && errno != EINTR) {
+      return false;
+    } else if (ret > 0) {
+      written += static_cast<size_t>(ret);
+    }
+  }
+  return true;
+}
+
+// Running as root, hand `fd` to the owner of the directory `dir_fd` unless
+// that is root too.
+bool chown_to_owner_of(int dir_fd, int fd) {
+  struct stat dir_stat;
+  if (geteuid() != 0 || fstat(dir_fd, &dir_stat) != 0 ||
+      dir_stat.st_uid == 0) {
+    return true;
+  }
+  return fchown(fd, dir_stat.st_uid, dir_stat.st_gid) == 0;
 }
+#endif
+}  // namespace
 
 int SysUtils::exec_command(const std::string& cmd) {
   // return std::system(cmd.c_str());
@@ -194,7 +224,170 @@ SysUtils::path_string_t SysUtils::make_path_string(
 #endif
 }
 
-bool SysUtils::register_startup_task() {
+bool SysUtils::is_elevated() {
+#ifdef _WIN32
+  HANDLE token = nullptr;
+  if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+    return false;
+  }
+  TOKEN_ELEVATION elevation;
+  DWORD size = sizeof(elevation);
+  bool elevated = GetTokenInformation(token, TokenElevation, &elevation,
+                                      sizeof(elevation), &size) &&
+                  elevation.TokenIsElevated;
+  CloseHandle(token);
+  return elevated;
+#else
+  return geteuid() == 0;
+#endif
+}
+
+std::string SysUtils::get_boot_id() {
+#ifdef _WIN32
+  return std::string();
+#else
+  std::ifstream file("/proc/sys/kernel/random/boot_id");
+  std::string boot_id;
+  std::getline(file, boot_id);
+  return boot_id;
+#endif
+}
+
+bool SysUtils::replace_file(const std::string& utf8_path,
+                            const std::string& content) {
+#ifdef _WIN32
+  std::ofstream file(make_path_string(utf8_path), std::ios::binary);
+  file << content;
+  file.close();
+  return static_cast<bool>(file);
+#else
+  std::filesystem::path path(utf8_path);
+  std::string dir =
+      path.has_parent_path() ? path.parent_path().string() : std::string(".");
+  std::string name = path.filename().string();
+  std::string temp_name = fmt::format(".{}.{}.tmp", name, getpid());
+
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+                                     O_CLOEXEC);
+  if (dir_fd < 0) {
+    std::cerr << fmt::format("Cannot open {}: {}", dir, std::strerror(errno))
+              << std::endl;
+    return false;
+  }
+  // A leftover of an interrupted write; O_EXCL below refuses to reuse it.
+  unlinkat(dir_fd, temp_name.c_str(), 0);
+  int fd = openat(dir_fd, temp_name.c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << fmt::format("Cannot create {}/{}: {}", dir, temp_name,
+                             std::strerror(errno))
+              << std::endl;
+    close(dir_fd);
+    return false;
+  }
+
+  bool ok = chown_to_owner_of(dir_fd, fd) && write_all(fd, content);
+  ok = ok && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  ok = ok && renameat(dir_fd, temp_name.c_str(), dir_fd, name.c_str()) == 0;
+  if (!ok) {
+    std::cerr << fmt::format("Cannot write {}: {}", utf8_path,
+                             std::strerror(errno))
+              << std::endl;
+    unlinkat(dir_fd, temp_name.c_str(), 0);
+  }
+  close(dir_fd);
+  return ok;
+#endif
+}
+
+bool SysUtils::create_file(const std::string& utf8_path,
+                           const std::string& content) {
+  std::filesystem::path path(utf8_path);
+  std::filesystem::path dir = path.parent_path();
+#ifdef _WIN32
+  std::error_code ec;
+  std::filesystem::create_directories(make_path_string(dir.u8string()), ec);
+  std::ofstream file(make_path_string(utf8_path), std::ios::binary);
+  file << content;
+  file.close();
+  if (!file) {
+    std::cerr << fmt::format("Cannot write {}", utf8_path) << std::endl;
+    return false;
+  }
+  return true;
+#else
+  std::string parent =
+      dir.has_parent_path() ? dir.parent_path().string() : std::string(".");
+  int parent_fd =
+      open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (parent_fd < 0) {
+    std::cerr << fmt::format("Cannot open {}: {}", parent,
+                             std::strerror(errno))
+              << std::endl;
+    return false;
+  }
+  std::string dir_name = dir.filename().string();
+  bool created = mkdirat(parent_fd, dir_name.c_str(), 0755) == 0;
+  int dir_fd = openat(parent_fd, dir_name.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (dir_fd >= 0 && created) {
+    [[maybe_unused]] bool ok = chown_to_owner_of(parent_fd, dir_fd);
+  }
+  close(parent_fd);
+  if (dir_fd < 0) {
+    std::cerr << fmt::format("Cannot open {}: {}", dir.string(),
+                             std::strerror(errno))
+              << std::endl;
+    return false;
+  }
+
+  std::string name = path.filename().string();
+  int fd = openat(dir_fd, name.c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << fmt::format("Cannot create {}: {}", utf8_path,
+                             std::strerror(errno))
+              << std::endl;
+    close(dir_fd);
+    return false;
+  }
+  bool ok = chown_to_owner_of(dir_fd, fd) && write_all(fd, content);
+  ok = close(fd) == 0 && ok;
+  if (!ok) {
+    std::cerr << fmt::format("Cannot write {}: {}", utf8_path,
+                             std::strerror(errno))
+              << std::endl;
+    unlinkat(dir_fd, name.c_str(), 0);
+  }
+  close(dir_fd);
+  return ok;
+#endif
+}
+
+double SysUtils::get_process_cpu_seconds() {
+#ifdef _WIN32
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time,
+                       &kernel_time, &user_time)) {
+    return 0.0;
+  }
+  auto to_100ns = [](const FILETIME& ft) {
+    return (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) |
+           ft.dwLowDateTime;
+  };
+  return (to_100ns(kernel_time) + to_100ns(user_time)) / 1e7;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0.0;
+  }
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+bool SysUtils::register_startup_task(bool resident) {
   std::string exe_path = get_executable_path();
   if (exe_path.empty()) {
     return false;
@@ -220,15 +413,35 @@ bool SysUtils::register_startup_task() {
   std::string user_service_name =
       fmt::format("{}@{}.service", SERVICE_NAME, user_name);
 
+  // The resident helper keeps running. ExecStart uses exec either way, so
+  // systemd signals nvtuner itself rather than the shell.
+  // `--boot` arms the boot guard (see BootGuard). The one-shot unit stays
+  // active so that its ExecStop disarms it at a clean shutdown; the helper
+  // disarms it itself.
+  args = "--apply-profiles --boot";
+  std::string service_type = "oneshot";
+  std::string service_extra = fmt::format(
+      "RemainAfterExit=yes\n"
+      "ExecStop=/bin/sh -c 'NVTUNER_TARGET_USER=%i exec {} --boot-ok'\n",
+      exe_path);
+  if (resident) {
+    args = "--daemon --boot";
+    service_type = "simple";
+    // Fans must not stay at a fixed duty if the helper dies.
+    service_extra =
+        fmt::format("Restart=on-failure\nExecStopPost={} --reset-fans\n",
+                    exe_path);
+  }
+
   std::string service_template = R"DELIM([Unit]
 Description=Apply nvtuner profiles on startup for %i
 Requires=user@%i.service
 After=user@%i.service
 
 [Service]
-Type=oneshot
-ExecStart=/bin/sh -c 'NVTUNER_TARGET_USER=%i {} {}'
-
+Type={}
+ExecStart=/bin/sh -c 'NVTUNER_TARGET_USER=%i exec {} {}'
+{}
 [Install]
 WantedBy=multi-user.target
 )DELIM";
@@ -238,11 +451,18 @@ WantedBy=multi-user.target
       "{}"
       "EOF\n"
       "systemctl daemon-reload\n"
-      "systemctl enable {}\"";
-  std::string service_content = fmt::format(service_template, exe_path, args);
-
+      "systemctl enable {}\n"
+      "{}\"";
+  std::string service_content = fmt::format(
+      service_template, service_type, exe_path, args, service_extra);
+
+  // Start the helper now rather than at the next boot, or stop a helper left
+  // over from an earlier registration.
+  std::string start_command =
+      fmt::format("systemctl {} {}\n", resident ? "restart" : "stop",
+                  user_service_name);
   command = fmt::format(command_template, service_file_path.string(),
-                        service_content, user_service_name);
+                        service_content, user_service_name, start_command);
   exec_command(command);
 
   std::string check_cmd = fmt::format(
@@ -271,7 +491,7 @@ bool SysUtils::unregister_startup_task() {
 
   std::string command_template =
       "pkexec sh -c '"
-      "systemctl disable {}\n"
+      "systemctl disable --now {}\n"
       "systemctl daemon-reload'";
 
   command = fmt::format(command_template, user_service_name);
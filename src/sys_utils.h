@@ -39,9 +39,46 @@ std::wstring make_wstring_from_utf8(const std::string& utf8);
 path_string_t make_path_string(const std::string& utf8_path);
 
 /**
+ * @return true if running as root / an elevated administrator, i.e. NVML
+ * setters work without going through pkexec or UAC.
+ */
+bool is_elevated();
+
+/**
+ * @return an ID unique to the running boot, empty if unknown (Windows).
+ */
+std::string get_boot_id();
+
+/**
+ * @brief Replace the file at `utf8_path` with `content`. On Linux the
+ * content goes to a new temporary file next to it, created without following
+ * symlinks and renamed into place, so a symlink planted at the path is
+ * replaced rather than written through. Running as root, the file is handed
+ * to the owner of its directory.
+ * @return true on success.
+ */
+bool replace_file(const std::string& utf8_path, const std::string& content);
+
+/**
+ * @brief Create the file at `utf8_path` with `content`, and its directory if
+ * missing (not further up). Fails if the file exists. On Linux, as in
+ * replace_file, nothing on the way follows a symlink and, running as root,
+ * the directory and file are handed to the owner of the directory above.
+ * @return true on success; failures are logged.
+ */
+bool create_file(const std::string& utf8_path, const std::string& content);
+
+/**
+ * @return user + kernel CPU time consumed by this process, in seconds.
+ */
+double get_process_cpu_seconds();
+
+/**
+ * @param resident on Linux, keep `nvtuner --daemon` running instead of
+ * applying once, so the TUI can apply without pkexec.
  * @return true on success.
  */
-bool register_startup_task();
+bool register_startup_task(bool resident = false);
 bool unregister_startup_task();
 bool call_apply_profiles_as_root();
 }  // namespace SysUtils
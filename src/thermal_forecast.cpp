@@ -0,0 +1,140 @@
+#include "thermal_forecast.h"
+
+#include <cmath>
+
+namespace {
+// Per second, so about the last minute dominates the fit whatever the
+// sampling rate.
+const double FORGETTING = 0.985;
+const double INITIAL_COVARIANCE = 1000.0;
+// Without excitation (steady power and temperature) forgetting would blow up
+// the covariance; it stops once its trace reaches this.
+const double MAX_COVARIANCE_TRACE = 1e5;
+// Seconds of fitted data before forecasting.
+const double MIN_FIT_S = 20.0;
+// Samples are gathered into intervals of at least this long before a fit
+// step: the temperature is reported in whole degrees, so slopes over a
+// tenth of a second are mostly rounding noise. A second, less some jitter,
+// so a 1 Hz sampler still steps on every sample.
+const double INTERVAL_S = 0.8;
+// Samples further apart than this (e.g. a paused sampler) restart the slope.
+const double MAX_DT_S = 5.0;
+// Inputs are scaled to ~1 to keep the covariance well conditioned.
+const double SCALE = 100.0;
+
+std::array<double, 3> regressor(int temperature_c, int power_w) {
+  return {1.0, power_w / SCALE, temperature_c / SCALE};
+}
+}  // namespace
+
+ThermalForecaster::ThermalForecaster() { reset(); }
+
+void ThermalForecaster::reset() {
+  theta_ = {};
+  for (size_t i = 0; i < 3; ++i) {
+    cov_[i] = {};
+    cov_[i][i] = INITIAL_COVARIANCE;
+  }
+  fit_s_ = 0;
+  interval_s_ = 0;
+}
+
+void ThermalForecaster::add_sample(double dt_s, int temperature_c,
+                                   int power_w) {
+  if (temperature_c < 0 || power_w < 0) {
+    temperature_c_ = -1;
+    return;
+  }
+  if (temperature_c_ < 0 || dt_s > MAX_DT_S) {
+    temperature_c_ = temperature_c;
+    power_w_ = power_w;
+    interval_temperature_c_ = temperature_c;
+    interval_s_ = 0;
+    interval_energy_j_ = 0;
+    return;
+  }
+  temperature_c_ = temperature_c;
+  power_w_ = power_w;
+  if (dt_s <= 0) {
+    return;
+  }
+  interval_s_ += dt_s;
+  interval_energy_j_ += power_w * dt_s;
+  if (interval_s_ < INTERVAL_S) {
+    return;
+  }
+
+  // The slope over the interval, against the power drawn during it (NVML
+  // averages power over about a second) and the temperature it started at.
+  double slope = (temperature_c - interval_temperature_c_) / interval_s_;
+  auto x = regressor(interval_temperature_c_,
+                     static_cast<int>(interval_energy_j_ / interval_s_));
+  double interval_s = interval_s_;
+  interval_temperature_c_ = temperature_c;
+  interval_s_ = 0;
+  interval_energy_j_ = 0;
+
+  std::array<double, 3> px{};
+  double denominator = 0;
+  double trace = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      px[i] += cov_[i][j] * x[j];
+    }
+    denominator += x[i] * px[i];
+    trace += cov_[i][i];
+  }
+  double lambda =
+      trace < MAX_COVARIANCE_TRACE ? std::pow(FORGETTING, interval_s) : 1.0;
+  denominator += lambda;
+
+  double error = slope;
+  for (size_t i = 0; i < 3; ++i) {
+    error -= theta_[i] * x[i];
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    theta_[i] += px[i] / denominator * error;
+  }
+  // P = (P - P x x' P / (lambda + x' P x)) / lambda; P is symmetric.
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      cov_[i][j] = (cov_[i][j] - px[i] * px[j] / denominator) / lambda;
+    }
+  }
+  fit_s_ += interval_s;
+}
+
+int ThermalForecaster::seconds_to(int threshold_c) const {
+  if (threshold_c <= 0 || temperature_c_ < 0) {
+    return -1;
+  }
+  if (temperature_c_ >= threshold_c) {
+    return 0;
+  }
+  if (fit_s_ < MIN_FIT_S) {
+    return -1;
+  }
+
+  auto x = regressor(temperature_c_, power_w_);
+  double slope = theta_[0] * x[0] + theta_[1] * x[1] + theta_[2] * x[2];
+  double rate = -theta_[2] / SCALE;  // 1 / time constant
+  double seconds;
+  if (rate > 1e-4) {
+    double steady_c = temperature_c_ + slope / rate;
+    if (steady_c <= threshold_c) {
+      return -1;
+    }
+    seconds = std::log((steady_c - temperature_c_) / (steady_c - threshold_c)) /
+              rate;
+  } else {
+    // No cooling term fitted yet: extrapolate the slope.
+    if (slope <= 0) {
+      return -1;
+    }
+    seconds = (threshold_c - temperature_c_) / slope;
+  }
+  if (seconds > HORIZON_S) {
+    return -1;
+  }
+  return static_cast<int>(std::ceil(seconds));
+}
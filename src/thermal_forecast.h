@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+
+// Online first-order thermal model of one GPU, dT/dt = a + b * P + c * T,
+// fitted by recursive least squares with exponential forgetting so it
+// follows fan and ambient changes. Held at the current power, the model
+// heads exponentially towards a steady temperature; seconds_to() is when it
+// crosses a threshold on the way. Samples are gathered into steps of about a
+// second and forgetting is per second, so the fit does not depend on how
+// often it is fed. Fed by NvmlManager::update_dynamic_state.
+class ThermalForecaster {
+ public:
+  ThermalForecaster();
+
+  /**
+   * @brief Add a sample taken `dt_s` after the previous one.
+   */
+  void add_sample(double dt_s, int temperature_c, int power_w);
+
+  /**
+   * @return seconds until the temperature reaches `threshold_c` at the
+   * current power; 0 if it already has, -1 if not within HORIZON_S or the
+   * model has seen too little data yet.
+   */
+  int seconds_to(int threshold_c) const;
+
+  static constexpr int HORIZON_S = 600;
+
+ private:
+  void reset();
+
+  std::array<double, 3> theta_;                // a, b, c on scaled inputs
+  std::array<std::array<double, 3>, 3> cov_;  // RLS covariance
+  double fit_s_ = 0;        // seconds of data fitted
+  int temperature_c_ = -1;  // last sample
+  int power_w_ = -1;
+  // The interval being gathered for the next fit step.
+  int interval_temperature_c_ = -1;  // at its start
+  double interval_s_ = 0;
+  double interval_energy_j_ = 0;
+};
@@ -0,0 +1,16 @@
+#pragma once
+#include <fmt/core.h>
+
+#include <cstdlib>
+#include <iostream>
+
+// Stops the test with the failed condition and where it is.
+#define CHECK(condition)                                                 \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      std::cerr << fmt::format("{}:{}: CHECK({}) failed.", __FILE__,     \
+                               __LINE__, #condition)                     \
+                << std::endl;                                            \
+      std::exit(1);                                                      \
+    }                                                                    \
+  } while (false)
@@ -0,0 +1,43 @@
+// AutoTuner on a simulated GPU under steady full load. The simulated
+// workload crashes above an offset the tuner is not told, like a real
+// unstable overclock.
+#include "auto_tuner.h"
+#include "check.h"
+
+namespace {
+TuningResult tune() {
+  SimulatedTuningBackend backend(2, 0);
+  AutoTuner tuner(backend);
+  TuningResult result =
+      tuner.run(ProfileManager::default_profile(backend.gpu()));
+  CHECK(result.success);
+
+  // The tuner leaves the result applied; the workload must survive it.
+  for (int i = 0; i < 120; ++i) {
+    backend.wait_and_sample(0.5);
+    CHECK(backend.gpu().gpu_util_percent >= 90);
+  }
+
+  const GpuState& gs = backend.gpu();
+  const OcProfile& profile = result.profile;
+  CHECK(profile.power_limit >= gs.power_limit_min_w &&
+        profile.power_limit <= gs.power_limit_max_w);
+  CHECK(profile.gpu_clock_offset >= gs.clock_offset_min_mhz &&
+        profile.gpu_clock_offset <= gs.clock_offset_max_mhz);
+  CHECK(profile.max_gpu_clock >= 0 &&
+        profile.max_gpu_clock <= gs.gpu_max_clock_mhz);
+  return result;
+}
+}  // namespace
+
+int main() {
+  TuningResult result = tune();
+  CHECK(result.best.perf_per_watt() > result.baseline.perf_per_watt());
+  CHECK(result.best.perf() >=
+        TuningOptions{}.min_perf_ratio * result.baseline.perf());
+
+  // The simulator is seeded, so a second search ends in the same place.
+  TuningResult again = tune();
+  CHECK(again.profile == result.profile);
+  return 0;
+}
@@ -0,0 +1,41 @@
+// Once a sample has been formatted, redrawing it must not allocate: the
+// sparklines and the dashboard's clock event labels are formatted into
+// buffers that keep their capacity.
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include "alloc_counter.h"
+#include "check.h"
+#include "components/dashboard.h"
+#include "components/sparklines.h"
+
+int main() {
+  std::deque<int> data;
+  for (size_t i = 0; i < GpuStateSamples::MAX_SAMPLES; ++i) {
+    data.push_back(static_cast<int>(i * 37 % 101));
+  }
+  std::string sparkline;
+  Sparklines::format_sparkline(data, 0, 100, sparkline);
+  CHECK(sparkline.size() == 3 * GpuStateSamples::MAX_SAMPLES);
+
+  GpuState gs;
+  auto now = std::chrono::system_clock::now();
+  gs.last_event_power_cap_time = now - std::chrono::hours(3);
+  gs.last_event_hwt_slowdown_time = now - std::chrono::hours(50);
+  std::string labels[3];
+  std::string scratch;
+  CHECK(format_clock_event_labels(gs, labels, scratch));
+  CHECK(labels[0] == "PC:3h" && labels[1] == "ST:-" && labels[2] == "HT:2d");
+
+  uint64_t before = AllocCounter::count();
+  bool changed = false;
+  for (int frame = 0; frame < 100; ++frame) {
+    Sparklines::format_sparkline(data, 0, 100, sparkline);
+    changed |= format_clock_event_labels(gs, labels, scratch);
+  }
+  uint64_t allocations = AllocCounter::count() - before;
+  CHECK(!changed);
+  CHECK(allocations == 0);
+  return 0;
+}
@@ -0,0 +1,66 @@
+// PowerBudget::allocate splits a node's budget by weight within each GPU's
+// limit range.
+#include <numeric>
+#include <vector>
+
+#include "check.h"
+#include "power_budget.h"
+
+namespace {
+int sum(const std::vector<int>& limits) {
+  return std::accumulate(limits.begin(), limits.end(), 0);
+}
+
+void test_over_subscribed() {
+  // The minimums alone exceed the budget; nothing goes below them.
+  std::vector<int> limits = PowerBudget::allocate(
+      {{150, 300, 1.0}, {150, 300, 1.0}, {100, 200, 1.0}}, 350);
+  CHECK((limits == std::vector<int>{150, 150, 100}));
+}
+
+void test_idle_floor_weight() {
+  // An idle GPU at the floor weight still gets a small share above its
+  // minimum, the busy one the rest.
+  std::vector<int> limits =
+      PowerBudget::allocate({{100, 300, 1.0}, {100, 300, 0.05}}, 400);
+  CHECK(limits[0] == 290);
+  CHECK(limits[1] == 109);
+  CHECK(sum(limits) <= 400);
+}
+
+void test_capped_at_max() {
+  // The first GPU's half of the spare 300W passes its maximum; the excess
+  // goes to the second.
+  std::vector<int> limits =
+      PowerBudget::allocate({{100, 150, 1.0}, {100, 400, 1.0}}, 500);
+  CHECK((limits == std::vector<int>{150, 350}));
+
+  // More than everyone can take: all at the maximum, the rest unused.
+  limits = PowerBudget::allocate({{100, 150, 1.0}, {100, 400, 2.0}}, 1000);
+  CHECK((limits == std::vector<int>{150, 400}));
+}
+
+void test_rounding() {
+  // Shares are rounded down, so the sum never passes the budget.
+  std::vector<int> limits = PowerBudget::allocate(
+      {{0, 100, 1.0}, {0, 100, 1.0}, {0, 100, 1.0}}, 100);
+  CHECK((limits == std::vector<int>{33, 33, 33}));
+
+  limits = PowerBudget::allocate(
+      {{90, 450, 0.3}, {90, 450, 0.7}, {90, 450, 0.45}, {90, 450, 0.05}},
+      1001);
+  CHECK(sum(limits) <= 1001);
+  CHECK(sum(limits) >= 1001 - static_cast<int>(limits.size()));
+  for (int limit : limits) {
+    CHECK(limit >= 90 && limit <= 450);
+  }
+}
+}  // namespace
+
+int main() {
+  test_over_subscribed();
+  test_idle_floor_weight();
+  test_capped_at_max();
+  test_rounding();
+  return 0;
+}
@@ -0,0 +1,95 @@
+// PowerBudget redistributing between simulated GPUs as their load shifts.
+// Every power limit write is replayed: the sum of the limits must stay
+// within the budget after each one, and a failed decrease must hold the
+// increases back.
+#include <numeric>
+#include <vector>
+
+#include "check.h"
+#include "gpu_simulator.h"
+#include "power_budget.h"
+
+namespace {
+const int BUDGET_W = 700;
+
+struct Replay {
+  std::vector<int> limits;
+  int increases = 0;  // in the last run()
+  int decreases = 0;
+};
+
+// Apply the writes since the last call to `replay`, checking the sum after
+// each and that no decrease follows an increase.
+void replay_writes(GpuSimulator& sim, Replay& replay) {
+  bool increased = false;
+  for (const auto& [index, power_limit_w] : sim.take_power_limit_writes()) {
+    int& limit = replay.limits.at(index);
+    if (power_limit_w > limit) {
+      increased = true;
+      replay.increases++;
+    } else if (power_limit_w < limit) {
+      CHECK(!increased);
+      replay.decreases++;
+    }
+    limit = power_limit_w;
+    CHECK(std::accumulate(replay.limits.begin(), replay.limits.end(), 0) <=
+          BUDGET_W);
+  }
+}
+
+// Sample and tick once a second for `seconds`, replaying every period.
+void run(NvmlManager& nvml, PowerBudget& budget, Replay& replay,
+         int seconds) {
+  replay.increases = replay.decreases = 0;
+  for (int i = 0; i < seconds; ++i) {
+    nvml.get_simulator()->skip_time(1.0);
+    nvml.update_dynamic_state();
+    budget.tick(1.0);
+    replay_writes(*nvml.get_simulator(), replay);
+  }
+}
+}  // namespace
+
+int main() {
+  NvmlManager nvml(4);
+  GpuSimulator& sim = *nvml.get_simulator();
+  const auto& gpus = nvml.get_gpus();
+
+  // Start within the budget, so it must hold from the first write on.
+  Replay replay;
+  for (const GpuState& gs : gpus) {
+    CHECK(nvml.set_power_limit(gs, gs.power_limit_min_w));
+    replay.limits.push_back(gs.power_limit_min_w);
+  }
+  sim.take_power_limit_writes();
+
+  PowerBudget budget(nvml);
+  NodeConfig node;
+  node.power_budget_w = BUDGET_W;
+  node.budget_period_s = 2;
+  budget.configure(node);
+
+  // GPU 0 busy, the rest idle: it gets most of the budget.
+  sim.hold_load(gpus[0], 1.0);
+  for (size_t i = 1; i < gpus.size(); ++i) {
+    sim.hold_load(gpus[i], 0.0);
+  }
+  run(nvml, budget, replay, 10);
+  CHECK(replay.limits[0] > replay.limits[1] + 100);
+
+  // The load moves to GPU 1; GPU 0's decrease is refused, so nothing may
+  // be raised.
+  sim.hold_load(gpus[0], 0.0);
+  sim.hold_load(gpus[1], 1.0);
+  sim.fail_power_limit(gpus[0], true);
+  int held_back = replay.limits[1];
+  run(nvml, budget, replay, 10);
+  CHECK(replay.limits[1] == held_back);
+  CHECK(replay.increases == 0);
+
+  // Once GPU 0 takes writes again the budget follows the load.
+  sim.fail_power_limit(gpus[0], false);
+  run(nvml, budget, replay, 10);
+  CHECK(replay.limits[1] > replay.limits[0]);
+  return 0;
+}